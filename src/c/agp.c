@@ -0,0 +1,196 @@
+#include "agp.h"
+#include "config.h"
+#include "history.h"
+#include "metrics.h"
+#include "scheduler.h"
+
+// Persist keys. settings.c uses 1, journal.c 16 and up, daily.c 80 and up.
+#define PERSIST_KEY_WEEK 64
+#define PERSIST_KEY_COUNTS 65 // COUNT_KEYS keys
+#define COUNT_KEYS ((AGP_PERSIST_SIZE + PERSIST_DATA_MAX_LENGTH - 1) / PERSIST_DATA_MAX_LENGTH)
+#define PERSIST_KEY_NEWEST (PERSIST_KEY_COUNTS + COUNT_KEYS)
+
+#define WEEK_SECONDS (7 * 24 * 60 * 60)
+
+// Changes are written this long after the first one [milliseconds]
+#define PERSIST_DELAY_MS (60 * 60 * 1000)
+#define PERSIST_SLACK_MS (10 * 60 * 1000)
+
+// Bin edges [mg/dL], narrowest around the target range. Values below the first edge count in the
+// first bin, values above the last in the last bin.
+static const uint16_t BIN_EDGES[AGP_BINS + 1] = {40,  60,  70,  80,  90,  100, 110, 120, 135,
+                                                 150, 165, 180, 200, 225, 250, 300, 400};
+
+// Readings per bin, bucket and week: [0] the current week, [1] the previous one. A bin saturates
+// at 255, which one minute readings in a single bin for a whole week stay below.
+static uint8_t s_counts[2][AGP_BUCKETS][AGP_BINS];
+static uint32_t s_week = 0;      // Of the current set, weeks since epoch
+static uint32_t s_newest = 0;    // Timestamp of the newest reading counted
+static uint8_t s_dirty_keys = 0; // Bit per count key
+static bool s_is_persist_pending = false;
+
+static uint8_t bin_index(uint16_t mgdl) {
+    uint8_t bin = AGP_BINS - 1;
+    while (bin > 0 && mgdl < BIN_EDGES[bin]) {
+        bin--;
+    }
+    return bin;
+}
+
+// Returns the time-of-day bucket of `timestamp`, and sets `into_bucket` to the seconds since it
+// started.
+static uint8_t bucket_index(uint32_t timestamp, uint32_t *into_bucket) {
+    const time_t time = timestamp;
+    const struct tm *tm = localtime(&time);
+    const uint32_t seconds = tm->tm_hour * 60 * 60 + tm->tm_min * 60 + tm->tm_sec;
+    *into_bucket = seconds % AGP_BUCKET_SECONDS;
+    return seconds / AGP_BUCKET_SECONDS;
+}
+
+static void persist_callback(void *context) {
+    s_is_persist_pending = false;
+    if (s_dirty_keys == 0) {
+        return;
+    }
+    const uint8_t *data = &s_counts[0][0][0];
+    for (uint8_t key = 0; key < COUNT_KEYS; key++) {
+        if (s_dirty_keys & (1 << key)) {
+            const size_t offset = key * PERSIST_DATA_MAX_LENGTH;
+            const size_t remaining = AGP_PERSIST_SIZE - offset;
+            const size_t length =
+                remaining < PERSIST_DATA_MAX_LENGTH ? remaining : PERSIST_DATA_MAX_LENGTH;
+            persist_write_data(PERSIST_KEY_COUNTS + key, data + offset, length);
+            metrics_record_flash_write(length);
+        }
+    }
+    persist_write_int(PERSIST_KEY_WEEK, s_week);
+    persist_write_int(PERSIST_KEY_NEWEST, s_newest);
+    metrics_record_flash_write(2 * sizeof(int32_t));
+    s_dirty_keys = 0;
+}
+
+static SchedulerTask s_persist_task = {.callback = persist_callback};
+
+// Marks the count key holding `offset` for the next write.
+static void mark_dirty(size_t offset) {
+    s_dirty_keys |= 1 << (offset / PERSIST_DATA_MAX_LENGTH);
+    if (!s_is_persist_pending) {
+        s_is_persist_pending = true;
+        scheduler_schedule(&s_persist_task, PERSIST_DELAY_MS, PERSIST_SLACK_MS);
+    }
+}
+
+static void roll_to(uint32_t week) {
+    if (week == s_week + 1) {
+        memcpy(s_counts[1], s_counts[0], sizeof(s_counts[0]));
+    } else {
+        memset(s_counts[1], 0, sizeof(s_counts[1]));
+    }
+    memset(s_counts[0], 0, sizeof(s_counts[0]));
+    s_week = week;
+    for (size_t offset = 0; offset < AGP_PERSIST_SIZE; offset += PERSIST_DATA_MAX_LENGTH) {
+        mark_dirty(offset);
+    }
+}
+
+// Interpolates the percentile linearly within the bin it falls into.
+static uint16_t percentile(const uint16_t *counts, uint16_t total, uint8_t percent) {
+    const uint32_t rank = (uint32_t)total * percent; // In hundredths of a reading
+    uint32_t below = 0;
+    for (uint8_t bin = 0; bin < AGP_BINS; bin++) {
+        const uint32_t in_bin = counts[bin] * 100;
+        if (in_bin > 0 && below + in_bin >= rank) {
+            const uint16_t width = BIN_EDGES[bin + 1] - BIN_EDGES[bin];
+            return BIN_EDGES[bin] + width * (rank - below) / in_bin;
+        }
+        below += in_bin;
+    }
+    return BIN_EDGES[AGP_BINS];
+}
+
+void agp_init(void) {
+    if (persist_exists(PERSIST_KEY_WEEK)) {
+        s_week = persist_read_int(PERSIST_KEY_WEEK);
+    }
+    uint8_t *data = &s_counts[0][0][0];
+    for (uint8_t key = 0; key < COUNT_KEYS; key++) {
+        const size_t offset = key * PERSIST_DATA_MAX_LENGTH;
+        const size_t remaining = AGP_PERSIST_SIZE - offset;
+        const size_t length =
+            remaining < PERSIST_DATA_MAX_LENGTH ? remaining : PERSIST_DATA_MAX_LENGTH;
+        if (persist_read_data(PERSIST_KEY_COUNTS + key, data + offset, length) != (int)length) {
+            memset(data + offset, 0, length);
+        }
+    }
+
+    // Readings the history restored that came after the last write, which a crash or power cut
+    // lost from the histograms. Without a written timestamp, as from a version that didn't write
+    // one, the history is taken as counted. Backfilled readings older than the newest one written
+    // are not recovered.
+    const uint16_t count = history_count();
+    if (persist_exists(PERSIST_KEY_NEWEST)) {
+        s_newest = persist_read_int(PERSIST_KEY_NEWEST);
+    } else if (count > 0) {
+        s_newest = history_get(0)->timestamp;
+    }
+    uint16_t age = 0;
+    while (age < count && history_get(age)->timestamp > s_newest) {
+        age++;
+    }
+    while (age > 0) {
+        age--;
+        agp_add(history_get(age)->timestamp, history_get(age)->mgdl);
+    }
+
+    // Weeks may have passed since the face last ran
+    const uint32_t week = time(NULL) / WEEK_SECONDS;
+    if (week > s_week) {
+        roll_to(week);
+    }
+}
+
+void agp_deinit(void) {
+    scheduler_cancel(&s_persist_task);
+    persist_callback(NULL);
+}
+
+void agp_add(uint32_t timestamp, uint16_t mgdl) {
+    const uint32_t week = timestamp / WEEK_SECONDS;
+    if (week > s_week) {
+        roll_to(week);
+    } else if (week + 1 < s_week) {
+        return;
+    }
+
+    if (timestamp > s_newest) {
+        s_newest = timestamp;
+    }
+    uint32_t into_bucket;
+    const uint8_t bucket = bucket_index(timestamp, &into_bucket);
+    uint8_t *count = &s_counts[s_week - week][bucket][bin_index(mgdl)];
+    if (*count < UINT8_MAX) {
+        (*count)++;
+        mark_dirty(count - &s_counts[0][0][0]);
+    }
+}
+
+uint32_t agp_get(uint32_t timestamp, AgpBucket *bucket) {
+    uint32_t into_bucket;
+    const uint8_t index = bucket_index(timestamp, &into_bucket);
+    uint16_t counts[AGP_BINS];
+    uint16_t total = 0;
+    for (uint8_t bin = 0; bin < AGP_BINS; bin++) {
+        counts[bin] = s_counts[0][index][bin] + s_counts[1][index][bin];
+        total += counts[bin];
+    }
+
+    *bucket = (AgpBucket){.count = total};
+    if (total >= AGP_MIN_READINGS) {
+        bucket->p10_mgdl = percentile(counts, total, 10);
+        bucket->p25_mgdl = percentile(counts, total, 25);
+        bucket->p50_mgdl = percentile(counts, total, 50);
+        bucket->p75_mgdl = percentile(counts, total, 75);
+        bucket->p90_mgdl = percentile(counts, total, 90);
+    }
+    return AGP_BUCKET_SECONDS - into_bucket;
+}
@@ -0,0 +1,48 @@
+// Ambulatory glucose profile: median and 10/25/75/90 percentiles per 30 minute time-of-day bucket,
+// over the last one to two weeks, shown as bands behind the graph.
+//
+// The watch can't keep two weeks of readings, so each bucket only counts readings in a small
+// histogram with fixed bins, which makes adding a reading O(1). Percentiles are interpolated
+// within the bins, so they are accurate to a fraction of a bin width: 10 mg/dL in the target
+// range, up to 50 mg/dL far above it. There is one set of histograms for the current week and one
+// for the previous week. At the start of a week, the current set becomes the previous one and the
+// oldest is dropped.
+//
+// The histograms take AGP_PERSIST_SIZE bytes of RAM and persistent storage. Changed parts are
+// written once an hour and when the face exits. After a crash, the readings of the last hour are
+// counted again from the history the journal restores.
+
+#pragma once
+
+#include <pebble.h>
+
+#define AGP_BUCKET_SECONDS (30 * 60)
+#define AGP_BUCKETS (24 * 60 * 60 / AGP_BUCKET_SECONDS)
+#define AGP_BINS 16
+#define AGP_PERSIST_SIZE (2 * AGP_BUCKETS * AGP_BINS)
+
+// Fewer readings than this in a bucket don't give meaningful percentiles
+#define AGP_MIN_READINGS 12
+
+typedef struct {
+    uint16_t count; // Readings in the bucket
+    uint16_t p10_mgdl;
+    uint16_t p25_mgdl;
+    uint16_t p50_mgdl;
+    uint16_t p75_mgdl;
+    uint16_t p90_mgdl;
+} AgpBucket;
+
+// Loads the persisted histograms, and counts the readings of the history that are newer than the
+// last write. Call once the journal has restored the history.
+void agp_init(void);
+
+// Writes what changed since the last write.
+void agp_deinit(void);
+
+// Adds a reading, new or backfilled. Readings before the previous week are ignored.
+void agp_add(uint32_t timestamp, uint16_t mgdl);
+
+// Gets the bucket that `timestamp` falls into. Percentiles are only set if it has at least
+// AGP_MIN_READINGS readings. Returns the seconds from `timestamp` to the end of the bucket.
+uint32_t agp_get(uint32_t timestamp, AgpBucket *bucket);
@@ -0,0 +1,31 @@
+#include "alerts.h"
+#include "config.h"
+#include "metrics.h"
+#include "settings.h"
+
+typedef enum { RANGE_IN, RANGE_LOW, RANGE_HIGH } Range;
+
+static Range s_range = RANGE_IN;
+
+bool alerts_evaluate(uint16_t mgdl) {
+    const Settings *settings = settings_get();
+    const Range range = (mgdl < settings->target_low_mgdl)    ? RANGE_LOW
+                        : (mgdl > settings->target_high_mgdl) ? RANGE_HIGH
+                                                              : RANGE_IN;
+    if (range == s_range) {
+        return false;
+    }
+    s_range = range;
+
+    if (range == RANGE_LOW && (settings->alerts & SETTINGS_ALERT_LOW)) {
+        vibes_double_pulse();
+        metrics_record_vibes(2);
+        return true;
+    }
+    if (range == RANGE_HIGH && (settings->alerts & SETTINGS_ALERT_HIGH)) {
+        vibes_short_pulse();
+        metrics_record_vibes(1);
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,9 @@
+// Vibration alerts when BG leaves the target range, as enabled in the settings.
+
+#pragma once
+
+#include <pebble.h>
+
+// Evaluates a new reading, and vibrates if it is the first one below or above the target range.
+// Returns true if it vibrated.
+bool alerts_evaluate(uint16_t mgdl);
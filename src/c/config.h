@@ -0,0 +1,116 @@
+// Build-time configuration: feature profile, history, graph and statistics.
+//
+// The FEATURE_* flags, HISTORY_SIZE and LOG_LEVEL (see log.h) form the feature profile of a
+// build. wscript sets them per platform (see PLATFORM_PROFILES there) and leaves the sources of
+// disabled components out of the build. The defaults below only apply to builds that don't go
+// through wscript.
+
+#pragma once
+
+#include <pebble.h>
+
+// Readings kept in RAM for the graph and statistics. 288 is 24 hours at a 5 minute cadence.
+#ifndef HISTORY_SIZE
+#define HISTORY_SIZE 288
+#endif
+
+#ifdef PBL_PLATFORM_EMERY
+#define LAYOUT_LARGE 1
+#else
+#define LAYOUT_LARGE 0
+#endif
+
+#ifndef FEATURE_GRAPH // History graph (emery layout only)
+#define FEATURE_GRAPH LAYOUT_LARGE
+#endif
+#ifndef FEATURE_STATS // Statistics row (emery layout only)
+#define FEATURE_STATS LAYOUT_LARGE
+#endif
+#ifndef FEATURE_AGP // Time-of-day profile bands in the graph, see agp.h
+#define FEATURE_AGP FEATURE_GRAPH
+#endif
+#ifndef FEATURE_ALERTS // Vibration when BG leaves the target range
+#define FEATURE_ALERTS 1
+#endif
+#ifndef FEATURE_COLOR // Colored BG and graph
+#ifdef PBL_COLOR
+#define FEATURE_COLOR 1
+#else
+#define FEATURE_COLOR 0
+#endif
+#endif
+#ifndef FEATURE_DETAIL // Detail view on wrist tap, see detail.h
+#define FEATURE_DETAIL 1
+#endif
+#ifndef FEATURE_DAILY // Daily summary archive in the detail view, see daily.h
+#define FEATURE_DAILY (FEATURE_DETAIL && HISTORY_SIZE > 0)
+#endif
+#ifndef FEATURE_SMOOTHING // Smoothed trend arrow and graph, see filter.h
+#define FEATURE_SMOOTHING 0
+#endif
+#ifndef FEATURE_LOOP // Extended loop fields: IOB and COB
+#define FEATURE_LOOP 1
+#endif
+#ifndef FEATURE_QUIET // Reduced updates at night, see quiet.h
+#define FEATURE_QUIET 1
+#endif
+#ifndef FEATURE_DISCONNECTED // Inverted time ago while the phone is disconnected
+#define FEATURE_DISCONNECTED 1
+#endif
+#ifndef FEATURE_METRICS // Frame timing and counters, reported to the log, see metrics.h
+#define FEATURE_METRICS 0
+#endif
+
+#define FEATURE_HISTORY (HISTORY_SIZE > 0)
+
+#if (FEATURE_GRAPH || FEATURE_STATS) && !LAYOUT_LARGE
+#error "The graph and statistics row only fit the emery layout"
+#endif
+#if (FEATURE_GRAPH || FEATURE_STATS) && !FEATURE_HISTORY
+#error "The graph and statistics row need HISTORY_SIZE > 0"
+#endif
+#if FEATURE_AGP && !FEATURE_GRAPH
+#error "The time-of-day profile is drawn in the graph"
+#endif
+#if FEATURE_DAILY && !(FEATURE_DETAIL && FEATURE_HISTORY)
+#error "The daily summaries are shown in the detail view, and rebuilt from the history"
+#endif
+#if FEATURE_COLOR && !defined(PBL_COLOR)
+#error "FEATURE_COLOR needs a color display"
+#endif
+
+// Time span shown by the graph [seconds]
+#define GRAPH_SPAN (3 * 60 * 60)
+
+// Vertical range of the graph [mg/dL]. Readings outside it are clamped to the edge.
+#define GRAPH_MIN_MGDL 40
+#define GRAPH_MAX_MGDL 300
+
+// Default target range [mg/dL], shown as a band in the graph and used for time in range and
+// alerts. Can be changed in the settings, see settings.h.
+#define TARGET_LOW_MGDL 70
+#define TARGET_HIGH_MGDL 180
+
+// Time span covered by the statistics row [seconds]
+#define STATS_SPAN (24 * 60 * 60)
+
+// Scheduled hours of the reduced update mode, in addition to the watch's Quiet Time. From
+// QUIET_START_HOUR up to QUIET_END_HOUR, possibly over midnight. Equal hours disable the schedule.
+#ifndef QUIET_START_HOUR
+#define QUIET_START_HOUR 0
+#endif
+#ifndef QUIET_END_HOUR
+#define QUIET_END_HOUR 0
+#endif
+
+// Time a wrist tap or alert wakes the face from the reduced update mode [seconds]
+#define QUIET_WAKE_SECONDS 120
+
+// Battery charge at which the face stops showing and requesting the loop fields [percent]
+#define BATTERY_SAVER_PERCENT 20
+
+// Time the phone connection must be stable before the face acts on a change [milliseconds]. A
+// flapping connection then announces capabilities once, instead of on every reconnect.
+#ifndef CONNECTION_SETTLE_MS
+#define CONNECTION_SETTLE_MS 5000
+#endif
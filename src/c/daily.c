@@ -0,0 +1,250 @@
+#include "daily.h"
+#include "config.h"
+#include "history.h"
+#include "metrics.h"
+#include "settings.h"
+
+// Persist keys. settings.c uses 1, journal.c 16 and up, agp.c 64 and up.
+#define PERSIST_KEY_ARCHIVE 80 // ARCHIVE_KEYS keys
+
+// Archive layout: uint8 version, uint8 record count, uint16 little endian day number of the
+// newest record (see day_of()), then the records, newest first.
+#define ARCHIVE_VERSION 1
+#define HEADER_SIZE 4
+#define ARCHIVE_SIZE (HEADER_SIZE + DAILY_DAYS * DAILY_RECORD_SIZE)
+#define ARCHIVE_KEYS ((ARCHIVE_SIZE + PERSIST_DATA_MAX_LENGTH - 1) / PERSIST_DATA_MAX_LENGTH)
+
+_Static_assert(DAILY_DAYS <= UINT8_MAX, "The record count is a uint8");
+
+#define DAY_SECONDS (24 * 60 * 60)
+#define SLOT_SECONDS (5 * 60)
+#define DAY_SLOTS (DAY_SECONDS / SLOT_SECONDS)
+
+// A longer gap between readings ends an excursion, so the readings on both sides of an outage
+// don't add up to an episode
+#define EXCURSION_GAP_SECONDS (3 * SLOT_SECONDS)
+
+#define TARGET_IN_RANGE_PERCENT 70 // Consensus target, drawn as a line behind the bars
+
+// Running totals of the current day
+typedef struct {
+    uint16_t day; // See day_of()
+    uint16_t count;
+    uint32_t sum_mgdl;
+    uint16_t in_range;
+    uint8_t low_episodes;
+    uint8_t high_episodes;
+    int8_t excursion;             // -1 below the target range, 1 above, 0 within
+    uint32_t excursion_start;     // Timestamp of the excursion's first reading
+    uint32_t excursion_last;      // Timestamp of its latest reading
+    bool is_excursion_counted;    // Set once the excursion lasted long enough to be an episode
+    uint8_t slots[DAY_SLOTS / 8]; // Bit per 5 minute slot with a reading
+} Totals;
+
+static DailyRecord s_records[DAILY_DAYS]; // Newest first
+static uint8_t s_count = 0;
+static Totals s_totals = {0};
+
+// Local day number: days since the epoch at the local midnight before `timestamp`. Rounding the
+// midnight keeps the numbers consecutive across daylight saving changes.
+static uint16_t day_of(uint32_t timestamp, uint32_t *seconds_into_day) {
+    const time_t time = timestamp;
+    const struct tm *tm = localtime(&time);
+    const uint32_t into_day = tm->tm_hour * 60 * 60 + tm->tm_min * 60 + tm->tm_sec;
+    if (seconds_into_day) {
+        *seconds_into_day = into_day;
+    }
+    return (timestamp - into_day + DAY_SECONDS / 2) / DAY_SECONDS;
+}
+
+static void save(void) {
+    uint8_t data[ARCHIVE_SIZE];
+    data[0] = ARCHIVE_VERSION;
+    data[1] = s_count;
+    data[2] = s_totals.day - 1;
+    data[3] = (s_totals.day - 1) >> 8;
+    memcpy(data + HEADER_SIZE, s_records, s_count * DAILY_RECORD_SIZE);
+    const size_t length = HEADER_SIZE + s_count * DAILY_RECORD_SIZE;
+    for (uint8_t key = 0; key * PERSIST_DATA_MAX_LENGTH < length; key++) {
+        const size_t offset = key * PERSIST_DATA_MAX_LENGTH;
+        const size_t chunk =
+            length - offset < PERSIST_DATA_MAX_LENGTH ? length - offset : PERSIST_DATA_MAX_LENGTH;
+        persist_write_data(PERSIST_KEY_ARCHIVE + key, data + offset, chunk);
+        metrics_record_flash_write(chunk);
+    }
+}
+
+// Returns the day number of the newest archived record, or 0 if there is none.
+static uint16_t load(void) {
+    uint8_t data[ARCHIVE_SIZE];
+    size_t length = 0;
+    for (uint8_t key = 0; key < ARCHIVE_KEYS; key++) {
+        const int read = persist_read_data(PERSIST_KEY_ARCHIVE + key, data + length,
+                                           ARCHIVE_SIZE - length);
+        if (read <= 0) {
+            break;
+        }
+        length += read;
+    }
+    if (length < HEADER_SIZE || data[0] != ARCHIVE_VERSION) {
+        return 0;
+    }
+    const uint8_t count = data[1] < DAILY_DAYS ? data[1] : DAILY_DAYS;
+    if (length < (size_t)(HEADER_SIZE + count * DAILY_RECORD_SIZE)) {
+        return 0;
+    }
+    s_count = count;
+    memcpy(s_records, data + HEADER_SIZE, count * DAILY_RECORD_SIZE);
+    return data[2] | (data[3] << 8);
+}
+
+static void push_record(const DailyRecord *record) {
+    memmove(&s_records[1], &s_records[0], (DAILY_DAYS - 1) * sizeof(DailyRecord));
+    s_records[0] = *record;
+    if (s_count < DAILY_DAYS) {
+        s_count++;
+    }
+}
+
+static uint8_t saturate_nibble(uint8_t value) { return value < 15 ? value : 15; }
+
+static void start_day(uint16_t day) { s_totals = (Totals){.day = day}; }
+
+// Archives the current day, and empty records for the days up to `day`, which becomes current.
+static void finish_days_before(uint16_t day) {
+    const Totals *totals = &s_totals;
+    DailyRecord record = {0};
+    if (totals->count > 0) {
+        uint16_t covered = 0;
+        for (uint16_t i = 0; i < sizeof(totals->slots); i++) {
+            for (uint8_t byte = totals->slots[i]; byte; byte &= byte - 1) {
+                covered++;
+            }
+        }
+        record = (DailyRecord){
+            .mean = (totals->sum_mgdl / totals->count + 1) / 2,
+            .in_range_percent = totals->in_range * 100 / totals->count,
+            .covered_percent = covered * 100 / DAY_SLOTS,
+            .episodes = saturate_nibble(totals->low_episodes) |
+                        (saturate_nibble(totals->high_episodes) << 4),
+        };
+        if (record.covered_percent == 0) {
+            record.covered_percent = 1; // Had readings
+        }
+    }
+    push_record(&record);
+    const DailyRecord empty = {0};
+    for (uint16_t missed = totals->day + 1; missed < day && missed - totals->day <= DAILY_DAYS;
+         missed++) {
+        push_record(&empty);
+    }
+    start_day(day);
+    save();
+}
+
+static void add_to_totals(uint32_t timestamp, uint32_t into_day, uint16_t mgdl) {
+    Totals *totals = &s_totals;
+    const uint16_t slot = into_day / SLOT_SECONDS;
+    if (slot < DAY_SLOTS) { // Not on the long day of a daylight saving change
+        totals->slots[slot / 8] |= 1 << (slot % 8);
+    }
+    totals->count++;
+    totals->sum_mgdl += mgdl;
+
+    const Settings *settings = settings_get();
+    const int8_t excursion = mgdl < settings->target_low_mgdl    ? -1
+                             : mgdl > settings->target_high_mgdl ? 1
+                                                                 : 0;
+    if (excursion == 0) {
+        totals->in_range++;
+    }
+    const bool is_after_gap = timestamp > totals->excursion_last + EXCURSION_GAP_SECONDS;
+    if (excursion != totals->excursion || is_after_gap) {
+        totals->excursion = excursion;
+        totals->excursion_start = timestamp;
+        totals->is_excursion_counted = false;
+    }
+    if (timestamp > totals->excursion_last) {
+        totals->excursion_last = timestamp;
+    }
+    if (excursion != 0 && !totals->is_excursion_counted &&
+        timestamp - totals->excursion_start >= DAILY_EPISODE_MINUTES * 60) {
+        totals->is_excursion_counted = true;
+        if (excursion < 0) {
+            totals->low_episodes++;
+        } else {
+            totals->high_episodes++;
+        }
+    }
+}
+
+void daily_init(void) {
+    // Rebuild the totals from the history: the current day, and the days since the newest record
+    // if the face wasn't running at their midnight
+    const uint16_t newest = load();
+    const uint16_t count = history_count();
+    if (newest > 0) {
+        start_day(newest + 1);
+    } else {
+        start_day(day_of(count > 0 ? history_get(count - 1)->timestamp : time(NULL), NULL));
+    }
+    for (uint16_t age = count; age-- > 0;) {
+        daily_add(history_get(age)->timestamp, history_get(age)->mgdl);
+    }
+    daily_update(time(NULL));
+}
+
+void daily_add(uint32_t timestamp, uint16_t mgdl) {
+    uint32_t into_day;
+    const uint16_t day = day_of(timestamp, &into_day);
+    if (day < s_totals.day) {
+        return;
+    }
+    if (day > s_totals.day) {
+        finish_days_before(day);
+    }
+    add_to_totals(timestamp, into_day, mgdl);
+}
+
+void daily_update(uint32_t now) {
+    const uint16_t day = day_of(now, NULL);
+    if (day > s_totals.day) {
+        finish_days_before(day);
+    }
+}
+
+uint8_t daily_count(void) { return s_count; }
+
+const DailyRecord *daily_get(uint8_t age) { return &s_records[age]; }
+
+void daily_draw_bars(GContext *ctx, GRect bounds) {
+    const int16_t bar_width = 2;
+    const int16_t step = bar_width + 1;
+    const int16_t height = bounds.size.h;
+    const int16_t bottom = bounds.origin.y + height;
+
+    graphics_context_set_stroke_color(ctx, PBL_IF_COLOR_ELSE(GColorLightGray, GColorBlack));
+    const int16_t target_y = bottom - height * TARGET_IN_RANGE_PERCENT / 100;
+    for (int16_t x = bounds.origin.x; x < bounds.origin.x + bounds.size.w; x += 2) {
+        graphics_draw_pixel(ctx, GPoint(x, target_y));
+    }
+    graphics_draw_line(ctx, GPoint(bounds.origin.x, bottom - 1),
+                       GPoint(bounds.origin.x + bounds.size.w - 1, bottom - 1));
+
+    int16_t x = bounds.origin.x + bounds.size.w - bar_width;
+    for (uint8_t age = 0; age < s_count && x >= bounds.origin.x; age++, x -= step) {
+        const DailyRecord *record = &s_records[age];
+        if (record->covered_percent == 0) {
+            continue;
+        }
+        const int16_t bar_height = height * record->in_range_percent / 100;
+#if FEATURE_COLOR
+        // Days with a low episode stand out
+        graphics_context_set_fill_color(ctx, (record->episodes & 0x0F) ? GColorRed : GColorBlack);
+#else
+        graphics_context_set_fill_color(ctx, GColorBlack);
+#endif
+        graphics_fill_rect(ctx, GRect(x, bottom - bar_height, bar_width, bar_height), 0,
+                           GCornerNone);
+    }
+}
@@ -0,0 +1,54 @@
+// Archive of daily summaries: time in range, mean, and low and high episodes per local day, for
+// the last DAILY_DAYS days, shown as bars in the detail view.
+//
+// The history only covers a day, so each day is summarized as its readings come in: readings
+// update running totals, and at local midnight the totals become the day's record, a few bytes in
+// a persisted ring. Days without readings get an empty record, so the ring stays one record per
+// calendar day. After a restart, the current day's totals are rebuilt from the restored history.
+//
+// An episode is a run of readings outside the target range (see settings.h) lasting at least
+// DAILY_EPISODE_MINUTES, as in the international consensus on CGM metrics. A gap of more than
+// 15 minutes between readings ends the run.
+
+#pragma once
+
+#include <pebble.h>
+
+#ifndef DAILY_DAYS
+#define DAILY_DAYS 60
+#endif
+
+// sizeof(DailyRecord), also reported by wscript
+#ifndef DAILY_RECORD_SIZE
+#define DAILY_RECORD_SIZE 4
+#endif
+
+#define DAILY_EPISODE_MINUTES 15
+
+typedef struct {
+    uint8_t mean;             // [2 mg/dL]
+    uint8_t in_range_percent; // Share of readings within the target range
+    uint8_t covered_percent;  // Share of the day's 5 minute slots with a reading, 0 if no readings
+    uint8_t episodes;         // Low episodes in the low nibble, high in the high one, up to 15 each
+} DailyRecord;
+
+_Static_assert(sizeof(DailyRecord) == DAILY_RECORD_SIZE, "wscript reports DAILY_RECORD_SIZE");
+
+// Loads the archive, and rebuilds the current day from the history. Call after journal_init().
+void daily_init(void);
+
+// Adds a reading, new or backfilled. Readings of days already archived are ignored.
+void daily_add(uint32_t timestamp, uint16_t mgdl);
+
+// Archives the current day once `now` is past its midnight, even if no reading came since.
+void daily_update(uint32_t now);
+
+// Number of archived days, at most DAILY_DAYS.
+uint8_t daily_count(void);
+
+// Record of the day `age` days before the current one, 0 being yesterday. `age` must be less than
+// daily_count().
+const DailyRecord *daily_get(uint8_t age);
+
+// Draws the archived days as time in range bars, the newest on the right, as many as fit.
+void daily_draw_bars(GContext *ctx, GRect bounds);
@@ -0,0 +1,240 @@
+#include "detail.h"
+#include "config.h"
+#include "daily.h"
+#include "metrics.h"
+#include "scheduler.h"
+#include "stats.h"
+#include "units.h"
+#include <stdarg.h>
+
+#define DETAIL_TIMEOUT_MS 10000
+#define DETAIL_TIMEOUT_SLACK_MS 1000
+
+#define DAILY_BARS_HEIGHT 24
+#define DAILY_SUMMARY_DAYS 7
+
+// Allocated when shown, and freed when hidden. If that fails, the window is shown blank.
+typedef struct {
+    TextLayer *body_layer;
+#if FEATURE_DAILY
+    Layer *daily_layer;
+#endif
+    char body[256];
+} DetailView;
+
+static Window *s_window = NULL;
+static DetailVisibilityHandler s_visibility_handler = NULL;
+
+static void append(char *buf, size_t size, size_t *length, const char *fmt, ...) {
+    if (*length >= size) {
+        return;
+    }
+    va_list args;
+    va_start(args, fmt);
+    const int written = vsnprintf(&buf[*length], size - *length, fmt, args);
+    va_end(args);
+    if (written > 0) {
+        *length += written;
+    }
+}
+
+static void format_minutes_ago(char *buf, size_t size, uint32_t timestamp) {
+    const int minutes_ago = (time(NULL) - timestamp) / 60;
+    if (minutes_ago < 60) {
+        snprintf(buf, size, "%dm ago", minutes_ago);
+    } else {
+        snprintf(buf, size, "%dh ago", minutes_ago / 60);
+    }
+}
+
+#if FEATURE_DAILY
+// Time in range and low episodes over the last days with readings
+static void format_daily_summary(char *buf, size_t size, size_t *length) {
+    uint8_t days = 0;
+    uint16_t in_range_percent = 0;
+    uint8_t lows = 0;
+    for (uint8_t age = 0; age < daily_count() && age < DAILY_SUMMARY_DAYS; age++) {
+        const DailyRecord *record = daily_get(age);
+        if (record->covered_percent > 0) {
+            days++;
+            in_range_percent += record->in_range_percent;
+            lows += record->episodes & 0x0F;
+        }
+    }
+    if (days > 0) {
+        append(buf, size, length, "%dd: %d%% in range, %d lows\n", days, in_range_percent / days,
+               lows);
+    }
+}
+
+static void daily_layer_update_proc(Layer *layer, GContext *ctx) {
+    daily_draw_bars(ctx, layer_get_bounds(layer));
+}
+#endif
+
+static void format_body(char *buf, size_t size, const DetailData *data) {
+    size_t length = 0;
+    char ago[10];
+
+    // Last reading
+    if (data->bg_timestamp > 0) {
+        const time_t bg_time = data->bg_timestamp;
+        char clock[6];
+        strftime(clock, sizeof(clock), clock_is_24h_style() ? "%H:%M" : "%I:%M",
+                 localtime(&bg_time));
+        append(buf, size, &length, "BG %s %s at %s\n", data->bg_string, data->delta_string, clock);
+    } else {
+        append(buf, size, &length, "No reading yet\n");
+    }
+
+#if FEATURE_HISTORY
+    // 24h statistics
+    Stats stats;
+    stats_compute(&stats, time(NULL) - STATS_SPAN);
+    if (stats.count > 0) {
+        char mean[6], min[6], max[6];
+        bg_format(mean, sizeof(mean), stats.mean_mgdl, data->bg_is_mmol);
+        bg_format(min, sizeof(min), stats.min_mgdl, data->bg_is_mmol);
+        bg_format(max, sizeof(max), stats.max_mgdl, data->bg_is_mmol);
+        append(buf, size, &length, "Avg %s, %d%% in range\n", mean, stats.in_range_percent);
+        append(buf, size, &length, "Min %s, max %s\n", min, max);
+    }
+#endif
+
+    // Connection and sync health
+    append(buf, size, &length, "%s", data->connected ? "Connected" : "Disconnected");
+    if (data->last_message_time > 0) {
+        format_minutes_ago(ago, sizeof(ago), data->last_message_time);
+        append(buf, size, &length, ", msg %s", ago);
+    }
+    append(buf, size, &length, "\n");
+#if FEATURE_HISTORY
+    append(buf, size, &length, "%d readings in 24h\n", stats.count);
+#endif
+#if FEATURE_DAILY
+    format_daily_summary(buf, size, &length);
+#endif
+
+    // Extended fields
+#if FEATURE_LOOP
+    if (data->iob_string[0] != '\0' || data->cob_string[0] != '\0') {
+        append(buf, size, &length, "IOB %s  COB %s\n", data->iob_string, data->cob_string);
+    }
+#endif
+    if (data->sensor_age_string[0] != '\0') {
+        append(buf, size, &length, "Sensor %s", data->sensor_age_string);
+    }
+    if (data->phone_battery != XDRIP_PHONE_BATTERY_UNKNOWN) {
+        append(buf, size, &length, "%sbat %d%%", data->sensor_age_string[0] ? ", " : "Phone ",
+               data->phone_battery);
+    }
+}
+
+static void timeout_callback(void *context) { detail_hide(); }
+
+static SchedulerTask s_timeout_task = {.callback = timeout_callback};
+
+static void detail_window_load(Window *window) {
+    Layer *root_layer = window_get_root_layer(window);
+    const GRect bounds = layer_get_bounds(root_layer);
+
+    GRect body_bounds = grect_inset(bounds, PBL_IF_ROUND_ELSE(18, 4));
+#if FEATURE_DAILY
+    body_bounds.size.h -= DAILY_BARS_HEIGHT;
+    const GRect daily_bounds =
+        GRect(body_bounds.origin.x, body_bounds.origin.y + body_bounds.size.h, body_bounds.size.w,
+              DAILY_BARS_HEIGHT);
+#endif
+
+    DetailView *view = malloc(sizeof(DetailView));
+    TextLayer *body_layer = view ? text_layer_create(body_bounds) : NULL;
+#if FEATURE_DAILY
+    Layer *daily_layer = body_layer ? layer_create(daily_bounds) : NULL;
+    if (!daily_layer && body_layer) {
+        text_layer_destroy(body_layer);
+        body_layer = NULL;
+    }
+#endif
+    if (!body_layer) {
+        free(view);
+        metrics_record_alloc_failure(ALLOC_SITE_DETAIL_VIEW);
+        window_set_user_data(window, NULL);
+        return;
+    }
+    view->body[0] = '\0';
+    view->body_layer = body_layer;
+    text_layer_set_background_color(view->body_layer, GColorClear);
+    text_layer_set_text_color(view->body_layer, GColorBlack);
+    text_layer_set_font(view->body_layer, fonts_get_system_font(FONT_KEY_GOTHIC_18));
+    text_layer_set_text_alignment(view->body_layer,
+                                  PBL_IF_ROUND_ELSE(GTextAlignmentCenter, GTextAlignmentLeft));
+    text_layer_set_text(view->body_layer, view->body);
+    layer_add_child(root_layer, text_layer_get_layer(view->body_layer));
+#if FEATURE_DAILY
+    view->daily_layer = daily_layer;
+    layer_set_update_proc(view->daily_layer, daily_layer_update_proc);
+    layer_add_child(root_layer, view->daily_layer);
+#endif
+    window_set_user_data(window, view);
+}
+
+static void detail_window_unload(Window *window) {
+    DetailView *view = window_get_user_data(window);
+    if (view) {
+        text_layer_destroy(view->body_layer);
+#if FEATURE_DAILY
+        layer_destroy(view->daily_layer);
+#endif
+        free(view);
+    }
+    window_destroy(window);
+    s_window = NULL;
+    metrics_set_view_allocated(false);
+
+    scheduler_cancel(&s_timeout_task);
+    s_visibility_handler(false);
+}
+
+void detail_init(DetailVisibilityHandler handler) { s_visibility_handler = handler; }
+
+void detail_show(const DetailData *data) {
+    if (s_window) {
+        detail_refresh(data);
+        scheduler_schedule(&s_timeout_task, DETAIL_TIMEOUT_MS, DETAIL_TIMEOUT_SLACK_MS);
+        return;
+    }
+
+    s_window = window_create();
+    if (!s_window) {
+        metrics_record_alloc_failure(ALLOC_SITE_DETAIL_WINDOW);
+        return;
+    }
+    metrics_set_view_allocated(true);
+    window_set_window_handlers(s_window, (WindowHandlers){.load = detail_window_load,
+                                                          .unload = detail_window_unload});
+    window_stack_push(s_window, /*animated*/ true);
+    detail_refresh(data);
+    scheduler_schedule(&s_timeout_task, DETAIL_TIMEOUT_MS, DETAIL_TIMEOUT_SLACK_MS);
+    s_visibility_handler(true);
+    metrics_sample_heap();
+}
+
+void detail_hide(void) {
+    if (s_window) {
+        window_stack_remove(s_window, /*animated*/ true);
+    }
+}
+
+bool detail_is_visible(void) { return s_window != NULL; }
+
+void detail_refresh(const DetailData *data) {
+    if (!s_window) {
+        return;
+    }
+    DetailView *view = window_get_user_data(s_window);
+    if (!view) {
+        return;
+    }
+    format_body(view->body, sizeof(view->body), data);
+    layer_mark_dirty(text_layer_get_layer(view->body_layer));
+}
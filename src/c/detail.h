@@ -0,0 +1,34 @@
+// Detail view: a second window with 24h statistics, details of the last reading, connection and
+// sync health, the extended fields, and the daily summaries (see daily.h). Shown on a wrist tap and
+// hidden again after a timeout. The window, its layers and its text only exist while it is shown,
+// so the main face's steady-state memory is unaffected.
+
+#pragma once
+
+#include "xdrip.h"
+#include <pebble.h>
+
+// Snapshot of what the detail view shows, apart from statistics, which it computes from history.
+typedef struct {
+    const char *bg_string;
+    const char *delta_string;
+    uint32_t bg_timestamp; // Seconds since epoch, 0 if no reading yet
+    bool bg_is_mmol;
+    bool connected;
+    uint32_t last_message_time; // Seconds since epoch, 0 if no message yet
+    const char *iob_string;
+    const char *cob_string;
+    const char *sensor_age_string;
+    uint8_t phone_battery; // Percent, XDRIP_PHONE_BATTERY_UNKNOWN if not received
+} DetailData;
+
+// Called when the view is shown or hidden, including when it times out.
+typedef void (*DetailVisibilityHandler)(bool visible);
+
+void detail_init(DetailVisibilityHandler handler);
+void detail_show(const DetailData *data);
+void detail_hide(void);
+bool detail_is_visible(void);
+
+// Updates the shown data. Does nothing if the view is hidden.
+void detail_refresh(const DetailData *data);
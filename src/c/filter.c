@@ -0,0 +1,75 @@
+#include "filter.h"
+
+// Fixed point: level in 1/16 mg/dL, trend in 1/16 mg/dL per minute
+#define FIXED_SHIFT 4
+
+#define LEVEL_SHIFT 1 // Level smoothing factor 1/2
+#define TREND_SHIFT 1 // Trend smoothing factor 1/2
+#define MAX_GAP (15 * 60)
+
+// Lower edges of the arrow buckets [1/16 mg/dL per minute], from double up to down. Below the
+// last one is double down. Same edges as xDrip: 3.5, 2 and 1 mg/dL per minute.
+static const int32_t ARROW_EDGES[] = {56, 32, 16, -16, -32, -56};
+#define ARROW_BUCKETS (sizeof(ARROW_EDGES) / sizeof(ARROW_EDGES[0]) + 1)
+#define ARROW_HYSTERESIS 4 // 0.25 mg/dL per minute
+
+static uint32_t s_timestamp = 0; // Of the last reading, 0 before the first one
+static int32_t s_level = 0;
+static int32_t s_trend = 0;
+static bool s_has_trend = false;
+static uint8_t s_arrow_index = 0;
+
+// Arrow index 1 (double up) to 7 (double down) for a trend, without hysteresis.
+static uint8_t arrow_bucket(int32_t trend) {
+    uint8_t bucket = 0;
+    while (bucket < ARROW_BUCKETS - 1 && trend <= ARROW_EDGES[bucket]) {
+        bucket++;
+    }
+    return bucket + 1;
+}
+
+static void update_arrow(void) {
+    const uint8_t bucket = arrow_bucket(s_trend);
+    if (s_arrow_index == 0 || bucket == s_arrow_index) {
+        s_arrow_index = bucket;
+        return;
+    }
+    // Only leave the current bucket if the trend is clearly past its edge
+    const int32_t margin = (bucket < s_arrow_index) ? -ARROW_HYSTERESIS : ARROW_HYSTERESIS;
+    s_arrow_index = arrow_bucket(s_trend + margin);
+}
+
+static uint16_t smoothed_mgdl(void) {
+    return (s_level + (1 << (FIXED_SHIFT - 1))) >> FIXED_SHIFT;
+}
+
+uint16_t filter_update(uint32_t timestamp, uint16_t mgdl) {
+    if (s_timestamp != 0 && timestamp <= s_timestamp) {
+        // Already seen, e.g. backfilled before xDrip sent it as the latest reading
+        return smoothed_mgdl();
+    }
+
+    const int32_t value = (int32_t)mgdl << FIXED_SHIFT;
+    const uint32_t gap = timestamp - s_timestamp;
+
+    if (s_timestamp == 0 || gap > MAX_GAP) {
+        s_level = value;
+        s_trend = 0;
+        s_has_trend = false;
+        s_arrow_index = 0;
+    } else {
+        const int32_t minutes = (gap + 30) / 60 > 0 ? (gap + 30) / 60 : 1;
+        const int32_t previous_level = s_level;
+        const int32_t predicted = s_level + s_trend * minutes;
+        s_level = predicted + ((value - predicted) >> LEVEL_SHIFT);
+        const int32_t observed_trend = (s_level - previous_level) / minutes;
+        s_trend += (observed_trend - s_trend) >> TREND_SHIFT;
+        s_has_trend = true;
+        update_arrow();
+    }
+    s_timestamp = timestamp;
+
+    return smoothed_mgdl();
+}
+
+uint8_t filter_arrow_index(uint8_t fallback) { return s_has_trend ? s_arrow_index : fallback; }
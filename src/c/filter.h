@@ -0,0 +1,18 @@
+// Integer-only noise smoothing of incoming readings, and a trend arrow derived from it.
+//
+// Uses double exponential (Holt) smoothing of level and trend, updated in O(1) per reading. The
+// arrow changes bucket only when the smoothed trend is past the bucket edge by a hysteresis
+// margin, so noise around an edge doesn't make it flip back and forth.
+
+#pragma once
+
+#include <pebble.h>
+
+// Adds a new reading and returns the smoothed value [mg/dL]. A gap of more than 15 minutes
+// restarts the filter from the new reading. A reading that is not newer than the last one leaves
+// the filter as is, and returns the current smoothed value.
+uint16_t filter_update(uint32_t timestamp, uint16_t mgdl);
+
+// Arrow index (see ARROWS in main.c) for the smoothed trend, or `fallback` until the filter has
+// seen two readings in a row.
+uint8_t filter_arrow_index(uint8_t fallback);
@@ -0,0 +1,322 @@
+// The graph writes rows of the frame buffer directly instead of going through graphics_fill_rect
+// and friends. This keeps the cost per frame close to a memset per row, so the tall emery graph is
+// no slower than a small one would be. Note that the frame buffer is not clipped to the layer, so
+// everything drawn here must be clipped to the layer's screen rect by hand.
+//
+// The static background (target band, hour grid and axis labels) is drawn once with the graphics
+// API, copied out of the frame buffer into a bitmap, and copied back row by row in later frames.
+// It is only redrawn when the span, unit or target range changes. Rows are copied whole, so on
+// 1-bit displays the layer must start on a multiple of 8 pixels. Round displays are not supported.
+//
+// With FEATURE_AGP, the time-of-day profile from agp.h is drawn between the background and the
+// readings.
+
+#include "graph.h"
+#include "agp.h"
+#include "config.h"
+#include "history.h"
+#include "metrics.h"
+#include "units.h"
+
+// Set to 0 to draw the background every frame, to measure what the cache saves
+#ifndef GRAPH_CACHE_BACKGROUND
+#define GRAPH_CACHE_BACKGROUND 1
+#endif
+
+#define DOT_RADIUS 1
+#define GRID_INTERVAL (60 * 60) // Vertical grid line every hour [seconds]
+
+#ifdef PBL_COLOR
+#define PIXEL_BYTE(x) (x)
+#define ROW_BYTES(width) (width)
+#else
+#define PIXEL_BYTE(x) ((x) / 8)
+#define ROW_BYTES(width) (((width) + 7) / 8)
+#endif
+
+// State of a graph layer, allocated together with the layer by layer_create_with_data
+typedef struct {
+    uint32_t span;              // Time span shown [seconds]
+    bool mmol;                  // Unit of the axis labels
+    uint16_t target_low_mgdl;   // Target range, shown as a band
+    uint16_t target_high_mgdl;
+    GBitmap *background;        // Cached background, allocated with the layer
+    bool is_background_current; // False if the background must be redrawn
+} GraphData;
+
+// Screen rect of the layer being drawn
+typedef struct {
+    int16_t x0, y0, x1, y1; // Inclusive
+} Clip;
+
+// Draws pixels x0..x1 of screen row y, clipped to the layer and the row.
+static void draw_hline(GBitmap *fb, const Clip *clip, int16_t y, int16_t x0, int16_t x1,
+                       GColor color) {
+    if (y < clip->y0 || y > clip->y1) {
+        return;
+    }
+    const GBitmapDataRowInfo row = gbitmap_get_data_row_info(fb, y);
+    x0 = (x0 < clip->x0) ? clip->x0 : x0;
+    x0 = (x0 < row.min_x) ? row.min_x : x0;
+    x1 = (x1 > clip->x1) ? clip->x1 : x1;
+    x1 = (x1 > row.max_x) ? row.max_x : x1;
+    if (x0 > x1) {
+        return;
+    }
+
+#ifdef PBL_COLOR
+    memset(&row.data[x0], color.argb, x1 - x0 + 1);
+#else
+    const bool white = gcolor_equal(color, GColorWhite);
+    for (int16_t x = x0; x <= x1; x++) {
+        if (white) {
+            row.data[x / 8] |= (1 << (x % 8));
+        } else {
+            row.data[x / 8] &= ~(1 << (x % 8));
+        }
+    }
+#endif
+}
+
+// Maps a BG value to a row offset within the graph, clamped to its height.
+static int16_t value_to_y(uint16_t mgdl, int16_t height) {
+    if (mgdl < GRAPH_MIN_MGDL) {
+        mgdl = GRAPH_MIN_MGDL;
+    } else if (mgdl > GRAPH_MAX_MGDL) {
+        mgdl = GRAPH_MAX_MGDL;
+    }
+    return (height - 1) -
+           (int32_t)(mgdl - GRAPH_MIN_MGDL) * (height - 1) / (GRAPH_MAX_MGDL - GRAPH_MIN_MGDL);
+}
+
+// Maps an age to a column offset within the graph, the newest being rightmost.
+static int16_t age_to_x(uint32_t seconds_ago, int16_t width, uint32_t span) {
+    return (width - 1) - (int32_t)seconds_ago * (width - 1) / span;
+}
+
+static GColor reading_color(uint16_t mgdl, const GraphData *data) {
+#if FEATURE_COLOR
+    if (mgdl < data->target_low_mgdl) {
+        return GColorRed;
+    }
+    if (mgdl > data->target_high_mgdl) {
+        return GColorOrange;
+    }
+#endif
+    return GColorBlack;
+}
+
+// Draws the target band, hour grid and axis labels with the graphics API, in layer coordinates.
+static void draw_background(GContext *ctx, GRect bounds, const GraphData *data) {
+    const int16_t width = bounds.size.w;
+    const int16_t height = bounds.size.h;
+    const int16_t top = value_to_y(data->target_high_mgdl, height);
+    const int16_t bottom = value_to_y(data->target_low_mgdl, height);
+
+    // Target band
+#if FEATURE_COLOR
+    graphics_context_set_fill_color(ctx, GColorLightGray);
+    graphics_fill_rect(ctx, GRect(0, top, width, bottom - top + 1), 0, GCornerNone);
+    graphics_context_set_stroke_color(ctx, GColorDarkGray);
+#else
+    graphics_context_set_stroke_color(ctx, GColorBlack);
+    for (int16_t x = 0; x < width; x += 2) {
+        graphics_draw_pixel(ctx, GPoint(x, top));
+        graphics_draw_pixel(ctx, GPoint(x, bottom));
+    }
+#endif
+
+    // Hour grid and labels
+    const GFont font = fonts_get_system_font(FONT_KEY_GOTHIC_14);
+    graphics_context_set_text_color(ctx, PBL_IF_COLOR_ELSE(GColorDarkGray, GColorBlack));
+    char label[6];
+    for (uint32_t seconds_ago = GRID_INTERVAL; seconds_ago < data->span;
+         seconds_ago += GRID_INTERVAL) {
+        const int16_t x = age_to_x(seconds_ago, width, data->span);
+        for (int16_t y = 0; y < height; y += 3) {
+            graphics_draw_pixel(ctx, GPoint(x, y));
+        }
+        snprintf(label, sizeof(label), "-%dh", (int)(seconds_ago / GRID_INTERVAL));
+        graphics_draw_text(ctx, label, font, GRect(x + 2, height - 16, 30, 16),
+                           GTextOverflowModeFill, GTextAlignmentLeft, NULL);
+    }
+
+    // Target range labels, left edge
+    bg_format(label, sizeof(label), data->target_high_mgdl, data->mmol);
+    graphics_draw_text(ctx, label, font, GRect(2, top - 16, 40, 16), GTextOverflowModeFill,
+                       GTextAlignmentLeft, NULL);
+    bg_format(label, sizeof(label), data->target_low_mgdl, data->mmol);
+    graphics_draw_text(ctx, label, font, GRect(2, bottom - 2, 40, 16), GTextOverflowModeFill,
+                       GTextAlignmentLeft, NULL);
+}
+
+#if GRAPH_CACHE_BACKGROUND
+// Copies the layer's rows between the frame buffer and the cached background.
+static void copy_background(GBitmap *fb, const Clip *clip, GBitmap *background, bool to_cache) {
+    uint8_t *cache = gbitmap_get_data(background);
+    const uint16_t cache_bytes_per_row = gbitmap_get_bytes_per_row(background);
+    const size_t length = ROW_BYTES(clip->x1 - clip->x0 + 1);
+
+    for (int16_t y = clip->y0; y <= clip->y1; y++) {
+        const GBitmapDataRowInfo row = gbitmap_get_data_row_info(fb, y);
+        uint8_t *screen_row = &row.data[PIXEL_BYTE(clip->x0)];
+        uint8_t *cache_row = &cache[(y - clip->y0) * cache_bytes_per_row];
+        if (to_cache) {
+            memcpy(cache_row, screen_row, length);
+        } else {
+            memcpy(screen_row, cache_row, length);
+        }
+    }
+}
+#endif
+
+#if FEATURE_AGP
+// Fills rows y0..y1 of columns x0..x1.
+static void fill_rows(GBitmap *fb, const Clip *clip, int16_t y0, int16_t y1, int16_t x0, int16_t x1,
+                      GColor color) {
+    for (int16_t y = y0; y <= y1; y++) {
+        draw_hline(fb, clip, y, x0, x1, color);
+    }
+}
+
+// Draws the time-of-day profile behind the readings, one 30 minute bucket at a time: the 10th to
+// 90th and 25th to 75th percentile bands, and the median. Without color only the median.
+static void draw_profile(GBitmap *fb, const Clip *clip, const GraphData *data) {
+    const uint32_t now = time(NULL);
+    const int16_t width = clip->x1 - clip->x0 + 1;
+    const int16_t height = clip->y1 - clip->y0 + 1;
+
+    for (uint32_t seconds_ago = data->span; seconds_ago > 0;) {
+        AgpBucket bucket;
+        const uint32_t length = agp_get(now - seconds_ago, &bucket);
+        const uint32_t end_ago = (length < seconds_ago) ? seconds_ago - length : 0;
+        if (bucket.count >= AGP_MIN_READINGS) {
+            const int16_t x0 = clip->x0 + age_to_x(seconds_ago, width, data->span);
+            const int16_t x1 = clip->x0 + age_to_x(end_ago, width, data->span);
+#if FEATURE_COLOR
+            fill_rows(fb, clip, clip->y0 + value_to_y(bucket.p90_mgdl, height),
+                      clip->y0 + value_to_y(bucket.p10_mgdl, height), x0, x1, GColorCeleste);
+            fill_rows(fb, clip, clip->y0 + value_to_y(bucket.p75_mgdl, height),
+                      clip->y0 + value_to_y(bucket.p25_mgdl, height), x0, x1, GColorPictonBlue);
+#endif
+            draw_hline(fb, clip, clip->y0 + value_to_y(bucket.p50_mgdl, height), x0, x1,
+                       PBL_IF_COLOR_ELSE(GColorBlue, GColorBlack));
+        }
+        seconds_ago = end_ago;
+    }
+}
+#endif
+
+static void draw_readings(GBitmap *fb, const Clip *clip, const GraphData *data) {
+    const uint32_t span = data->span;
+    const uint32_t now = time(NULL);
+    const int16_t width = clip->x1 - clip->x0 + 1;
+    const int16_t height = clip->y1 - clip->y0 + 1;
+
+    for (uint16_t age = 0; age < history_count(); age++) {
+        const Reading *reading = history_get(age);
+        const uint32_t seconds_ago = (now > reading->timestamp) ? now - reading->timestamp : 0;
+        if (seconds_ago > span) {
+            break;
+        }
+        const int16_t x = clip->x0 + age_to_x(seconds_ago, width, span);
+        const int16_t y = clip->y0 + value_to_y(reading->smoothed_mgdl, height);
+        const GColor color = reading_color(reading->smoothed_mgdl, data);
+        for (int16_t dy = -DOT_RADIUS; dy <= DOT_RADIUS; dy++) {
+            draw_hline(fb, clip, y + dy, x - DOT_RADIUS, x + DOT_RADIUS, color);
+        }
+    }
+}
+
+static void graph_update_proc(Layer *layer, GContext *ctx) {
+    const uint32_t start_ms = metrics_now_ms();
+    GraphData *data = layer_get_data(layer);
+    const GRect bounds = layer_get_bounds(layer);
+    const GPoint origin = layer_convert_point_to_screen(layer, bounds.origin);
+    const Clip clip = {
+        .x0 = origin.x,
+        .y0 = origin.y,
+        .x1 = origin.x + bounds.size.w - 1,
+        .y1 = origin.y + bounds.size.h - 1,
+    };
+
+    const bool draw_background_now = !GRAPH_CACHE_BACKGROUND || !data->is_background_current;
+    if (draw_background_now) {
+        draw_background(ctx, bounds, data);
+    }
+
+    GBitmap *fb = graphics_capture_frame_buffer(ctx);
+    if (!fb) {
+        return;
+    }
+#if GRAPH_CACHE_BACKGROUND
+    if (data->background) {
+        copy_background(fb, &clip, data->background, /*to_cache*/ draw_background_now);
+        data->is_background_current = true;
+    }
+#endif
+#if FEATURE_AGP
+    draw_profile(fb, &clip, data);
+#endif
+    draw_readings(fb, &clip, data);
+    graphics_release_frame_buffer(ctx, fb);
+
+    metrics_record_graph_frame(metrics_now_ms() - start_ms);
+}
+
+Layer *graph_layer_create(GRect frame) {
+    Layer *layer = layer_create_with_data(frame, sizeof(GraphData));
+    GraphData *data = layer_get_data(layer);
+    *data = (GraphData){
+        .span = GRAPH_SPAN,
+        .target_low_mgdl = TARGET_LOW_MGDL,
+        .target_high_mgdl = TARGET_HIGH_MGDL,
+    };
+#if GRAPH_CACHE_BACKGROUND
+    // Allocated here rather than on the first draw, so it counts towards the steady-state heap (see
+    // metrics_mark_steady_state()). Without it the graph is just slower.
+    data->background =
+        gbitmap_create_blank(frame.size, PBL_IF_COLOR_ELSE(GBitmapFormat8Bit, GBitmapFormat1Bit));
+    if (!data->background) {
+        metrics_record_alloc_failure(ALLOC_SITE_GRAPH_CACHE);
+    }
+#endif
+    layer_set_update_proc(layer, graph_update_proc);
+    return layer;
+}
+
+void graph_layer_destroy(Layer *layer) {
+    GraphData *data = layer_get_data(layer);
+    if (data->background) {
+        gbitmap_destroy(data->background);
+    }
+    layer_destroy(layer);
+}
+
+void graph_layer_set_span(Layer *layer, uint32_t span) {
+    GraphData *data = layer_get_data(layer);
+    if (span != data->span) {
+        data->span = span;
+        data->is_background_current = false;
+        layer_mark_dirty(layer);
+    }
+}
+
+void graph_layer_set_mmol(Layer *layer, bool mmol) {
+    GraphData *data = layer_get_data(layer);
+    if (mmol != data->mmol) {
+        data->mmol = mmol;
+        data->is_background_current = false;
+        layer_mark_dirty(layer);
+    }
+}
+
+void graph_layer_set_target(Layer *layer, uint16_t low_mgdl, uint16_t high_mgdl) {
+    GraphData *data = layer_get_data(layer);
+    if (low_mgdl != data->target_low_mgdl || high_mgdl != data->target_high_mgdl) {
+        data->target_low_mgdl = low_mgdl;
+        data->target_high_mgdl = high_mgdl;
+        data->is_background_current = false;
+        layer_mark_dirty(layer);
+    }
+}
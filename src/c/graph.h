@@ -0,0 +1,14 @@
+// History graph, drawn straight into the frame buffer.
+
+#pragma once
+
+#include <pebble.h>
+
+Layer *graph_layer_create(GRect frame);
+void graph_layer_destroy(Layer *layer);
+
+// Settings that change the static background. Changing them redraws the cached background.
+void graph_layer_set_span(Layer *layer, uint32_t span); // Time span shown [seconds]
+void graph_layer_set_mmol(Layer *layer, bool mmol);     // Unit of the axis labels
+// Target range, shown as a band [mg/dL]
+void graph_layer_set_target(Layer *layer, uint16_t low_mgdl, uint16_t high_mgdl);
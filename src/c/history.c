@@ -0,0 +1,55 @@
+#include "history.h"
+#include "config.h"
+
+static Reading s_readings[HISTORY_SIZE];
+static uint16_t s_newest = 0; // Index of the newest reading
+static uint16_t s_count = 0;
+
+bool history_add(uint32_t timestamp, uint16_t mgdl, uint16_t smoothed_mgdl) {
+    if (s_count > 0 && timestamp <= s_readings[s_newest].timestamp) {
+        return false;
+    }
+
+    s_newest = (s_count == 0) ? 0 : (s_newest + 1) % HISTORY_SIZE;
+    s_readings[s_newest] =
+        (Reading){.timestamp = timestamp, .mgdl = mgdl, .smoothed_mgdl = smoothed_mgdl};
+    if (s_count < HISTORY_SIZE) {
+        s_count++;
+    }
+    return true;
+}
+
+static Reading *reading_at(uint16_t age) {
+    return &s_readings[(s_newest + HISTORY_SIZE - age) % HISTORY_SIZE];
+}
+
+bool history_insert(uint32_t timestamp, uint16_t mgdl, uint16_t smoothed_mgdl) {
+    if (s_count == 0 || timestamp > s_readings[s_newest].timestamp) {
+        return history_add(timestamp, mgdl, smoothed_mgdl);
+    }
+
+    uint16_t age = 0;
+    while (age < s_count && reading_at(age)->timestamp > timestamp) {
+        age++;
+    }
+    if ((age < s_count && reading_at(age)->timestamp == timestamp) ||
+        (age == s_count && s_count == HISTORY_SIZE)) {
+        return false;
+    }
+
+    // Move the newer readings one slot up. In a full history this overwrites the oldest one.
+    s_newest = (s_newest + 1) % HISTORY_SIZE;
+    if (s_count < HISTORY_SIZE) {
+        s_count++;
+    }
+    for (uint16_t i = 0; i < age; i++) {
+        *reading_at(i) = *reading_at(i + 1);
+    }
+    *reading_at(age) =
+        (Reading){.timestamp = timestamp, .mgdl = mgdl, .smoothed_mgdl = smoothed_mgdl};
+    return true;
+}
+
+uint16_t history_count(void) { return s_count; }
+
+const Reading *history_get(uint16_t age) { return reading_at(age); }
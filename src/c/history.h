@@ -0,0 +1,26 @@
+// Ring buffer of recent BG readings, feeding the graph and statistics. Persisted by journal.h.
+
+#pragma once
+
+#include <pebble.h>
+
+typedef struct {
+    uint32_t timestamp; // Seconds since epoch
+    uint16_t mgdl;
+    uint16_t smoothed_mgdl; // Same as mgdl unless the build has smoothing, see filter.h
+} Reading;
+
+// Adds a reading. Readings that are not newer than the newest stored one are ignored, since xDrip
+// re-sends the latest reading after every capability announcement. Returns true if added.
+bool history_add(uint32_t timestamp, uint16_t mgdl, uint16_t smoothed_mgdl);
+
+// Inserts a reading in timestamp order, for backfilled readings that may be older than the newest
+// stored one. Readings with a stored timestamp, or older than all readings of a full history, are
+// ignored. Returns true if inserted.
+bool history_insert(uint32_t timestamp, uint16_t mgdl, uint16_t smoothed_mgdl);
+
+// Number of stored readings, at most HISTORY_SIZE.
+uint16_t history_count(void);
+
+// Reading `age` steps back, 0 being the newest. `age` must be less than history_count().
+const Reading *history_get(uint16_t age);
@@ -0,0 +1,76 @@
+#include "history_batch.h"
+
+#define HEADER_SIZE 10
+#define MAX_MGDL 1000 // Anything above is not a reading, but a broken encoder
+
+static uint16_t read_uint16(const uint8_t *data) { return data[0] | (data[1] << 8); }
+
+static uint32_t read_uint32(const uint8_t *data) {
+    return read_uint16(data) | ((uint32_t)read_uint16(data + 2) << 16);
+}
+
+// Walks the batch, calling `handler` for each reading unless it is NULL, so the same code both
+// validates and decodes.
+static int walk(const uint8_t *data, size_t length, HistoryBatchReadingHandler handler,
+                void *context) {
+    if (length < HEADER_SIZE || data[0] != HISTORY_BATCH_VERSION) {
+        return -1;
+    }
+    const uint32_t interval = data[1] * 60;
+    const uint16_t slot_count = read_uint16(data + 2);
+    const uint32_t base_timestamp = read_uint32(data + 4);
+    int32_t mgdl = read_uint16(data + 8);
+
+    const uint8_t *bitmap = data + HEADER_SIZE;
+    const size_t bitmap_size = (slot_count + 7) / 8;
+    // The last slot's timestamp must not wrap around
+    if (slot_count == 0 || interval == 0 ||
+        slot_count - 1u > (UINT32_MAX - base_timestamp) / interval ||
+        length < HEADER_SIZE + bitmap_size || (bitmap[0] & 1) == 0) {
+        return -1;
+    }
+    // Bits past the last slot must be clear, so each batch has a single encoding
+    if (bitmap[bitmap_size - 1] >> ((slot_count - 1) % 8 + 1) != 0) {
+        return -1;
+    }
+    const uint8_t *delta = bitmap + bitmap_size;
+    const uint8_t *end = data + length;
+
+    int count = 0;
+    for (uint16_t slot = 0; slot < slot_count; slot++) {
+        if ((bitmap[slot / 8] & (1 << (slot % 8))) == 0) {
+            continue;
+        }
+        if (slot > 0) {
+            if (delta >= end) {
+                return -1;
+            }
+            const int8_t step = (int8_t)*delta++;
+            if (step == HISTORY_BATCH_ESCAPE) {
+                if (end - delta < 2) {
+                    return -1;
+                }
+                mgdl = read_uint16(delta);
+                delta += 2;
+            } else {
+                mgdl += step;
+            }
+        }
+        if (mgdl <= 0 || mgdl > MAX_MGDL) {
+            return -1;
+        }
+        if (handler) {
+            handler(base_timestamp + slot * interval, mgdl, context);
+        }
+        count++;
+    }
+    return (delta == end) ? count : -1;
+}
+
+int history_batch_decode(const uint8_t *data, size_t length, HistoryBatchReadingHandler handler,
+                         void *context) {
+    if (walk(data, length, NULL, context) < 0) {
+        return -1;
+    }
+    return walk(data, length, handler, context);
+}
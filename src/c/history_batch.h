@@ -0,0 +1,32 @@
+// Decoder for history batches, the compact encoding xDrip uses to backfill the reading history.
+//
+// Readings are placed in fixed time slots after a base reading, and each stored reading is a delta
+// from the previous one, so a 24 hour backfill at 5 minute intervals takes about 330 bytes: two
+// messages within the 256 byte inbox, instead of one message per reading. Layout, little endian:
+//
+//   uint8   version, HISTORY_BATCH_VERSION
+//   uint8   slot interval [minutes]
+//   uint16  slot count, including the base slot
+//   uint32  base timestamp [seconds since epoch]
+//   uint16  base value [mg/dL]
+//   uint8[] slot bitmap, (slot count + 7) / 8 bytes. Bit i (LSB first) is set if slot i has a
+//           reading. Bit 0, the base reading, must be set, and the bits past the last slot clear.
+//   int8[]  one delta per set bit after bit 0 [mg/dL], from the previous reading in the batch.
+//           HISTORY_BATCH_ESCAPE is followed by the full value as uint16, for jumps that don't fit.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define HISTORY_BATCH_VERSION 1
+#define HISTORY_BATCH_ESCAPE ((int8_t)-128)
+
+typedef void (*HistoryBatchReadingHandler)(uint32_t timestamp, uint16_t mgdl, void *context);
+
+// Calls `handler` for each reading in the batch, oldest first. A malformed batch (wrong version,
+// truncated, trailing bytes, bitmap bits set past the last slot, or values or timestamps out of
+// range) is rejected as a whole, before any handler call. Returns the number of readings, or -1 if
+// the batch was rejected.
+int history_batch_decode(const uint8_t *data, size_t length, HistoryBatchReadingHandler handler,
+                         void *context);
@@ -0,0 +1,192 @@
+#include "journal.h"
+#include "config.h"
+#include "history.h"
+#include "metrics.h"
+#include "scheduler.h"
+
+// Persist keys. settings.c uses 1, agp.c 64 and up, daily.c 80 and up.
+#define PERSIST_KEY_TAIL 16     // JOURNAL_TAIL_SLOTS keys
+#define PERSIST_KEY_SNAPSHOT 32 // SNAPSHOT_RECORDS keys
+
+// Record layout, little endian:
+//
+//   uint16  CRC-16/CCITT of the rest of the record
+//   uint32  generation of the snapshot
+//   uint8   reading count
+//   then per reading, oldest first: uint32 timestamp [seconds since epoch], uint16 value [mg/dL]
+#define HEADER_SIZE 7
+#define READING_SIZE 6
+#define RECORD_READINGS ((PERSIST_DATA_MAX_LENGTH - HEADER_SIZE) / READING_SIZE)
+#define RECORD_MAX_SIZE (HEADER_SIZE + RECORD_READINGS * READING_SIZE)
+
+// Readings in the snapshot. Apps only get 4 KB of persistent storage, so of a longer history only
+// the newest readings are persisted.
+#define SNAPSHOT_MAX_READINGS 288
+#if HISTORY_SIZE < SNAPSHOT_MAX_READINGS
+#define SNAPSHOT_READINGS HISTORY_SIZE
+#else
+#define SNAPSHOT_READINGS SNAPSHOT_MAX_READINGS
+#endif
+#define SNAPSHOT_RECORDS ((SNAPSHOT_READINGS + RECORD_READINGS - 1) / RECORD_READINGS)
+
+// Time a compaction may wait for a wakeup that happens anyway [milliseconds]
+#define COMPACT_SLACK_MS (60 * 1000)
+
+static uint32_t s_generation = 1; // Of the current snapshot, 0 is never used
+static uint8_t s_tail_count = 0;  // Tail slots used in the current generation
+
+static uint16_t crc16(const uint8_t *data, size_t length) {
+    uint16_t crc = 0xFFFF;
+    for (size_t i = 0; i < length; i++) {
+        crc ^= data[i] << 8;
+        for (uint8_t bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+static uint16_t read_uint16(const uint8_t *data) { return data[0] | (data[1] << 8); }
+
+static uint32_t read_uint32(const uint8_t *data) {
+    return read_uint16(data) | ((uint32_t)read_uint16(data + 2) << 16);
+}
+
+static void write_uint16(uint8_t *data, uint16_t value) {
+    data[0] = value;
+    data[1] = value >> 8;
+}
+
+static void write_uint32(uint8_t *data, uint32_t value) {
+    write_uint16(data, value);
+    write_uint16(data + 2, value >> 16);
+}
+
+// Size of the records holding `count` readings
+static uint32_t records_size(uint16_t count) {
+    return (count + RECORD_READINGS - 1) / RECORD_READINGS * HEADER_SIZE + count * READING_SIZE;
+}
+
+// Encodes the `count` readings from `newest_age` back. Returns the record length.
+static size_t encode_record(uint8_t *record, uint16_t newest_age, uint8_t count) {
+    write_uint32(record + 2, s_generation);
+    record[6] = count;
+    uint8_t *reading = record + HEADER_SIZE;
+    for (uint16_t age = newest_age + count; age-- > newest_age; reading += READING_SIZE) {
+        write_uint32(reading, history_get(age)->timestamp);
+        write_uint16(reading + 4, history_get(age)->mgdl);
+    }
+    const size_t length = reading - record;
+    write_uint16(record, crc16(record + 2, length - 2));
+    return length;
+}
+
+// Reads and checks a record. Returns its reading count, or -1 if it is missing or corrupt.
+static int read_record(uint32_t key, uint8_t *record, uint32_t *generation) {
+    const int length = persist_read_data(key, record, RECORD_MAX_SIZE);
+    if (length < HEADER_SIZE) {
+        return -1;
+    }
+    const uint8_t count = record[6];
+    if (count > RECORD_READINGS || length != HEADER_SIZE + count * READING_SIZE ||
+        read_uint16(record) != crc16(record + 2, length - 2)) {
+        return -1;
+    }
+    *generation = read_uint32(record + 2);
+    return count;
+}
+
+static void write_record(uint32_t key, const uint8_t *record, size_t length) {
+    persist_write_data(key, record, length);
+    metrics_record_flash_write(length);
+}
+
+// Snapshot records first, oldest readings first, so reading them back mostly appends to the
+// history instead of inserting.
+#define KEY_COUNT (SNAPSHOT_RECORDS + JOURNAL_TAIL_SLOTS)
+
+static uint32_t key_at(uint8_t index) {
+    return (index < SNAPSHOT_RECORDS) ? PERSIST_KEY_SNAPSHOT + index
+                                      : PERSIST_KEY_TAIL + index - SNAPSHOT_RECORDS;
+}
+
+// Writes the history as the snapshot of the current generation.
+static void write_snapshot(void) {
+    uint16_t age = history_count() < SNAPSHOT_READINGS ? history_count() : SNAPSHOT_READINGS;
+    uint8_t record[RECORD_MAX_SIZE];
+    for (uint8_t i = 0; age > 0; i++) {
+        const uint8_t count = age < RECORD_READINGS ? age : RECORD_READINGS;
+        age -= count;
+        write_record(PERSIST_KEY_SNAPSHOT + i, record, encode_record(record, age, count));
+    }
+    s_tail_count = 0;
+}
+
+static void compact_callback(void *context) {
+    s_generation++;
+    write_snapshot();
+}
+
+static SchedulerTask s_compact_task = {.callback = compact_callback};
+
+void journal_init(void) {
+    uint8_t record[RECORD_MAX_SIZE];
+    uint32_t generation;
+    uint32_t newest = 0;
+    for (uint8_t i = 0; i < KEY_COUNT; i++) {
+        if (read_record(key_at(i), record, &generation) >= 0 && generation > newest) {
+            newest = generation;
+        }
+    }
+    if (newest == 0) {
+        return;
+    }
+
+    bool is_interrupted = false; // Set if a compaction was cut short
+    for (uint8_t i = 0; i < KEY_COUNT; i++) {
+        const int count = read_record(key_at(i), record, &generation);
+        if (count < 0 || generation + 1 < newest) {
+            continue;
+        }
+        if (i < SNAPSHOT_RECORDS && generation < newest) {
+            is_interrupted = true;
+        }
+        for (const uint8_t *reading = record + HEADER_SIZE;
+             reading < record + HEADER_SIZE + count * READING_SIZE; reading += READING_SIZE) {
+            const uint16_t mgdl = read_uint16(reading + 4);
+            history_insert(read_uint32(reading), mgdl, mgdl);
+        }
+        if (i >= SNAPSHOT_RECORDS && generation == newest) {
+            s_tail_count = i - SNAPSHOT_RECORDS + 1;
+        }
+    }
+    s_generation = newest;
+
+    // Finish it, before new tail records overwrite those of the previous generation. In the same
+    // generation: a new one would leave the previous generation unread if this is cut short too.
+    if (is_interrupted) {
+        write_snapshot();
+    }
+}
+
+void journal_append(void) {
+    // What rewriting the whole history on every reading would write
+    const uint16_t count = history_count();
+    metrics_record_flash_naive(records_size(count < SNAPSHOT_READINGS ? count : SNAPSHOT_READINGS));
+
+    // A full tail waits for the compaction, which takes this reading along. It is requested again
+    // here in case the face restarted with a full tail.
+    if (s_tail_count == JOURNAL_TAIL_SLOTS) {
+        journal_mark_dirty();
+        return;
+    }
+    uint8_t record[HEADER_SIZE + READING_SIZE];
+    write_record(PERSIST_KEY_TAIL + s_tail_count, record, encode_record(record, 0, 1));
+
+    s_tail_count++;
+    if (s_tail_count == JOURNAL_TAIL_SLOTS) {
+        journal_mark_dirty();
+    }
+}
+
+void journal_mark_dirty(void) { scheduler_schedule(&s_compact_task, 0, COMPACT_SLACK_MS); }
@@ -0,0 +1,30 @@
+// Persists the reading history across restarts of the face, as an append-only journal.
+//
+// Rewriting the whole history on every reading would write about 2 KB of flash every 5 minutes,
+// which is slow and wears the small persistent storage. Instead each new reading is appended as a
+// small record of its own to a tail of JOURNAL_TAIL_SLOTS keys. Once the tail is full, or after a
+// backfill, the whole history is written again as a compacted snapshot, in the next wakeup that
+// happens anyway (see scheduler.h), and the tail starts over.
+//
+// Every record carries the generation of the snapshot it belongs to and a CRC. At startup,
+// records with a bad CRC are skipped, and records of the newest two generations are read back, so
+// a restart during compaction loses nothing: the new snapshot is partly written, and the old
+// snapshot and its tail still hold the rest. The next start finishes the new snapshot, in the same
+// generation, so it may be cut short again. Smoothed values are not persisted, so restored
+// readings are shown unsmoothed.
+
+#pragma once
+
+#include <pebble.h>
+
+// Readings appended between compactions
+#define JOURNAL_TAIL_SLOTS 12
+
+// Reads the persisted readings back into the history.
+void journal_init(void);
+
+// Appends the newest reading of the history, after history_add() added it.
+void journal_append(void);
+
+// Requests a compaction after readings were inserted in the middle of the history.
+void journal_mark_dirty(void);
@@ -0,0 +1,46 @@
+#include "log.h"
+
+static LogRecord s_ring[LOG_RING_SIZE];
+static uint8_t s_next = 0; // Index of the next record to write
+static bool s_wrapped = false;
+static uint32_t s_last_time = 0; // Seconds since epoch, of the newest record
+
+static bool is_ambiguous(uint32_t later_time) {
+    return (s_next > 0 || s_wrapped) && later_time - s_last_time > 0xFFFF;
+}
+
+void log_event(LogEvent event, uint8_t arg0, uint16_t arg1, uint16_t arg2) {
+    const uint32_t now = time(NULL);
+    if (is_ambiguous(now)) {
+        s_ring[(s_next + LOG_RING_SIZE - 1) % LOG_RING_SIZE].event |= LOG_EVENT_AMBIGUOUS_TIME;
+    }
+    s_last_time = now;
+    s_ring[s_next] = (LogRecord){
+        .time = now & 0xFFFF,
+        .event = event,
+        .arg0 = arg0,
+        .arg1 = arg1,
+        .arg2 = arg2,
+    };
+    s_next = (s_next + 1) % LOG_RING_SIZE;
+    if (s_next == 0) {
+        s_wrapped = true;
+    }
+}
+
+size_t log_dump(uint8_t *buf) {
+    const uint32_t now = time(NULL);
+    memcpy(buf, &now, sizeof(now));
+    size_t size = sizeof(now);
+
+    const uint8_t oldest = s_wrapped ? s_next : 0;
+    const uint8_t count = s_wrapped ? LOG_RING_SIZE : s_next;
+    for (uint8_t i = 0; i < count; i++) {
+        memcpy(&buf[size], &s_ring[(oldest + i) % LOG_RING_SIZE], sizeof(LogRecord));
+        size += sizeof(LogRecord);
+    }
+    if (is_ambiguous(now)) {
+        buf[size - sizeof(LogRecord) + offsetof(LogRecord, event)] |= LOG_EVENT_AMBIGUOUS_TIME;
+    }
+    return size;
+}
@@ -0,0 +1,89 @@
+// Logging with compile-time levels.
+//
+// Hot paths log compact binary events (an event ID and three small arguments) instead of
+// formatted text. Events are kept in a RAM ring buffer, which xDrip or a debug tool can request
+// with KEY_DEBUG_DUMP, and tools/decode_log.py decodes on the host. Text logs with LOG() are for
+// cold paths only. Anything above LOG_LEVEL, set per build in wscript, is compiled out along with
+// its strings, so release builds (LOG_LEVEL_NONE) pay nothing.
+
+#pragma once
+
+#include <pebble.h>
+
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_INFO 2
+#define LOG_LEVEL_DEBUG 3
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_NONE
+#endif
+
+// Event IDs. Keep in sync with EVENTS in tools/decode_log.py.
+typedef enum {
+    LOG_EVENT_BG_RECEIVED = 1,         // arrow index, mg/dL, 1 if new reading
+    LOG_EVENT_OUTBOX_BEGIN_FAILED = 2, // -, AppMessageResult
+    LOG_EVENT_OUTBOX_SEND_FAILED = 3,  // -, AppMessageResult
+    LOG_EVENT_CAPABILITIES_SENT = 4,   // protocol version, capabilities low and high 16 bits
+    LOG_EVENT_HEAP_GROWTH = 5,         // -, bytes grown since startup, bytes used at startup
+    LOG_EVENT_HISTORY_BATCH = 6,       // 1 if valid, batch bytes, readings decoded
+    LOG_EVENT_MESSAGE_REJECTED = 7,    // tuple type, key, tuple length
+    LOG_EVENT_ALLOC_FAILED = 8,        // AllocSite, heap bytes free, heap bytes used
+    LOG_EVENT_QUIET_ENDED = 9,         // hours in quiet mode, wakeups saved, redraws saved
+    LOG_EVENT_SETTINGS = 10,           // 1 if valid, bytes, SETTINGS_CHANGED_* bits
+} LogEvent;
+
+// Set in a record's event when the next record, or the dump, is more than 0xFFFF seconds later,
+// so the low 16 bits of its time no longer tell how much older it is. Event IDs stay below it.
+#define LOG_EVENT_AMBIGUOUS_TIME 0x80
+
+typedef struct {
+    uint16_t time; // Seconds since epoch, low 16 bits
+    uint8_t event; // LogEvent, or'ed with LOG_EVENT_AMBIGUOUS_TIME
+    uint8_t arg0;
+    uint16_t arg1;
+    uint16_t arg2;
+} LogRecord;
+
+// Records kept in the ring buffer
+#define LOG_RING_SIZE 32
+
+// Size of a serialized dump: current time followed by the records, oldest first
+#define LOG_DUMP_SIZE (sizeof(uint32_t) + LOG_RING_SIZE * sizeof(LogRecord))
+
+#define LOG_APP_LEVEL(level)                                                                       \
+    ((level) == LOG_LEVEL_ERROR  ? APP_LOG_LEVEL_ERROR                                            \
+     : (level) == LOG_LEVEL_INFO ? APP_LOG_LEVEL_INFO                                             \
+                                 : APP_LOG_LEVEL_DEBUG)
+
+#define LOG(level, fmt, ...)                                                                       \
+    do {                                                                                           \
+        if ((level) <= LOG_LEVEL) {                                                                \
+            APP_LOG(LOG_APP_LEVEL(level), fmt, ##__VA_ARGS__);                                     \
+        }                                                                                          \
+    } while (0)
+
+#if LOG_LEVEL > LOG_LEVEL_NONE
+
+void log_event(LogEvent event, uint8_t arg0, uint16_t arg1, uint16_t arg2);
+
+// Writes the ring buffer to `buf`, which must fit LOG_DUMP_SIZE bytes. Returns the bytes written.
+size_t log_dump(uint8_t *buf);
+
+#define LOG_EVENT(level, event, arg0, arg1, arg2)                                                  \
+    do {                                                                                           \
+        if ((level) <= LOG_LEVEL) {                                                                \
+            log_event((event), (arg0), (arg1), (arg2));                                            \
+        }                                                                                          \
+    } while (0)
+
+#else
+
+#define LOG_EVENT(level, event, arg0, arg1, arg2)                                                  \
+    do {                                                                                           \
+        (void)(arg0);                                                                              \
+        (void)(arg1);                                                                              \
+        (void)(arg2);                                                                              \
+    } while (0)
+
+#endif
@@ -8,28 +8,82 @@
 //   - time ago (time since BG reading)
 //   - BG delta
 //   - time and date
+//   - IOB and COB, if the build has loop fields
+//   - on emery: a history graph and a statistics row
+//
+// The protocol itself is in xdrip.h, which has no UI, so other watchfaces can reuse it.
+//
+// Tapping the watch shows a detail view for a few seconds, see detail.h.
+// During Quiet Time it ticks once an hour and redraws on the next tap, see quiet.h.
 //
 // Until it gets data, it displays "---" for glucose and nothing for the rest.
 
+#include "agp.h"
+#include "alerts.h"
+#include "config.h"
+#include "daily.h"
+#include "detail.h"
+#include "filter.h"
+#include "graph.h"
+#include "history.h"
+#include "history_batch.h"
+#include "journal.h"
+#include "log.h"
+#include "metrics.h"
+#include "quiet.h"
+#include "readings.h"
+#include "scheduler.h"
+#include "settings.h"
+#include "simulator.h"
+#include "stats.h"
 #include "test_mode.h"
+#include "units.h"
+#include "xdrip.h"
 #include <pebble.h>
 
-#define PROTOCOL_VERSION 1 // Bump for breaking protocol changes
-
-// Message keys: Pebble -> xDrip capability announcement
-#define KEY_PROTOCOL_VERSION 0
-#define KEY_CAPABILITIES 1
-
-// Message keys: xDrip -> Pebble watchface data
-#define KEY_BG_TIMESTAMP 10 // UNIX epoch time [seconds]
-#define KEY_BG_STRING 11    // Formatted BG value, e.g. "7.5" or "135"
-#define KEY_DELTA_STRING 12 // Formatted delta, e.g. "+0.3" or "-5"
-#define KEY_ARROW_INDEX 13
-
-// Capability bits (what data the watchface wants to receive)
-#define CAP_BG (1 << 0)
-#define CAP_TREND_ARROW (1 << 1)
-#define CAP_DELTA (1 << 2)
+// Minimum time between capability announcements for changes on the watch [milliseconds]. Reconnects
+// announce at once.
+#define ANNOUNCE_INTERVAL_MS 5000
+#define ANNOUNCE_SLACK_MS 1000
+
+// A reading this long after the newest one in the history leaves a gap to backfill [seconds]
+#define HISTORY_GAP (15 * 60)
+
+// Layout, per display. Emery's larger display fits bigger BG digits, a history graph and a
+// statistics row.
+typedef struct {
+    GRect bg, arrow, time_ago, delta, loop, graph, stats, time, date;
+    const char *time_font;
+    const char *date_font;
+} Layout;
+
+#if LAYOUT_LARGE
+static const Layout LAYOUT = {
+    .bg = {{0, 0}, {150, 56}},
+    .arrow = {{160, 18}, {30, 30}},
+    .time_ago = {{10, 52}, {60, 30}},
+    .delta = {{130, 52}, {60, 30}},
+    .loop = {{10, 56}, {180, 24}}, // Row shared with time ago and delta, see layout_loop_row()
+    .graph = {{0, 84}, {200, 84}},
+    .stats = {{0, 166}, {200, 22}},
+    .time = {{10, 188}, {96, 40}}, // Fits '20:23', left of the date
+    .date = {{106, 198}, {84, 24}},
+    .time_font = FONT_KEY_BITHAM_34_MEDIUM_NUMBERS,
+    .date_font = FONT_KEY_GOTHIC_18_BOLD,
+};
+#else
+static const Layout LAYOUT = {
+    .bg = {{0, 0}, {PBL_DISPLAY_WIDTH - 30 - 10, 42}},
+    .arrow = {{PBL_DISPLAY_WIDTH - 30 - 10, 12}, {30, 30}},
+    .time_ago = {{10, 42}, {50, 42}},
+    .delta = {{PBL_DISPLAY_WIDTH - 50 - 10, 42}, {50, 42}},
+    .time = {{0, 82}, {PBL_DISPLAY_WIDTH, 42}},
+    .date = {{0, 126}, {PBL_DISPLAY_WIDTH, 24}},
+    .loop = {{0, 148}, {PBL_DISPLAY_WIDTH, 20}},
+    .time_font = FONT_KEY_BITHAM_42_BOLD,
+    .date_font = FONT_KEY_GOTHIC_24_BOLD,
+};
+#endif
 
 // Layout elements
 static Window *s_window = NULL;
@@ -39,16 +93,45 @@ static TextLayer *s_time_ago_layer = NULL;
 static TextLayer *s_time_layer = NULL;
 static TextLayer *s_date_layer = NULL;
 static BitmapLayer *s_arrow_layer = NULL;
-static GBitmap *s_arrow_bitmap = NULL;
+#if FEATURE_LOOP
+static TextLayer *s_loop_layer = NULL;
+#endif
+#if FEATURE_GRAPH
+static Layer *s_graph_layer = NULL;
+#endif
+#if FEATURE_STATS
+static TextLayer *s_stats_layer = NULL;
+#endif
 
-// Watchface data
-static uint32_t s_bg_timestamp = 0;    // Seconds since epoch
-static char s_bg_string[5] = "---";    // Fits '10.0'
-static char s_delta_string[6] = "";    // Fits '+0.06'
-static uint8_t s_arrow_index = 0;      // See ARROWS below
+// Watchface data. What xDrip sent is in xdrip_model().
+static bool s_connected = true;        // Phone connection, once settled
+static char s_bg_buffer[5] = "---";    // BG in the display unit, fits '10.0'
+static char s_delta_buffer[6] = "";    // Delta in the display unit, fits '+0.06'
 static char s_time_ago_buffer[4] = ""; // Fits '99h'
 static char s_time_buffer[6] = "";     // Fits '20:23'
 static char s_date_buffer[11] = "";    // Fits 'Tue 13 Jan'
+#if FEATURE_HISTORY
+static bool s_history_has_gap = true;    // Until the first backfill
+static uint32_t s_disconnected_time = 0; // Seconds since epoch, when the connection last dropped
+#endif
+#if FEATURE_LOOP
+static char s_loop_buffer[14] = "";  // Fits '12.25U  120g'
+static bool s_battery_saver = false; // Loop fields hidden to save battery
+#endif
+#if FEATURE_STATS
+static char s_stats_buffer[32] = ""; // Fits 'Avg 10.0  In range 100%'
+#endif
+
+// Inbox size, announced to xDrip so it can size history batches to it
+#define INBOX_SIZE 256
+
+// Outbox size. Debug builds make room for the binary log dump, plus the dictionary and tuple
+// headers.
+#if LOG_LEVEL > LOG_LEVEL_NONE
+#define OUTBOX_SIZE (64 + 1 + 7 + LOG_DUMP_SIZE)
+#else
+#define OUTBOX_SIZE 64
+#endif
 
 // Mapping: Arrow index -> Arrow image resource ID
 static const uint32_t ARROWS[] = {0, // unknown, no arrow
@@ -59,48 +142,185 @@ static const uint32_t ARROWS[] = {0, // unknown, no arrow
                                   RESOURCE_ID_ARROW_DOWN_SLANT,
                                   RESOURCE_ID_ARROW_DOWN,
                                   RESOURCE_ID_ARROW_DOWN_DOUBLE};
-
-static inline char *safe_strncpy(char *dest, const char *src, size_t count) {
-    if (count > 0) {
-        strncpy(dest, src, count);
-        dest[count - 1] = '\0';
+#define ARROW_COUNT (sizeof(ARROWS) / sizeof(ARROWS[0]))
+
+// All arrows are loaded once in window_load, so a new arrow doesn't allocate. They are small
+// palettized images, and a fixed set of blocks doesn't fragment the heap the way reloading one per
+// message does over days of uptime.
+static GBitmap *s_arrow_bitmaps[ARROW_COUNT];
+static uint8_t s_displayed_arrow_index = 0;
+
+#if LAYOUT_LARGE && FEATURE_LOOP
+// On emery, IOB and COB sit between time ago and delta. '12.25U  120g' needs about 90 px, so they
+// get the width those two leave free, centered in it.
+static void layout_loop_row(void) {
+    int16_t left = LAYOUT.loop.origin.x;
+    int16_t right = LAYOUT.loop.origin.x + LAYOUT.loop.size.w;
+    if (!layer_get_hidden(text_layer_get_layer(s_time_ago_layer))) {
+        left = LAYOUT.time_ago.origin.x + text_layer_get_content_size(s_time_ago_layer).w;
+    }
+    if (!layer_get_hidden(text_layer_get_layer(s_delta_layer))) {
+        right = LAYOUT.delta.origin.x + LAYOUT.delta.size.w -
+                text_layer_get_content_size(s_delta_layer).w;
     }
-    return dest;
+    layer_set_frame(text_layer_get_layer(s_loop_layer),
+                    GRect(left, LAYOUT.loop.origin.y, right - left, LAYOUT.loop.size.h));
 }
+#endif
 
 static void update_displayed_time_ago(void) {
-    // Don't populate until we have valid data.
-    if (s_bg_timestamp == 0) {
-        return;
+    xdrip_format_time_ago(s_time_ago_buffer, sizeof(s_time_ago_buffer), time(NULL));
+    text_layer_set_text(s_time_ago_layer, s_time_ago_buffer);
+#if LAYOUT_LARGE && FEATURE_LOOP
+    layout_loop_row();
+#endif
+}
+
+// Unit of the displayed values: as xDrip sends them, unless set in the settings
+static bool display_is_mmol(void) {
+    switch (settings_get()->unit) {
+    case SETTINGS_UNIT_MGDL:
+        return false;
+    case SETTINGS_UNIT_MMOL:
+        return true;
+    default:
+        return xdrip_model()->bg_is_mmol;
     }
+}
 
-    const int minutes_ago = (time(NULL) - s_bg_timestamp) / 60;
-    if (minutes_ago < 60) {
-        snprintf(s_time_ago_buffer, sizeof(s_time_ago_buffer), "%dm", minutes_ago);
+static void update_display_strings(void) {
+    const XdripModel *model = xdrip_model();
+    const bool mmol = display_is_mmol();
+    if (mmol == model->bg_is_mmol || model->bg_mgdl == 0) {
+        snprintf(s_bg_buffer, sizeof(s_bg_buffer), "%s", model->bg_string);
+        snprintf(s_delta_buffer, sizeof(s_delta_buffer), "%s", model->delta_string);
     } else {
-        snprintf(s_time_ago_buffer, sizeof(s_time_ago_buffer), "%dh", minutes_ago / 60);
+        bg_format(s_bg_buffer, sizeof(s_bg_buffer), model->bg_mgdl, mmol);
+        bg_convert_delta(s_delta_buffer, sizeof(s_delta_buffer), model->delta_string, mmol);
     }
-    text_layer_set_text(s_time_ago_layer, s_time_ago_buffer);
 }
 
+#if FEATURE_LOOP
+static bool loop_is_shown(void) {
+    return !s_battery_saver && (settings_get()->components & SETTINGS_SHOW_LOOP);
+}
+#endif
+
+// Roboto 49 only has digits, so it is used for mg/dL values only. Anything else, like "7.5" or
+// "---", falls back to Bitham 42.
+static GFont bg_font(const char *bg_string) {
+#if LAYOUT_LARGE
+    for (const char *c = bg_string; *c != '\0'; c++) {
+        if (*c < '0' || *c > '9') {
+            return fonts_get_system_font(FONT_KEY_BITHAM_42_BOLD);
+        }
+    }
+    return fonts_get_system_font(FONT_KEY_ROBOTO_BOLD_SUBSET_49);
+#else
+    return fonts_get_system_font(FONT_KEY_BITHAM_42_BOLD);
+#endif
+}
+
+#if FEATURE_COLOR
+static GColor bg_color(uint16_t mgdl) {
+    if (mgdl > 0 && mgdl < settings_get()->target_low_mgdl) {
+        return GColorRed;
+    }
+    if (mgdl > settings_get()->target_high_mgdl) {
+        return GColorOrange;
+    }
+    return GColorBlack;
+}
+#endif
+
+#if FEATURE_GRAPH || FEATURE_STATS
+static void update_displayed_history(void) {
+#if FEATURE_STATS
+    Stats stats;
+    stats_compute(&stats, time(NULL) - STATS_SPAN);
+    if (stats.count > 0) {
+        char mean[6];
+        bg_format(mean, sizeof(mean), stats.mean_mgdl, display_is_mmol());
+        snprintf(s_stats_buffer, sizeof(s_stats_buffer), "Avg %s  In range %d%%", mean,
+                 stats.in_range_percent);
+    }
+    text_layer_set_text(s_stats_layer, s_stats_buffer);
+#endif
+#if FEATURE_GRAPH
+    graph_layer_set_mmol(s_graph_layer, display_is_mmol());
+    graph_layer_set_target(s_graph_layer, settings_get()->target_low_mgdl,
+                           settings_get()->target_high_mgdl);
+    layer_mark_dirty(s_graph_layer);
+#endif
+}
+#endif
+
 static void update_displayed_xdrip_data(void) {
+    const XdripModel *model = xdrip_model();
+
     // Update displayed BG value
-    text_layer_set_text(s_bg_layer, s_bg_string);
+    text_layer_set_font(s_bg_layer, bg_font(s_bg_buffer));
+#if FEATURE_COLOR
+    text_layer_set_text_color(s_bg_layer, bg_color(model->bg_mgdl));
+#endif
+    text_layer_set_text(s_bg_layer, s_bg_buffer);
 
     // Update displayed delta value
-    text_layer_set_text(s_delta_layer, s_delta_string);
+    text_layer_set_text(s_delta_layer, s_delta_buffer);
 
-    // Update displayed trend arrow
-    if (s_arrow_bitmap) {
-        gbitmap_destroy(s_arrow_bitmap);
-        s_arrow_bitmap = NULL;
+    // Update displayed trend arrow, if it changed
+#if FEATURE_SMOOTHING
+    uint8_t arrow_index = filter_arrow_index(model->arrow_index);
+#else
+    uint8_t arrow_index = model->arrow_index;
+#endif
+    if (arrow_index >= ARROW_COUNT) {
+        arrow_index = 0;
     }
-    if (s_arrow_index > 0 && s_arrow_index < sizeof(ARROWS) / sizeof(ARROWS[0])) {
-        s_arrow_bitmap = gbitmap_create_with_resource(ARROWS[s_arrow_index]);
-        bitmap_layer_set_bitmap(s_arrow_layer, s_arrow_bitmap);
-    } else {
-        bitmap_layer_set_bitmap(s_arrow_layer, NULL);
+    if (arrow_index != s_displayed_arrow_index) {
+        bitmap_layer_set_bitmap(s_arrow_layer, s_arrow_bitmaps[arrow_index]);
+        s_displayed_arrow_index = arrow_index;
     }
+
+#if FEATURE_LOOP
+    // Update displayed IOB and COB
+    layer_set_hidden(text_layer_get_layer(s_loop_layer), !loop_is_shown());
+    snprintf(s_loop_buffer, sizeof(s_loop_buffer), "%s  %s", model->iob_string, model->cob_string);
+    text_layer_set_text(s_loop_layer, s_loop_buffer);
+#if LAYOUT_LARGE
+    layout_loop_row();
+#endif
+#endif
+
+#if FEATURE_GRAPH || FEATURE_STATS
+    update_displayed_history();
+#endif
+}
+
+#if FEATURE_DISCONNECTED
+static void update_displayed_connection(void) {
+    text_layer_set_background_color(s_time_ago_layer, s_connected ? GColorClear : GColorBlack);
+    text_layer_set_text_color(s_time_ago_layer, s_connected ? GColorBlack : GColorWhite);
+}
+#endif
+
+// Shows the components enabled in the settings. The loop fields also depend on the battery saver,
+// and are shown or hidden with the rest of the xDrip data.
+static void update_displayed_components(void) {
+    const uint8_t components = settings_get()->components;
+    layer_set_hidden(text_layer_get_layer(s_delta_layer), !(components & SETTINGS_SHOW_DELTA));
+    layer_set_hidden(text_layer_get_layer(s_time_ago_layer),
+                     !(components & SETTINGS_SHOW_TIME_AGO));
+    layer_set_hidden(text_layer_get_layer(s_date_layer), !(components & SETTINGS_SHOW_DATE));
+#if FEATURE_GRAPH
+    layer_set_hidden(s_graph_layer, !(components & SETTINGS_SHOW_GRAPH));
+#endif
+#if FEATURE_STATS
+    layer_set_hidden(text_layer_get_layer(s_stats_layer), !(components & SETTINGS_SHOW_STATS));
+#endif
+#if LAYOUT_LARGE && FEATURE_LOOP
+    layout_loop_row();
+#endif
 }
 
 static void update_displayed_time_and_date(void) {
@@ -113,58 +333,81 @@ static void update_displayed_time_and_date(void) {
     text_layer_set_text(s_date_layer, s_date_buffer);
 }
 
+static TextLayer *text_layer_create_in(Layer *root_layer, GRect frame, const char *font_key,
+                                       GTextAlignment alignment) {
+    TextLayer *layer = text_layer_create(frame);
+    text_layer_set_background_color(layer, GColorClear);
+    text_layer_set_text_color(layer, GColorBlack);
+    text_layer_set_font(layer, fonts_get_system_font(font_key));
+    text_layer_set_text_alignment(layer, alignment);
+    layer_add_child(root_layer, text_layer_get_layer(layer));
+    return layer;
+}
+
 static void window_load(Window *window) {
     Layer *root_layer = window_get_root_layer(window);
+    metrics_attach_frame_begin(root_layer);
 
     // BG value - top, left
-    s_bg_layer = text_layer_create(GRect(0, 0, PBL_DISPLAY_WIDTH - 30 - 10, 42));
-    text_layer_set_background_color(s_bg_layer, GColorClear);
-    text_layer_set_text_color(s_bg_layer, GColorBlack);
-    text_layer_set_font(s_bg_layer, fonts_get_system_font(FONT_KEY_BITHAM_42_BOLD));
-    text_layer_set_text_alignment(s_bg_layer, GTextAlignmentCenter);
-    layer_add_child(root_layer, text_layer_get_layer(s_bg_layer));
+    s_bg_layer = text_layer_create_in(root_layer, LAYOUT.bg, FONT_KEY_BITHAM_42_BOLD,
+                                      GTextAlignmentCenter);
 
     // Arrow - to the right of BG
-    s_arrow_layer = bitmap_layer_create(GRect(PBL_DISPLAY_WIDTH - 30 - 10, 12, 30, 30));
+    s_arrow_layer = bitmap_layer_create(LAYOUT.arrow);
     bitmap_layer_set_compositing_mode(s_arrow_layer, GCompOpSet);
     layer_add_child(root_layer, bitmap_layer_get_layer(s_arrow_layer));
+    for (size_t i = 1; i < ARROW_COUNT; i++) {
+        s_arrow_bitmaps[i] = gbitmap_create_with_resource(ARROWS[i]);
+    }
+    s_displayed_arrow_index = 0;
 
     // Time ago - below BG, left
-    s_time_ago_layer = text_layer_create(GRect(10, 42, 50, 42));
-    text_layer_set_background_color(s_time_ago_layer, GColorClear);
-    text_layer_set_text_color(s_time_ago_layer, GColorBlack);
-    text_layer_set_font(s_time_ago_layer, fonts_get_system_font(FONT_KEY_GOTHIC_24_BOLD));
-    text_layer_set_text_alignment(s_time_ago_layer, GTextAlignmentLeft);
-    layer_add_child(root_layer, text_layer_get_layer(s_time_ago_layer));
+    s_time_ago_layer = text_layer_create_in(root_layer, LAYOUT.time_ago, FONT_KEY_GOTHIC_24_BOLD,
+                                            GTextAlignmentLeft);
 
     // Delta - below BG, right
-    s_delta_layer = text_layer_create(GRect(PBL_DISPLAY_WIDTH - 50 - 10, 42, 50, 42));
-    text_layer_set_background_color(s_delta_layer, GColorClear);
-    text_layer_set_text_color(s_delta_layer, GColorBlack);
-    text_layer_set_font(s_delta_layer, fonts_get_system_font(FONT_KEY_GOTHIC_24_BOLD));
-    text_layer_set_text_alignment(s_delta_layer, GTextAlignmentRight);
-    layer_add_child(root_layer, text_layer_get_layer(s_delta_layer));
-
-    // Current time - bottom, centered
-    s_time_layer = text_layer_create(GRect(0, 82, PBL_DISPLAY_WIDTH, 42));
-    text_layer_set_background_color(s_time_layer, GColorClear);
-    text_layer_set_text_color(s_time_layer, GColorBlack);
-    text_layer_set_font(s_time_layer, fonts_get_system_font(FONT_KEY_BITHAM_42_BOLD));
-    text_layer_set_text_alignment(s_time_layer, GTextAlignmentCenter);
-    layer_add_child(root_layer, text_layer_get_layer(s_time_layer));
-
-    // Date - below time
-    s_date_layer = text_layer_create(GRect(0, 126, PBL_DISPLAY_WIDTH, 24));
-    text_layer_set_background_color(s_date_layer, GColorClear);
-    text_layer_set_text_color(s_date_layer, GColorBlack);
-    text_layer_set_font(s_date_layer, fonts_get_system_font(FONT_KEY_GOTHIC_24_BOLD));
-    text_layer_set_text_alignment(s_date_layer, GTextAlignmentCenter);
-    layer_add_child(root_layer, text_layer_get_layer(s_date_layer));
+    s_delta_layer = text_layer_create_in(root_layer, LAYOUT.delta, FONT_KEY_GOTHIC_24_BOLD,
+                                         GTextAlignmentRight);
+
+#if FEATURE_LOOP
+    // IOB and COB - bottom (between time ago and delta on emery)
+    s_loop_layer = text_layer_create_in(root_layer, LAYOUT.loop, FONT_KEY_GOTHIC_18_BOLD,
+                                        GTextAlignmentCenter);
+#endif
+
+#if FEATURE_GRAPH
+    // History graph - below time ago and delta, full width
+    s_graph_layer = graph_layer_create(LAYOUT.graph);
+    layer_add_child(root_layer, s_graph_layer);
+#endif
+
+#if FEATURE_STATS
+    // Statistics - below graph
+    s_stats_layer = text_layer_create_in(root_layer, LAYOUT.stats, FONT_KEY_GOTHIC_18_BOLD,
+                                         GTextAlignmentCenter);
+#endif
+
+    // Current time - bottom, centered (bottom left on emery)
+    s_time_layer = text_layer_create_in(root_layer, LAYOUT.time, LAYOUT.time_font,
+                                        LAYOUT_LARGE ? GTextAlignmentLeft
+                                                         : GTextAlignmentCenter);
+
+    // Date - below time (right of time on emery)
+    s_date_layer = text_layer_create_in(root_layer, LAYOUT.date, LAYOUT.date_font,
+                                        LAYOUT_LARGE ? GTextAlignmentRight
+                                                         : GTextAlignmentCenter);
+
+    metrics_attach_frame_end(root_layer);
 
     // Initial update
+    update_displayed_components();
     update_displayed_xdrip_data();
     update_displayed_time_and_date();
     update_displayed_time_ago();
+#if FEATURE_DISCONNECTED
+    update_displayed_connection();
+#endif
+    metrics_mark_steady_state();
 }
 
 static void window_unload(Window *window) {
@@ -174,95 +417,542 @@ static void window_unload(Window *window) {
     text_layer_destroy(s_time_layer);
     text_layer_destroy(s_date_layer);
     bitmap_layer_destroy(s_arrow_layer);
-    if (s_arrow_bitmap) {
-        gbitmap_destroy(s_arrow_bitmap);
+    for (size_t i = 1; i < ARROW_COUNT; i++) {
+        gbitmap_destroy(s_arrow_bitmaps[i]);
+        s_arrow_bitmaps[i] = NULL;
     }
+#if FEATURE_LOOP
+    text_layer_destroy(s_loop_layer);
+#endif
+#if FEATURE_GRAPH
+    graph_layer_destroy(s_graph_layer);
+#endif
+#if FEATURE_STATS
+    text_layer_destroy(s_stats_layer);
+#endif
+    metrics_detach();
 }
 
-void minute_tick_callback(struct tm *tick_time, TimeUnits units_changed) {
+#if FEATURE_DETAIL
+static void fill_detail_data(DetailData *data) {
+    const XdripModel *model = xdrip_model();
+    *data = (DetailData){
+        .bg_string = s_bg_buffer,
+        .delta_string = s_delta_buffer,
+        .bg_timestamp = model->bg_timestamp,
+        .bg_is_mmol = display_is_mmol(),
+        .connected = s_connected,
+        .last_message_time = model->last_message_time,
+        .iob_string = model->iob_string,
+        .cob_string = model->cob_string,
+        .sensor_age_string = model->sensor_age_string,
+        .phone_battery = model->phone_battery,
+    };
+}
+
+static void update_displayed_detail(void) {
+    if (detail_is_visible()) {
+        DetailData data;
+        fill_detail_data(&data);
+        detail_refresh(&data);
+    }
+}
+#endif
+
+#if FEATURE_QUIET
+static bool s_redraw_deferred = false;
+
+static void update_displayed_all(void) {
+    update_displayed_xdrip_data();
     update_displayed_time_and_date();
     update_displayed_time_ago();
+#if FEATURE_DETAIL
+    update_displayed_detail();
+#endif
 }
+#endif
 
-static void new_xdrip_data_callback(DictionaryIterator *iter, void *context) {
-    // Check for timestamp (always present in data messages)
-    Tuple *timestamp_tuple = dict_find(iter, KEY_BG_TIMESTAMP);
-    if (timestamp_tuple) {
-        s_bg_timestamp = timestamp_tuple->value->uint32;
+// Returns false if redraws wait for the end of the reduced update mode, see quiet.h.
+static bool can_redraw(void) {
+#if FEATURE_QUIET
+    if (quiet_is_active()) {
+        s_redraw_deferred = true;
+        quiet_record_deferred_redraw();
+        return false;
+    }
+#endif
+    return true;
+}
 
-        // BG as string
-        Tuple *bg_tuple = dict_find(iter, KEY_BG_STRING);
-        if (bg_tuple) {
-            safe_strncpy(s_bg_string, bg_tuple->value->cstring, sizeof(s_bg_string));
-        }
+#if FEATURE_QUIET
+// The SDK has no event for the end of Quiet Time, and the hourly tick would leave the face frozen
+// for up to an hour after it. So while Quiet Time is on, the mode is re-evaluated with every
+// reading, which wakes the face anyway, and every 20 to 30 minutes without one, on a timer that
+// each reading moves back. The scheduled hours end on an hourly tick.
+#define QUIET_CHECK_MS (20 * 60 * 1000)
+#define QUIET_CHECK_SLACK_MS (10 * 60 * 1000)
 
-        // Trend arrow
-        Tuple *arrow_tuple = dict_find(iter, KEY_ARROW_INDEX);
-        if (arrow_tuple) {
-            s_arrow_index = arrow_tuple->value->uint8;
-        }
+static void update_quiet_mode(const struct tm *tick_time);
 
-        // Delta as string
-        Tuple *delta_tuple = dict_find(iter, KEY_DELTA_STRING);
-        if (delta_tuple) {
-            safe_strncpy(s_delta_string, delta_tuple->value->cstring, sizeof(s_delta_string));
-        }
+static void quiet_check_callback(void *context) {
+    quiet_record_check();
+    const time_t now = time(NULL);
+    update_quiet_mode(localtime(&now));
+}
 
-        update_displayed_xdrip_data();
+static SchedulerTask s_quiet_check_task = {.callback = quiet_check_callback};
+
+static void schedule_quiet_check(void) {
+    if (quiet_is_active() && quiet_time_is_active()) {
+        scheduler_schedule(&s_quiet_check_task, QUIET_CHECK_MS, QUIET_CHECK_SLACK_MS);
+    } else {
+        scheduler_cancel(&s_quiet_check_task);
+    }
+}
+
+// Ticks every minute, or every hour in the reduced update mode, and redraws what was deferred
+// when leaving it.
+static void apply_quiet_mode(void) {
+    scheduler_set_tick_units(quiet_is_active() ? HOUR_UNIT : MINUTE_UNIT);
+    schedule_quiet_check();
+    if (!quiet_is_active() && s_redraw_deferred) {
+        s_redraw_deferred = false;
+        update_displayed_all();
+    }
+}
+
+// Re-evaluates the mode, on every tick, reading and quiet check
+static void update_quiet_mode(const struct tm *tick_time) {
+    if (quiet_update(tick_time)) {
+        apply_quiet_mode();
+    } else {
+        schedule_quiet_check(); // Quiet Time may have begun during the scheduled hours
+    }
+}
+
+static void wake_from_quiet_mode(void) {
+    if (quiet_is_active()) {
+        quiet_wake();
+        apply_quiet_mode();
+    }
+}
+#endif
+
+static void tick_callback(struct tm *tick_time, TimeUnits units_changed) {
+#if FEATURE_QUIET
+    quiet_record_tick();
+    update_quiet_mode(tick_time);
+#endif
+#if FEATURE_DAILY
+    daily_update(time(NULL)); // Archives the day at midnight, even without a reading
+#endif
+    if (can_redraw()) {
+        update_displayed_time_and_date();
         update_displayed_time_ago();
+#if FEATURE_GRAPH || FEATURE_STATS
+        update_displayed_history(); // Scrolls the graph and drops old readings from the statistics
+#endif
+#if FEATURE_DETAIL
+        update_displayed_detail();
+#endif
+    }
+    if (tick_time->tm_min == 0 || METRICS_REPORT_EVERY_MINUTE) {
+        metrics_report();
+    }
+}
 
-        APP_LOG(APP_LOG_LEVEL_INFO, "Received BG: %s, arrow: %d, delta: %s", s_bg_string,
-                s_arrow_index, s_delta_string);
+// Capabilities follow what is shown right now, so xDrip only sends fields that will be displayed:
+// loop fields unless hidden by the settings or the battery saver, history batches while the history
+// has a gap, and the extended fields while the detail view is shown.
+static uint32_t current_capabilities(void) {
+    uint32_t capabilities = XDRIP_CAP_BG | XDRIP_CAP_TREND_ARROW | XDRIP_CAP_DELTA;
+#if FEATURE_LOOP
+    if (loop_is_shown()) {
+        capabilities |= XDRIP_CAP_LOOP;
+    }
+#endif
+#if FEATURE_HISTORY
+    if (s_history_has_gap) {
+        capabilities |= XDRIP_CAP_HISTORY;
+    }
+#endif
+#if FEATURE_DETAIL
+    if (detail_is_visible()) {
+        capabilities |= XDRIP_CAP_EXTENDED;
     }
+#endif
+    return capabilities;
 }
 
-// This can also be used to trigger xDrip to send fresh data.
-void send_capability_announcement(void) {
+// Sends a message for the protocol core, see xdrip.h
+static bool send_fields(const XdripField *fields, size_t count) {
     DictionaryIterator *iter;
     AppMessageResult result = app_message_outbox_begin(&iter);
-
     if (result != APP_MSG_OK) {
-        APP_LOG(APP_LOG_LEVEL_ERROR, "Failed to begin outbox: %d", result);
-        return;
+        LOG_EVENT(LOG_LEVEL_ERROR, LOG_EVENT_OUTBOX_BEGIN_FAILED, 0, result, 0);
+        return false;
     }
 
-    dict_write_uint8(iter, KEY_PROTOCOL_VERSION, PROTOCOL_VERSION);
-    const uint32_t capabilities = CAP_BG | CAP_TREND_ARROW | CAP_DELTA;
-    dict_write_uint32(iter, KEY_CAPABILITIES, capabilities);
+    for (size_t i = 0; i < count; i++) {
+        const XdripField *field = &fields[i];
+        switch (field->type) {
+        case XDRIP_TYPE_STRING:
+            dict_write_cstring(iter, field->key, (const char *)field->data);
+            break;
+        case XDRIP_TYPE_UINT:
+        case XDRIP_TYPE_INT:
+            dict_write_int(iter, field->key, field->data, field->length,
+                           field->type == XDRIP_TYPE_INT);
+            break;
+        default:
+            dict_write_data(iter, field->key, field->data, field->length);
+            break;
+        }
+    }
+    metrics_record_message_sent(dict_size(iter));
 
     result = app_message_outbox_send();
     if (result != APP_MSG_OK) {
-        APP_LOG(APP_LOG_LEVEL_ERROR, "Failed to send capabilities: %d", result);
+        LOG_EVENT(LOG_LEVEL_ERROR, LOG_EVENT_OUTBOX_SEND_FAILED, 0, result, 0);
+        return false;
+    }
+    return true;
+}
+
+static uint32_t s_announced_capabilities = 0;
+static uint32_t s_last_announcement_ms = 0;
+
+void send_capability_announcement(void);
+
+static void announce_task_callback(void *context) { send_capability_announcement(); }
+
+static SchedulerTask s_announce_task = {.callback = announce_task_callback};
+
+// This can also be used to trigger xDrip to send fresh data.
+void send_capability_announcement(void) {
+    const uint32_t capabilities = current_capabilities();
+    if (xdrip_announce(capabilities, INBOX_SIZE)) {
+        scheduler_cancel(&s_announce_task);
+        s_announced_capabilities = capabilities;
+        s_last_announcement_ms = metrics_now_ms();
+        metrics_record_capabilities(capabilities);
+        LOG_EVENT(LOG_LEVEL_INFO, LOG_EVENT_CAPABILITIES_SENT, XDRIP_PROTOCOL_VERSION,
+                  capabilities & 0xFFFF, capabilities >> 16);
+    }
+}
+
+// Re-announces the capabilities if they changed, at most once per ANNOUNCE_INTERVAL_MS, so a
+// burst of changes costs one message. A change that is undone before then costs none.
+static void update_capabilities(void) {
+    if (current_capabilities() == s_announced_capabilities) {
+        scheduler_cancel(&s_announce_task);
+        return;
+    }
+    const uint32_t elapsed_ms = metrics_now_ms() - s_last_announcement_ms;
+    if (elapsed_ms >= ANNOUNCE_INTERVAL_MS) {
+        scheduler_schedule(&s_announce_task, 0, 0);
     } else {
-        APP_LOG(APP_LOG_LEVEL_INFO, "Sent capability announcement");
+        scheduler_schedule(&s_announce_task, ANNOUNCE_INTERVAL_MS - elapsed_ms,
+                           ANNOUNCE_SLACK_MS);
     }
 }
 
-static void bluetooth_callback(bool connected) {
-    // Re-send capabilities on reconnect. This triggers xDrip to send fresh data.
+static void model_changed_callback(const XdripModel *model, uint32_t changes) {
+    update_display_strings();
+#if FEATURE_QUIET
+    const time_t now = time(NULL);
+    update_quiet_mode(localtime(&now)); // Quiet Time may have ended since the last check
+#endif
+
+    const bool is_new_reading = changes & XDRIP_NEW_READING;
+    if (is_new_reading && model->bg_mgdl > 0) {
+#if FEATURE_SMOOTHING
+        const uint16_t smoothed_mgdl = filter_update(model->bg_timestamp, model->bg_mgdl);
+#else
+        const uint16_t smoothed_mgdl = model->bg_mgdl;
+#endif
+#if FEATURE_HISTORY
+        if (history_count() > 0 &&
+            model->bg_timestamp > history_get(0)->timestamp + HISTORY_GAP) {
+            s_history_has_gap = true;
+            update_capabilities();
+        }
+        readings_add(model->bg_timestamp, model->bg_mgdl, smoothed_mgdl);
+#else
+        (void)smoothed_mgdl;
+#endif
+#if FEATURE_ALERTS && FEATURE_QUIET
+        // Whoever feels the alert will look at the watch
+        if (alerts_evaluate(model->bg_mgdl)) {
+            wake_from_quiet_mode();
+        }
+#elif FEATURE_ALERTS
+        alerts_evaluate(model->bg_mgdl);
+#endif
+    }
+
+    if (s_window && can_redraw()) {
+        update_displayed_xdrip_data();
+        update_displayed_time_ago();
+#if FEATURE_DETAIL
+        update_displayed_detail();
+#endif
+    }
+
+    LOG_EVENT(LOG_LEVEL_INFO, LOG_EVENT_BG_RECEIVED, model->arrow_index, model->bg_mgdl,
+              is_new_reading);
+}
+
+// Applies only what changed: layers are shown or hidden, or redrawn, but never recreated.
+static void settings_callback(const uint8_t *data, uint16_t length) {
+    const int changes = settings_receive(data, length);
+    LOG_EVENT(LOG_LEVEL_INFO, LOG_EVENT_SETTINGS, changes >= 0, length, changes >= 0 ? changes : 0);
+    if (changes <= 0) {
+        return;
+    }
+    if (changes & SETTINGS_CHANGED_UNIT) {
+        update_display_strings();
+    }
+    if (changes & SETTINGS_CHANGED_COMPONENTS) {
+        update_capabilities();
+    }
+    if (!s_window) {
+        return;
+    }
+
+    if (changes & SETTINGS_CHANGED_COMPONENTS) {
+        update_displayed_components();
+    }
+    // BG strings and color, graph band and statistics. Alert settings apply to the next reading.
+    if (changes & (SETTINGS_CHANGED_UNIT | SETTINGS_CHANGED_TARGET | SETTINGS_CHANGED_COMPONENTS)) {
+        update_displayed_xdrip_data();
+#if FEATURE_DETAIL
+        update_displayed_detail();
+#endif
+    }
+}
+
+#if FEATURE_HISTORY
+// Backfilled readings only go into the history. They don't change the displayed BG and don't
+// alert, since they are old news.
+static void backfill_reading_callback(uint32_t timestamp, uint16_t mgdl, void *context) {
+#if FEATURE_SMOOTHING
+    // The filter only runs forward, so readings older than the newest one are stored unsmoothed
+    if (history_count() == 0 || timestamp > history_get(0)->timestamp) {
+        readings_insert(timestamp, mgdl, filter_update(timestamp, mgdl));
+        return;
+    }
+#endif
+    readings_insert(timestamp, mgdl, mgdl);
+}
+
+static void history_batch_callback(const uint8_t *data, uint16_t length) {
+    const int count = history_batch_decode(data, length, backfill_reading_callback, NULL);
+    LOG_EVENT(LOG_LEVEL_INFO, LOG_EVENT_HISTORY_BATCH, count >= 0, length, count >= 0 ? count : 0);
+    if (count > 0) {
+        journal_mark_dirty();
+    }
+    if (count >= 0) {
+        s_history_has_gap = false;
+        update_capabilities();
+    }
+#if FEATURE_GRAPH || FEATURE_STATS
+    if (count > 0 && s_window && can_redraw()) {
+        update_displayed_history();
+    }
+#endif
+}
+#endif
+
+#if LOG_LEVEL > LOG_LEVEL_NONE
+static void send_debug_log(void) {
+    static uint8_t s_dump[LOG_DUMP_SIZE];
+    const XdripField field = {XDRIP_KEY_DEBUG_LOG, XDRIP_TYPE_BYTES, log_dump(s_dump), s_dump};
+    send_fields(&field, 1);
+}
+#endif
+
+// More than xDrip ever sends in one message
+#define MESSAGE_MAX_FIELDS 16
+
+static void inbox_received_callback(DictionaryIterator *iter, void *context) {
+    const uint32_t start_ms = metrics_now_ms();
+    XdripField fields[MESSAGE_MAX_FIELDS];
+    size_t count = 0;
+    const XdripField *rejected = NULL;
+    bool valid = true;
+    for (Tuple *tuple = dict_read_first(iter); tuple; tuple = dict_read_next(iter)) {
+        if (count == MESSAGE_MAX_FIELDS) {
+            valid = false;
+            break;
+        }
+        fields[count++] = (XdripField){tuple->key, (XdripType)tuple->type, tuple->length,
+                                       tuple->value->data};
+    }
+    if (valid) {
+        valid = xdrip_receive(fields, count, time(NULL), &rejected);
+    } else {
+        rejected = &fields[count - 1];
+    }
+
+    metrics_record_message_received(dict_size(iter), !valid, metrics_now_ms() - start_ms);
+    if (!valid) {
+        LOG_EVENT(LOG_LEVEL_ERROR, LOG_EVENT_MESSAGE_REJECTED, rejected->type, rejected->key,
+                  rejected->length);
+    }
+}
+
+static void inbox_dropped_callback(AppMessageResult reason, void *context) {
+    metrics_record_message_dropped();
+}
+
+#define CONNECTION_SETTLE_SLACK_MS 2000
+
+static uint32_t s_connection_events = 0; // Since the connection last settled
+
+static void connection_settled_callback(void *context) {
+    const bool connected = connection_service_peek_pebble_app_connection();
+    metrics_record_connection_settled(s_connection_events - 1);
+    s_connection_events = 0;
+
+#if FEATURE_HISTORY
+    // The phone queued the readings missed while away, and sends them once asked for history
+    if (!connected && s_connected) {
+        s_disconnected_time = time(NULL);
+    } else if (connected && !s_connected && time(NULL) > s_disconnected_time + HISTORY_GAP) {
+        s_history_has_gap = true;
+    }
+#endif
+
+    // Re-send capabilities on reconnect, even after a short drop that ended connected, since
+    // messages may have been lost. This triggers xDrip to send fresh data.
     if (connected) {
         send_capability_announcement();
     }
+    if (connected != s_connected) {
+        s_connected = connected;
+#if FEATURE_DISCONNECTED
+        update_displayed_connection();
+#endif
+#if FEATURE_DETAIL
+        update_displayed_detail();
+#endif
+    }
 }
 
+static SchedulerTask s_settle_task = {.callback = connection_settled_callback};
+
+static void bluetooth_callback(bool connected) {
+    // Act once the connection has been stable for CONNECTION_SETTLE_MS
+    s_connection_events++;
+    scheduler_schedule(&s_settle_task, CONNECTION_SETTLE_MS, CONNECTION_SETTLE_SLACK_MS);
+}
+
+#if FEATURE_LOOP
+static void battery_callback(BatteryChargeState charge) {
+    const bool battery_saver = charge.charge_percent <= BATTERY_SAVER_PERCENT && !charge.is_plugged;
+    if (battery_saver != s_battery_saver) {
+        s_battery_saver = battery_saver;
+        if (s_window && can_redraw()) {
+            update_displayed_xdrip_data();
+        }
+        update_capabilities();
+    }
+}
+#endif
+
+#if FEATURE_DETAIL || FEATURE_QUIET
+static void tap_callback(AccelAxisType axis, int32_t direction) {
+#if FEATURE_QUIET
+    wake_from_quiet_mode();
+#endif
+#if FEATURE_DETAIL
+    if (detail_is_visible()) {
+        detail_hide();
+        return;
+    }
+    DetailData data;
+    fill_detail_data(&data);
+    detail_show(&data);
+#endif
+}
+#endif
+
+#if FEATURE_DETAIL
+static void detail_visibility_callback(bool visible) {
+    // The extended fields are only wanted while the detail view is shown
+    update_capabilities();
+}
+#endif
+
 void init_test_mode_data(void) {
-#ifdef TEST_MODE
-    s_bg_timestamp = time(NULL) - TEST_MINUTES_AGO * 60;
-    safe_strncpy(s_bg_string, TEST_BG_STRING, sizeof(s_bg_string));
-    s_arrow_index = TEST_ARROW_INDEX;
-    safe_strncpy(s_delta_string, TEST_DELTA_STRING, sizeof(s_delta_string));
+#if defined(TEST_MODE) && TEST_SIMULATOR
+    simulator_start();
+#elif defined(TEST_MODE)
+    // Fed through the protocol core like a message from xDrip
+    const uint32_t timestamp = time(NULL) - TEST_MINUTES_AGO * 60;
+    const uint8_t arrow_index = TEST_ARROW_INDEX;
+    const XdripField fields[] = {
+        {XDRIP_KEY_BG_TIMESTAMP, XDRIP_TYPE_UINT, sizeof(timestamp), (const uint8_t *)&timestamp},
+        {XDRIP_KEY_BG_STRING, XDRIP_TYPE_STRING, sizeof(TEST_BG_STRING),
+         (const uint8_t *)TEST_BG_STRING},
+        {XDRIP_KEY_DELTA_STRING, XDRIP_TYPE_STRING, sizeof(TEST_DELTA_STRING),
+         (const uint8_t *)TEST_DELTA_STRING},
+        {XDRIP_KEY_ARROW_INDEX, XDRIP_TYPE_UINT, sizeof(arrow_index), &arrow_index},
+    };
+    xdrip_receive(fields, sizeof(fields) / sizeof(fields[0]), time(NULL), NULL);
 #endif
 }
 
 void init(void) {
-    app_message_register_inbox_received(new_xdrip_data_callback);
-    app_message_open(/*in*/ 256, /*out*/ 64);
-
-    tick_timer_service_subscribe(MINUTE_UNIT, minute_tick_callback);
+    settings_init();
+#if FEATURE_HISTORY
+    journal_init();
+#endif
+#if FEATURE_AGP
+    agp_init();
+#endif
+#if FEATURE_DAILY
+    daily_init();
+#endif
+    xdrip_init(&(XdripHandlers){
+        .model_changed = model_changed_callback,
+        .settings = settings_callback,
+#if FEATURE_HISTORY
+        .history_batch = history_batch_callback,
+#endif
+#if LOG_LEVEL > LOG_LEVEL_NONE
+        .debug_dump = send_debug_log,
+#endif
+        .send = send_fields,
+    });
+    app_message_register_inbox_received(inbox_received_callback);
+    app_message_register_inbox_dropped(inbox_dropped_callback);
+    app_message_open(INBOX_SIZE, OUTBOX_SIZE);
+
+    scheduler_init(MINUTE_UNIT, tick_callback);
+#if FEATURE_QUIET
+    const time_t now = time(NULL);
+    quiet_update(localtime(&now));
+    apply_quiet_mode();
+#endif
 
+    s_connected = connection_service_peek_pebble_app_connection();
     connection_service_subscribe(
         (ConnectionHandlers){.pebble_app_connection_handler = bluetooth_callback});
 
+#if FEATURE_LOOP
+    battery_callback(battery_state_service_peek());
+    battery_state_service_subscribe(battery_callback);
+#endif
+
+#if FEATURE_DETAIL
+    detail_init(detail_visibility_callback);
+#endif
+#if FEATURE_DETAIL || FEATURE_QUIET
+    accel_tap_service_subscribe(tap_callback);
+#endif
+
     s_window = window_create();
     window_set_window_handlers(s_window,
                                (WindowHandlers){.load = window_load, .unload = window_unload});
@@ -273,14 +963,26 @@ void init(void) {
 
 void deinit(void) {
     app_message_deregister_callbacks();
-    tick_timer_service_unsubscribe();
+#if FEATURE_AGP
+    agp_deinit();
+#endif
+#if defined(TEST_MODE) && TEST_SIMULATOR
+    simulator_stop();
+#endif
+    scheduler_deinit();
     connection_service_unsubscribe();
+#if FEATURE_LOOP
+    battery_state_service_unsubscribe();
+#endif
+#if FEATURE_DETAIL || FEATURE_QUIET
+    accel_tap_service_unsubscribe();
+#endif
     window_destroy(s_window);
 }
 
 int main(void) {
-    init_test_mode_data();
     init();
+    init_test_mode_data();
     app_event_loop();
     deinit();
 }
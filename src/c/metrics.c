@@ -0,0 +1,262 @@
+#include "metrics.h"
+#include "log.h"
+
+uint32_t metrics_now_ms(void) {
+    time_t seconds;
+    uint16_t ms;
+    time_ms(&seconds, &ms);
+    return (uint32_t)seconds * 1000 + ms;
+}
+
+#if FEATURE_METRICS
+
+static Layer *s_begin_layer = NULL;
+static Layer *s_end_layer = NULL;
+
+static uint32_t s_frame_start_ms = 0;
+static uint32_t s_frame_last_ms = 0;
+static uint32_t s_frame_max_ms = 0;
+static uint32_t s_frame_total_ms = 0;
+static uint32_t s_frame_count = 0;
+
+static uint32_t s_graph_total_ms = 0;
+static uint32_t s_graph_max_ms = 0;
+static uint32_t s_graph_count = 0;
+
+static uint32_t s_received_count = 0;
+static uint32_t s_received_bytes = 0;
+static uint32_t s_rejected_count = 0;
+static uint32_t s_sent_count = 0;
+static uint32_t s_sent_bytes = 0;
+static uint32_t s_dropped_count = 0;
+static uint32_t s_coalesced_count = 0; // Messages whose redraw merged into that of the previous one
+static uint32_t s_handler_total_ms = 0;
+static uint32_t s_handler_max_ms = 0;
+static bool s_is_frame_pending = false; // Set by a message until the next frame is drawn
+
+// Received bytes per capability set. When more sets turn up, the last slot is reused.
+#define CAPABILITY_SETS 4
+typedef struct {
+    uint32_t capabilities;
+    uint32_t bytes;
+    uint32_t seconds; // Spent with this set, until it was last left
+} CapabilitySet;
+static CapabilitySet s_capability_sets[CAPABILITY_SETS];
+static uint8_t s_capability_set = 0;         // Index of the current set
+static uint32_t s_capability_set_since = 0; // Seconds since epoch
+
+static uint32_t s_tick_wakeups = 0;  // Since the last report
+static uint32_t s_timer_wakeups = 0; // Since the last report
+
+static uint32_t s_vibe_pulses = 0;
+
+static uint32_t s_flash_writes = 0;
+static uint32_t s_flash_bytes = 0;
+static uint32_t s_flash_naive_bytes = 0;
+
+static uint32_t s_connection_settled_count = 0;
+static uint32_t s_connection_suppressed_count = 0;
+
+static size_t s_heap_peak_used = 0;
+static size_t s_heap_min_free = SIZE_MAX;
+static size_t s_heap_steady_state = 0; // Heap used after startup, 0 until marked
+static bool s_is_view_allocated = false;
+
+static uint32_t s_alloc_failure_count = 0;
+static uint32_t s_first_alloc_failure_time = 0; // Seconds since epoch, 0 if none
+static uint8_t s_first_alloc_failure_site = 0;
+static size_t s_first_alloc_failure_free = 0; // Heap bytes free at the first failure
+
+
+static void frame_begin_update_proc(Layer *layer, GContext *ctx) {
+    s_frame_start_ms = metrics_now_ms();
+    s_is_frame_pending = false;
+}
+
+static void frame_end_update_proc(Layer *layer, GContext *ctx) {
+    s_frame_last_ms = metrics_now_ms() - s_frame_start_ms;
+    if (s_frame_last_ms > s_frame_max_ms) {
+        s_frame_max_ms = s_frame_last_ms;
+    }
+    s_frame_total_ms += s_frame_last_ms;
+    s_frame_count++;
+}
+
+static Layer *marker_layer_create(Layer *root_layer, LayerUpdateProc update_proc) {
+    Layer *layer = layer_create(layer_get_bounds(root_layer));
+    layer_set_update_proc(layer, update_proc);
+    layer_add_child(root_layer, layer);
+    return layer;
+}
+
+void metrics_attach_frame_begin(Layer *root_layer) {
+    s_begin_layer = marker_layer_create(root_layer, frame_begin_update_proc);
+}
+
+void metrics_attach_frame_end(Layer *root_layer) {
+    s_end_layer = marker_layer_create(root_layer, frame_end_update_proc);
+}
+
+void metrics_detach(void) {
+    layer_destroy(s_begin_layer);
+    layer_destroy(s_end_layer);
+    s_begin_layer = NULL;
+    s_end_layer = NULL;
+}
+
+void metrics_mark_steady_state(void) {
+    metrics_sample_heap();
+    s_heap_steady_state = heap_bytes_used();
+}
+
+void metrics_set_view_allocated(bool is_allocated) { s_is_view_allocated = is_allocated; }
+
+void metrics_sample_heap(void) {
+    const size_t used = heap_bytes_used();
+    const size_t free = heap_bytes_free();
+    if (used > s_heap_peak_used) {
+        s_heap_peak_used = used;
+    }
+    if (free < s_heap_min_free) {
+        s_heap_min_free = free;
+    }
+}
+
+void metrics_record_alloc_failure(AllocSite site) {
+    const size_t free = heap_bytes_free();
+    if (s_alloc_failure_count == 0) {
+        s_first_alloc_failure_time = time(NULL);
+        s_first_alloc_failure_site = site;
+        s_first_alloc_failure_free = free;
+    }
+    s_alloc_failure_count++;
+    LOG_EVENT(LOG_LEVEL_ERROR, LOG_EVENT_ALLOC_FAILED, site, free, heap_bytes_used());
+}
+
+void metrics_record_graph_frame(uint32_t ms) {
+    if (ms > s_graph_max_ms) {
+        s_graph_max_ms = ms;
+    }
+    s_graph_total_ms += ms;
+    s_graph_count++;
+}
+
+void metrics_record_message_received(uint32_t bytes, bool rejected, uint32_t handler_ms) {
+    s_received_count++;
+    s_received_bytes += bytes;
+    s_capability_sets[s_capability_set].bytes += bytes;
+    if (rejected) {
+        s_rejected_count++;
+    } else if (s_is_frame_pending) {
+        s_coalesced_count++;
+    } else {
+        s_is_frame_pending = s_begin_layer != NULL;
+    }
+    s_handler_total_ms += handler_ms;
+    if (handler_ms > s_handler_max_ms) {
+        s_handler_max_ms = handler_ms;
+    }
+}
+
+void metrics_record_message_dropped(void) { s_dropped_count++; }
+
+void metrics_record_message_sent(uint32_t bytes) {
+    s_sent_count++;
+    s_sent_bytes += bytes;
+}
+
+void metrics_record_vibes(uint8_t pulses) { s_vibe_pulses += pulses; }
+
+void metrics_record_capabilities(uint32_t capabilities) {
+    const uint32_t now = time(NULL);
+    CapabilitySet *current = &s_capability_sets[s_capability_set];
+    if (capabilities == current->capabilities) {
+        return;
+    }
+    if (s_capability_set_since > 0) {
+        current->seconds += now - s_capability_set_since;
+    }
+    s_capability_set_since = now;
+
+    uint8_t index = 0;
+    while (index < CAPABILITY_SETS - 1 && s_capability_sets[index].capabilities != capabilities &&
+           s_capability_sets[index].capabilities != 0) {
+        index++;
+    }
+    if (s_capability_sets[index].capabilities != capabilities) {
+        s_capability_sets[index] = (CapabilitySet){.capabilities = capabilities};
+    }
+    s_capability_set = index;
+}
+
+void metrics_record_wakeup(bool is_tick) {
+    if (is_tick) {
+        s_tick_wakeups++;
+    } else {
+        s_timer_wakeups++;
+    }
+}
+
+void metrics_record_flash_write(uint32_t bytes) {
+    s_flash_writes++;
+    s_flash_bytes += bytes;
+}
+
+void metrics_record_flash_naive(uint32_t bytes) { s_flash_naive_bytes += bytes; }
+
+void metrics_record_connection_settled(uint32_t suppressed_events) {
+    s_connection_settled_count++;
+    s_connection_suppressed_count += suppressed_events;
+}
+
+void metrics_report(void) {
+    metrics_sample_heap();
+    const size_t heap_used = heap_bytes_used();
+    if (s_heap_steady_state > 0 && !s_is_view_allocated && heap_used > s_heap_steady_state) {
+        LOG_EVENT(LOG_LEVEL_ERROR, LOG_EVENT_HEAP_GROWTH, 0, heap_used - s_heap_steady_state,
+                  s_heap_steady_state);
+    }
+
+    const uint32_t frame_avg_ms = s_frame_count ? s_frame_total_ms / s_frame_count : 0;
+    LOG(LOG_LEVEL_DEBUG, "Frames: %d, last %d ms, avg %d ms, max %d ms", (int)s_frame_count,
+        (int)s_frame_last_ms, (int)frame_avg_ms, (int)s_frame_max_ms);
+    if (s_graph_count > 0) {
+        LOG(LOG_LEVEL_DEBUG, "Graph: avg %d ms, max %d ms", (int)(s_graph_total_ms / s_graph_count),
+            (int)s_graph_max_ms);
+    }
+    LOG(LOG_LEVEL_DEBUG, "Messages: in %d (%d B, %d rejected), out %d (%d B)",
+        (int)s_received_count, (int)s_received_bytes, (int)s_rejected_count, (int)s_sent_count,
+        (int)s_sent_bytes);
+    LOG(LOG_LEVEL_DEBUG, "Inbox: %d dropped, %d coalesced, handlers %d ms, max %d ms",
+        (int)s_dropped_count, (int)s_coalesced_count, (int)s_handler_total_ms,
+        (int)s_handler_max_ms);
+    for (uint8_t i = 0; i < CAPABILITY_SETS; i++) {
+        const CapabilitySet *set = &s_capability_sets[i];
+        uint32_t seconds = set->seconds;
+        if (i == s_capability_set && s_capability_set_since > 0) {
+            seconds += time(NULL) - s_capability_set_since;
+        }
+        if (seconds > 0) {
+            LOG(LOG_LEVEL_DEBUG, "Capabilities 0x%x: %d B/h over %d min", (int)set->capabilities,
+                (int)((uint64_t)set->bytes * 3600 / seconds), (int)(seconds / 60));
+        }
+    }
+    LOG(LOG_LEVEL_DEBUG, "Wakeups since last report: %d ticks, %d timers", (int)s_tick_wakeups,
+        (int)s_timer_wakeups);
+    s_tick_wakeups = 0;
+    s_timer_wakeups = 0;
+    LOG(LOG_LEVEL_DEBUG, "Vibes: %d pulses", (int)s_vibe_pulses);
+    LOG(LOG_LEVEL_DEBUG, "Flash: %d writes, %d B, %d B rewriting the whole history",
+        (int)s_flash_writes, (int)s_flash_bytes, (int)s_flash_naive_bytes);
+    LOG(LOG_LEVEL_DEBUG, "Connection: settled %d times, %d flaps suppressed",
+        (int)s_connection_settled_count, (int)s_connection_suppressed_count);
+    LOG(LOG_LEVEL_DEBUG, "Heap: used %d B, peak %d B, min free %d B", (int)heap_used,
+        (int)s_heap_peak_used, (int)s_heap_min_free);
+    if (s_alloc_failure_count > 0) {
+        LOG(LOG_LEVEL_DEBUG, "Alloc failures: %d, first at %d from site %d with %d B free",
+            (int)s_alloc_failure_count, (int)s_first_alloc_failure_time,
+            (int)s_first_alloc_failure_site, (int)s_first_alloc_failure_free);
+    }
+}
+
+#endif
@@ -0,0 +1,106 @@
+// Lightweight instrumentation of frame time and heap usage, logged once an hour in debug builds.
+//
+// Only builds with FEATURE_METRICS (wscript: --enable metrics) have it. Elsewhere the calls below
+// compile to nothing, so release builds draw no marker layers and keep no counters.
+
+#pragma once
+
+#include "config.h"
+#include "log.h"
+#include <pebble.h>
+
+// Milliseconds on a free-running clock, for timing code. Also in builds without metrics.
+uint32_t metrics_now_ms(void);
+
+// Allocations the face survives the failure of. Keep in sync with ALLOC_SITES in
+// tools/decode_log.py.
+typedef enum {
+    ALLOC_SITE_DETAIL_WINDOW = 1,
+    ALLOC_SITE_DETAIL_VIEW = 2,
+    ALLOC_SITE_GRAPH_CACHE = 3,
+} AllocSite;
+
+#if FEATURE_METRICS
+
+// Adds marker layers that time each frame. Call begin before adding any other layer to the root
+// layer, and end after adding the last one, so the markers are drawn first and last.
+void metrics_attach_frame_begin(Layer *root_layer);
+void metrics_attach_frame_end(Layer *root_layer);
+void metrics_detach(void);
+
+// Records heap usage once all long-lived objects are allocated. From then on the face should not
+// allocate, and metrics_report() logs an error event if the heap has grown.
+void metrics_mark_steady_state(void);
+
+// Marks the heap the detail view allocates while it is shown, which the heap growth check expects.
+// The check is skipped meanwhile, and catches a view that leaks once it is hidden again.
+void metrics_set_view_allocated(bool is_allocated);
+
+void metrics_sample_heap(void);
+
+// Records a failed allocation. The heap is sampled at the first one, which is usually the
+// earliest sign of fragmentation after days of uptime.
+void metrics_record_alloc_failure(AllocSite site);
+
+// Records the time spent drawing the graph in one frame.
+void metrics_record_graph_frame(uint32_t ms);
+
+// Records AppMessage traffic, so protocol changes can be compared by messages and bytes per hour.
+// `bytes` is the dictionary size. Rejected messages are malformed ones that were not applied.
+// `handler_ms` is the time spent applying the message, not counting the redraw it causes.
+void metrics_record_message_received(uint32_t bytes, bool rejected, uint32_t handler_ms);
+void metrics_record_message_sent(uint32_t bytes);
+
+// Records a message the system dropped before the face saw it, e.g. because the inbox was still
+// busy with the previous one. The phone gets a NACK and may retry.
+void metrics_record_message_dropped(void);
+
+// Records vibration pulses, for the energy model in tools/energy_model.py.
+void metrics_record_vibes(uint8_t pulses);
+
+// Records a capability announcement. Received bytes are counted per capability set, and reported
+// per hour spent with that set.
+void metrics_record_capabilities(uint32_t capabilities);
+
+// Records a wakeup by the scheduler, from a clock tick or its timer. Reported per hour, as the
+// main measure of how often the face keeps the CPU awake.
+void metrics_record_wakeup(bool is_tick);
+
+// Records bytes written to persistent storage, and what rewriting the whole history on every
+// reading would have written instead, to compare with the journal, see journal.h.
+void metrics_record_flash_write(uint32_t bytes);
+void metrics_record_flash_naive(uint32_t bytes);
+
+// Records a settled phone connection, and the connection events that were absorbed while it
+// settled.
+void metrics_record_connection_settled(uint32_t suppressed_events);
+
+void metrics_report(void);
+
+#else
+
+static inline void metrics_attach_frame_begin(Layer *root_layer) {}
+static inline void metrics_attach_frame_end(Layer *root_layer) {}
+static inline void metrics_detach(void) {}
+static inline void metrics_mark_steady_state(void) {}
+static inline void metrics_set_view_allocated(bool is_allocated) {}
+static inline void metrics_sample_heap(void) {}
+static inline void metrics_record_graph_frame(uint32_t ms) {}
+static inline void metrics_record_message_received(uint32_t bytes, bool rejected,
+                                                   uint32_t handler_ms) {}
+static inline void metrics_record_message_sent(uint32_t bytes) {}
+static inline void metrics_record_message_dropped(void) {}
+static inline void metrics_record_vibes(uint8_t pulses) {}
+static inline void metrics_record_capabilities(uint32_t capabilities) {}
+static inline void metrics_record_wakeup(bool is_tick) {}
+static inline void metrics_record_flash_write(uint32_t bytes) {}
+static inline void metrics_record_flash_naive(uint32_t bytes) {}
+static inline void metrics_record_connection_settled(uint32_t suppressed_events) {}
+static inline void metrics_report(void) {}
+
+// Failures are still logged, at the log level of the build
+static inline void metrics_record_alloc_failure(AllocSite site) {
+    LOG_EVENT(LOG_LEVEL_ERROR, LOG_EVENT_ALLOC_FAILED, site, heap_bytes_free(), heap_bytes_used());
+}
+
+#endif
@@ -0,0 +1,83 @@
+#include "quiet.h"
+#include "config.h"
+#include "log.h"
+
+static bool s_in_period = false; // Quiet Time or the scheduled hours are on
+static bool s_active = false;    // And no tap or alert woke the face
+static uint32_t s_awake_until = 0; // Seconds since epoch
+
+// Counters for the current quiet period, taps or not
+static uint32_t s_active_since = 0;  // Seconds since epoch, while active
+static uint32_t s_active_seconds = 0; // Before s_active_since
+static uint16_t s_ticks = 0;
+static uint16_t s_checks = 0;
+static uint16_t s_leaves = 0; // Taps, alerts and the end of the period
+static uint16_t s_deferred_redraws = 0;
+
+static bool is_scheduled(const struct tm *tick_time) {
+    const int hour = tick_time->tm_hour;
+    if (QUIET_START_HOUR <= QUIET_END_HOUR) {
+        return hour >= QUIET_START_HOUR && hour < QUIET_END_HOUR;
+    }
+    return hour >= QUIET_START_HOUR || hour < QUIET_END_HOUR; // Over midnight
+}
+
+// Logs what the period saved. Without the mode, the face would have woken and redrawn every
+// minute, and redrawn for every message. With it, it woke for the hourly ticks and the Quiet Time
+// checks, and redrew once each time it left the mode.
+static void log_period(void) {
+    const int32_t minutes = s_active_seconds / 60;
+    const int32_t saved_wakeups = minutes - s_ticks - s_checks;
+    const int32_t saved_redraws = minutes + s_deferred_redraws - s_ticks - s_leaves;
+    LOG_EVENT(LOG_LEVEL_INFO, LOG_EVENT_QUIET_ENDED, minutes / 60,
+              saved_wakeups > 0 ? saved_wakeups : 0, saved_redraws > 0 ? saved_redraws : 0);
+}
+
+bool quiet_update(const struct tm *tick_time) {
+    const uint32_t now = time(NULL);
+    const bool in_period = quiet_time_is_active() || is_scheduled(tick_time);
+    const bool active = in_period && now >= s_awake_until;
+
+    if (in_period && !s_in_period) {
+        s_active_seconds = 0;
+        s_ticks = s_checks = s_leaves = s_deferred_redraws = 0;
+    }
+    if (active && !s_active) {
+        s_active_since = now;
+    } else if (!active && s_active) {
+        s_active_seconds += now - s_active_since;
+        s_leaves++;
+    }
+    if (!in_period && s_in_period) {
+        log_period();
+    }
+    s_in_period = in_period;
+
+    if (active == s_active) {
+        return false;
+    }
+    s_active = active;
+    return true;
+}
+
+bool quiet_is_active(void) { return s_active; }
+
+void quiet_wake(void) {
+    const time_t now = time(NULL);
+    s_awake_until = now + QUIET_WAKE_SECONDS;
+    quiet_update(localtime(&now));
+}
+
+void quiet_record_tick(void) {
+    if (s_active) {
+        s_ticks++;
+    }
+}
+
+void quiet_record_check(void) {
+    if (s_active) {
+        s_checks++;
+    }
+}
+
+void quiet_record_deferred_redraw(void) { s_deferred_redraws++; }
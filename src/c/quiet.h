@@ -0,0 +1,30 @@
+// Reduced update mode for the night, when the watch's Quiet Time is on or during the
+// QUIET_START_HOUR to QUIET_END_HOUR schedule in config.h.
+//
+// In this mode the face ticks once an hour instead of every minute, and redraws wait until a wrist
+// tap or the end of the mode. Alerts are still evaluated for every reading. A tap wakes the face
+// for QUIET_WAKE_SECONDS, after which it goes back to the reduced mode, in the same quiet period:
+// the period, and the summary of what it saved that is logged at its end, last until Quiet Time or
+// the scheduled hours end.
+//
+// The SDK doesn't report the end of Quiet Time, so while it is on, the caller also re-evaluates
+// the mode whenever a reading wakes the face, and on a timer while none do, without redrawing.
+
+#pragma once
+
+#include <pebble.h>
+
+// Re-evaluates the mode, on every tick, reading and Quiet Time check. Returns true if the mode
+// changed, in which case the caller must resubscribe its tick handler and, when leaving, redraw.
+bool quiet_update(const struct tm *tick_time);
+
+bool quiet_is_active(void);
+
+// Leaves the mode for QUIET_WAKE_SECONDS, on a wrist tap or an alert.
+void quiet_wake(void);
+
+// Record the wakeups of the mode, before it is re-evaluated in them, and the redraws it deferred,
+// for the summary logged at the end of the period.
+void quiet_record_tick(void);
+void quiet_record_check(void); // A timer wakeup for the Quiet Time check
+void quiet_record_deferred_redraw(void);
@@ -0,0 +1,32 @@
+#include "readings.h"
+#include "agp.h"
+#include "config.h"
+#include "daily.h"
+#include "history.h"
+#include "journal.h"
+
+static void count(uint32_t timestamp, uint16_t mgdl) {
+#if FEATURE_AGP
+    agp_add(timestamp, mgdl);
+#endif
+#if FEATURE_DAILY
+    daily_add(timestamp, mgdl);
+#endif
+}
+
+bool readings_add(uint32_t timestamp, uint16_t mgdl, uint16_t smoothed_mgdl) {
+    if (!history_add(timestamp, mgdl, smoothed_mgdl)) {
+        return false;
+    }
+    journal_append();
+    count(timestamp, mgdl);
+    return true;
+}
+
+bool readings_insert(uint32_t timestamp, uint16_t mgdl, uint16_t smoothed_mgdl) {
+    if (!history_insert(timestamp, mgdl, smoothed_mgdl)) {
+        return false;
+    }
+    count(timestamp, mgdl);
+    return true;
+}
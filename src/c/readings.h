@@ -0,0 +1,17 @@
+// Where a reading goes once it arrives: the history, the journal, and the time-of-day profile and
+// daily archive if the build has them.
+//
+// Each reading is counted once. xDrip re-sends the latest reading after every announcement, which
+// after a restart is new to xdrip.h but already in the history the journal restored, and a
+// backfill may send readings the history has. Only readings the history accepts are counted.
+
+#pragma once
+
+#include <pebble.h>
+
+// Adds a new reading, see history_add(). Returns true if added.
+bool readings_add(uint32_t timestamp, uint16_t mgdl, uint16_t smoothed_mgdl);
+
+// Adds a backfilled reading, see history_insert(). Returns true if inserted. The caller requests
+// the compaction that persists them, once per batch, see journal_mark_dirty().
+bool readings_insert(uint32_t timestamp, uint16_t mgdl, uint16_t smoothed_mgdl);
@@ -0,0 +1,110 @@
+#include "scheduler.h"
+#include "metrics.h"
+
+static SchedulerTask *s_tasks = NULL; // Unordered
+static AppTimer *s_timer = NULL;
+static TickHandler s_tick_handler = NULL;
+
+// Deadlines are on a wrapping millisecond clock, so compare by difference
+static bool is_before(uint32_t a, uint32_t b) { return (int32_t)(a - b) < 0; }
+
+static void remove_task(SchedulerTask *task) {
+    for (SchedulerTask **link = &s_tasks; *link; link = &(*link)->next) {
+        if (*link == task) {
+            *link = task->next;
+            break;
+        }
+    }
+    task->next = NULL;
+    task->is_scheduled = false;
+}
+
+static void timer_callback(void *context);
+
+// Arms the timer for the first task that can't wait any longer, or cancels it if there are none.
+static void arm_timer(void) {
+    if (!s_tasks) {
+        if (s_timer) {
+            app_timer_cancel(s_timer);
+            s_timer = NULL;
+        }
+        return;
+    }
+
+    uint32_t wakeup_ms = s_tasks->deadline_ms + s_tasks->slack_ms;
+    for (SchedulerTask *task = s_tasks->next; task; task = task->next) {
+        if (is_before(task->deadline_ms + task->slack_ms, wakeup_ms)) {
+            wakeup_ms = task->deadline_ms + task->slack_ms;
+        }
+    }
+    const uint32_t now_ms = metrics_now_ms();
+    const uint32_t delay_ms = is_before(now_ms, wakeup_ms) ? wakeup_ms - now_ms : 0;
+    if (!s_timer || !app_timer_reschedule(s_timer, delay_ms)) {
+        s_timer = app_timer_register(delay_ms, timer_callback, NULL);
+    }
+}
+
+// Runs all tasks whose deadline has passed. Callbacks may schedule tasks, including their own.
+static void run_due_tasks(void) {
+    for (;;) {
+        const uint32_t now_ms = metrics_now_ms();
+        SchedulerTask *due = s_tasks;
+        while (due && is_before(now_ms, due->deadline_ms)) {
+            due = due->next;
+        }
+        if (!due) {
+            break;
+        }
+        remove_task(due);
+        due->callback(due->context);
+    }
+    arm_timer();
+}
+
+static void timer_callback(void *context) {
+    s_timer = NULL;
+    metrics_record_wakeup(/*is_tick*/ false);
+    run_due_tasks();
+}
+
+static void tick_callback(struct tm *tick_time, TimeUnits units_changed) {
+    metrics_record_wakeup(/*is_tick*/ true);
+    s_tick_handler(tick_time, units_changed);
+    run_due_tasks();
+}
+
+void scheduler_init(TimeUnits tick_units, TickHandler tick_handler) {
+    s_tick_handler = tick_handler;
+    tick_timer_service_subscribe(tick_units, tick_callback);
+}
+
+void scheduler_deinit(void) {
+    tick_timer_service_unsubscribe();
+    while (s_tasks) {
+        remove_task(s_tasks);
+    }
+    arm_timer();
+}
+
+void scheduler_set_tick_units(TimeUnits tick_units) {
+    tick_timer_service_subscribe(tick_units, tick_callback);
+}
+
+void scheduler_schedule(SchedulerTask *task, uint32_t delay_ms, uint32_t slack_ms) {
+    if (task->is_scheduled) {
+        remove_task(task);
+    }
+    task->deadline_ms = metrics_now_ms() + delay_ms;
+    task->slack_ms = slack_ms;
+    task->is_scheduled = true;
+    task->next = s_tasks;
+    s_tasks = task;
+    arm_timer();
+}
+
+void scheduler_cancel(SchedulerTask *task) {
+    if (task->is_scheduled) {
+        remove_task(task);
+        arm_timer();
+    }
+}
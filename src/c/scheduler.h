@@ -0,0 +1,35 @@
+// Single source of wakeups: the clock tick subscription and one app timer shared by all delayed
+// tasks.
+//
+// Each task has a deadline and a slack, the time it may run late. The timer is armed for the
+// earliest deadline plus slack of all tasks, and every wakeup, timer or tick, runs all tasks whose
+// deadline has passed. So tasks with overlapping windows run in one wakeup, and tasks due close to
+// a clock tick run in the tick's wakeup.
+
+#pragma once
+
+#include <pebble.h>
+
+typedef void (*SchedulerCallback)(void *context);
+
+// A delayed task. Owned by the client, usually a static, so scheduling never allocates. Only set
+// `callback` and `context`; the rest belongs to the scheduler.
+typedef struct SchedulerTask {
+    SchedulerCallback callback;
+    void *context;
+    uint32_t deadline_ms; // See metrics_now_ms()
+    uint32_t slack_ms;
+    bool is_scheduled;
+    struct SchedulerTask *next;
+} SchedulerTask;
+
+// Subscribes to clock ticks, which call `tick_handler` before running due tasks.
+void scheduler_init(TimeUnits tick_units, TickHandler tick_handler);
+void scheduler_deinit(void);
+
+void scheduler_set_tick_units(TimeUnits tick_units);
+
+// Runs `task` once, between `delay_ms` and `delay_ms + slack_ms` from now. Scheduling a task that
+// is already scheduled moves it.
+void scheduler_schedule(SchedulerTask *task, uint32_t delay_ms, uint32_t slack_ms);
+void scheduler_cancel(SchedulerTask *task);
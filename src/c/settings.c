@@ -0,0 +1,73 @@
+#include "settings.h"
+#include "config.h"
+#include "metrics.h"
+
+#define PERSIST_KEY_SETTINGS 1
+#define SETTINGS_SIZE 8
+
+static Settings s_settings = {
+    .unit = SETTINGS_UNIT_AUTO,
+    .target_low_mgdl = TARGET_LOW_MGDL,
+    .target_high_mgdl = TARGET_HIGH_MGDL,
+    .components = 0xFF,
+    .alerts = 0xFF,
+};
+
+static uint16_t read_uint16(const uint8_t *data) { return data[0] | (data[1] << 8); }
+
+static bool decode(const uint8_t *data, size_t length, Settings *settings) {
+    if (length != SETTINGS_SIZE || data[0] != SETTINGS_VERSION || data[1] > SETTINGS_UNIT_MMOL) {
+        return false;
+    }
+    *settings = (Settings){
+        .unit = data[1],
+        .target_low_mgdl = read_uint16(data + 2),
+        .target_high_mgdl = read_uint16(data + 4),
+        .components = data[6],
+        .alerts = data[7],
+    };
+    return settings->target_low_mgdl > 0 &&
+           settings->target_low_mgdl < settings->target_high_mgdl;
+}
+
+void settings_init(void) {
+    uint8_t data[SETTINGS_SIZE];
+    Settings settings;
+    if (persist_read_data(PERSIST_KEY_SETTINGS, data, sizeof(data)) == sizeof(data) &&
+        decode(data, sizeof(data), &settings)) {
+        s_settings = settings;
+    }
+}
+
+const Settings *settings_get(void) { return &s_settings; }
+
+int settings_receive(const uint8_t *data, size_t length) {
+    Settings settings;
+    if (!decode(data, length, &settings)) {
+        return -1;
+    }
+
+    int changes = 0;
+    if (settings.unit != s_settings.unit) {
+        changes |= SETTINGS_CHANGED_UNIT;
+    }
+    if (settings.target_low_mgdl != s_settings.target_low_mgdl ||
+        settings.target_high_mgdl != s_settings.target_high_mgdl) {
+        changes |= SETTINGS_CHANGED_TARGET;
+    }
+    if (settings.components != s_settings.components) {
+        changes |= SETTINGS_CHANGED_COMPONENTS;
+    }
+    if (settings.alerts != s_settings.alerts) {
+        changes |= SETTINGS_CHANGED_ALERTS;
+    }
+
+    // The phone re-sends unchanged settings, e.g. after every config page visit, which shouldn't
+    // wear the flash
+    if (changes) {
+        s_settings = settings;
+        persist_write_data(PERSIST_KEY_SETTINGS, data, length);
+        metrics_record_flash_write(length);
+    }
+    return changes;
+}
@@ -0,0 +1,63 @@
+// User settings: BG unit, target range, shown components and alerts.
+//
+// The phone, a config page or xDrip, sends all settings at once as one byte array
+// (XDRIP_KEY_SETTINGS). The array is persisted as is in one key, and decoded again at startup.
+// Layout, little endian:
+//
+//   uint8   version, SETTINGS_VERSION
+//   uint8   BG unit, SETTINGS_UNIT_*
+//   uint16  target low [mg/dL]
+//   uint16  target high [mg/dL]
+//   uint8   shown components, SETTINGS_SHOW_* bits
+//   uint8   alerts, SETTINGS_ALERT_* bits
+//
+// Unknown bits are ignored. Without settings, the face uses the defaults from config.h and shows
+// everything.
+
+#pragma once
+
+#include <pebble.h>
+
+#define SETTINGS_VERSION 1
+
+typedef enum {
+    SETTINGS_UNIT_AUTO = 0, // As xDrip sends it
+    SETTINGS_UNIT_MGDL = 1,
+    SETTINGS_UNIT_MMOL = 2,
+} SettingsUnit;
+
+// Shown components. The rest of the face is always shown.
+#define SETTINGS_SHOW_DELTA (1 << 0)
+#define SETTINGS_SHOW_TIME_AGO (1 << 1)
+#define SETTINGS_SHOW_DATE (1 << 2)
+#define SETTINGS_SHOW_LOOP (1 << 3)  // If the build has loop fields
+#define SETTINGS_SHOW_GRAPH (1 << 4) // If the build has a graph
+#define SETTINGS_SHOW_STATS (1 << 5) // If the build has a statistics row
+
+// Alerts, if the build has alerts
+#define SETTINGS_ALERT_LOW (1 << 0)
+#define SETTINGS_ALERT_HIGH (1 << 1)
+
+typedef struct {
+    SettingsUnit unit;
+    uint16_t target_low_mgdl;
+    uint16_t target_high_mgdl;
+    uint8_t components; // SETTINGS_SHOW_* bits
+    uint8_t alerts;     // SETTINGS_ALERT_* bits
+} Settings;
+
+// What settings_receive() changed, so only the affected parts of the face are updated
+#define SETTINGS_CHANGED_UNIT (1 << 0)
+#define SETTINGS_CHANGED_TARGET (1 << 1)
+#define SETTINGS_CHANGED_COMPONENTS (1 << 2)
+#define SETTINGS_CHANGED_ALERTS (1 << 3)
+
+// Loads the persisted settings, or the defaults.
+void settings_init(void);
+
+const Settings *settings_get(void);
+
+// Applies and persists settings from the phone. A malformed array (wrong version or length, or an
+// empty target range) is rejected and changes nothing. Returns the SETTINGS_CHANGED_* bits, or -1
+// if rejected.
+int settings_receive(const uint8_t *data, size_t length);
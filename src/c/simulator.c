@@ -0,0 +1,174 @@
+#include "simulator.h"
+#include "test_mode.h"
+
+#ifdef TEST_MODE
+
+#include "scheduler.h"
+#include "units.h"
+#include "xdrip.h"
+
+// Glucose and its pools are kept in 1/16 mg/dL
+#define FRACTION_BITS 4
+#define RESTING_MGDL 120
+#define MIN_MGDL 40
+#define MAX_MGDL 400
+
+// Chances per simulated minute, as 1 in N
+#define MEAL_CHANCE 400  // About 3.6 a day
+#define HYPO_CHANCE 2000 // About every 1.4 days
+// Chance per reading
+#define GAP_CHANCE 100
+
+#define ISF_MGDL_PER_U 40    // For the IOB string
+#define CSF_MGDL_PER_GRAM 4  // For the COB string
+#define CARB_TIME_MINUTES 20 // Time constants of absorption and insulin action
+#define INSULIN_TIME_MINUTES 60
+
+static uint32_t s_random;
+static uint32_t s_time;   // Of the next reading
+static int32_t s_glucose; // Modelled blood glucose
+static int32_t s_drift;   // Per minute
+static int32_t s_carbs;   // Still to be absorbed
+static int32_t s_insulin; // Still to act
+static uint16_t s_last_mgdl = 0;
+static uint32_t s_last_time = 0;
+static uint8_t s_gap = 0; // Readings still to drop
+
+// xorshift32, deterministic for a seed
+static uint32_t next_random(void) {
+    s_random ^= s_random << 13;
+    s_random ^= s_random >> 17;
+    s_random ^= s_random << 5;
+    return s_random;
+}
+
+// Uniform in [low, high]
+static int32_t random_between(int32_t low, int32_t high) {
+    return low + (int32_t)(next_random() % (uint32_t)(high - low + 1));
+}
+
+static bool chance(uint32_t one_in) { return next_random() % one_in == 0; }
+
+static void step_minute(void) {
+    if (chance(MEAL_CHANCE)) {
+        const int32_t rise = random_between(40, 160) << FRACTION_BITS;
+        s_carbs += rise;
+        s_insulin += rise * 2 / 3; // Under-bolused, so meals still show as spikes
+    }
+    if (chance(HYPO_CHANCE)) {
+        s_insulin += random_between(60, 120) << FRACTION_BITS;
+    }
+
+    const int32_t absorbed = s_carbs / CARB_TIME_MINUTES;
+    const int32_t acted = s_insulin / INSULIN_TIME_MINUTES;
+    s_carbs -= absorbed;
+    s_insulin -= acted;
+
+    s_drift += random_between(-1, 1);
+    s_drift -= s_drift / 16;
+    s_glucose += absorbed - acted + s_drift + ((RESTING_MGDL << FRACTION_BITS) - s_glucose) / 60;
+    if (s_glucose < (MIN_MGDL - 10) << FRACTION_BITS) {
+        s_glucose = (MIN_MGDL - 10) << FRACTION_BITS;
+    } else if (s_glucose > (MAX_MGDL + 10) << FRACTION_BITS) {
+        s_glucose = (MAX_MGDL + 10) << FRACTION_BITS;
+    }
+}
+
+// As xDrip computes it, from the slope since the last reading [1 double up .. 7 double down]
+static uint8_t arrow_index(int32_t delta, uint32_t seconds) {
+    const int32_t slope = delta * 600 / (int32_t)seconds; // [0.1 mg/dL per minute]
+    if (slope >= 30) {
+        return 1;
+    } else if (slope >= 20) {
+        return 2;
+    } else if (slope >= 10) {
+        return 3;
+    } else if (slope > -10) {
+        return 4;
+    } else if (slope > -20) {
+        return 5;
+    } else if (slope > -30) {
+        return 6;
+    }
+    return 7;
+}
+
+static void send_reading(void) {
+    int32_t mgdl = (s_glucose >> FRACTION_BITS) + random_between(-3, 3);
+    mgdl = mgdl < MIN_MGDL ? MIN_MGDL : mgdl > MAX_MGDL ? MAX_MGDL : mgdl;
+
+    char bg[8];
+    bg_format(bg, sizeof(bg), mgdl, TEST_SIM_MMOL);
+    char delta_mgdl[8];
+    const int32_t delta = s_last_time ? mgdl - s_last_mgdl : 0;
+    snprintf(delta_mgdl, sizeof(delta_mgdl), "%s%d", delta < 0 ? "-" : "+",
+             (int)(delta < 0 ? -delta : delta));
+    char delta_string[8];
+    bg_convert_delta(delta_string, sizeof(delta_string), delta_mgdl, TEST_SIM_MMOL);
+    const uint8_t arrow = s_last_time ? arrow_index(delta, s_time - s_last_time) : 0;
+
+    const int32_t iob = (s_insulin >> FRACTION_BITS) * 100 / ISF_MGDL_PER_U; // [0.01 U]
+    char iob_string[8];
+    snprintf(iob_string, sizeof(iob_string), "%d.%02dU", (int)(iob / 100), (int)(iob % 100));
+    char cob_string[8];
+    snprintf(cob_string, sizeof(cob_string), "%dg",
+             (int)((s_carbs >> FRACTION_BITS) / CSF_MGDL_PER_GRAM));
+
+    const XdripField fields[] = {
+        {XDRIP_KEY_BG_TIMESTAMP, XDRIP_TYPE_UINT, sizeof(s_time), (const uint8_t *)&s_time},
+        {XDRIP_KEY_BG_STRING, XDRIP_TYPE_STRING, strlen(bg) + 1, (const uint8_t *)bg},
+        {XDRIP_KEY_DELTA_STRING, XDRIP_TYPE_STRING, strlen(delta_string) + 1,
+         (const uint8_t *)delta_string},
+        {XDRIP_KEY_ARROW_INDEX, XDRIP_TYPE_UINT, sizeof(arrow), &arrow},
+        {XDRIP_KEY_IOB_STRING, XDRIP_TYPE_STRING, strlen(iob_string) + 1,
+         (const uint8_t *)iob_string},
+        {XDRIP_KEY_COB_STRING, XDRIP_TYPE_STRING, strlen(cob_string) + 1,
+         (const uint8_t *)cob_string},
+    };
+    xdrip_receive(fields, sizeof(fields) / sizeof(fields[0]), time(NULL), NULL);
+    s_last_mgdl = mgdl;
+    s_last_time = s_time;
+}
+
+static void reading_callback(void *context);
+static SchedulerTask s_task = {.callback = reading_callback};
+
+// Schedules the next reading: sped up while replaying the past, then when it is due
+static void schedule_next(void) {
+    const uint32_t now = time(NULL);
+    const uint32_t delay_ms = (s_time <= now) ? TEST_SIM_CADENCE_SECONDS * 1000 / TEST_SIM_SPEEDUP
+                                              : (s_time - now) * 1000;
+    scheduler_schedule(&s_task, delay_ms, 0);
+}
+
+static void reading_callback(void *context) {
+    for (uint16_t minute = 0; minute < TEST_SIM_CADENCE_SECONDS / 60; minute++) {
+        step_minute();
+    }
+    if (s_gap > 0) {
+        s_gap--;
+    } else if (chance(GAP_CHANCE)) {
+        s_gap = random_between(1, 11);
+    } else {
+        send_reading();
+    }
+    s_time += TEST_SIM_CADENCE_SECONDS;
+    schedule_next();
+}
+
+void simulator_start(void) {
+    s_random = TEST_SIM_SEED ? TEST_SIM_SEED : 1; // xorshift gets stuck at 0
+    s_glucose = RESTING_MGDL << FRACTION_BITS;
+    s_drift = 0;
+    s_carbs = 0;
+    s_insulin = 0;
+    s_last_time = 0;
+    s_gap = 0;
+    s_time = time(NULL) - TEST_SIM_HOURS * 60 * 60;
+    s_time -= s_time % TEST_SIM_CADENCE_SECONDS;
+    schedule_next();
+}
+
+void simulator_stop(void) { scheduler_cancel(&s_task); }
+
+#endif
@@ -0,0 +1,18 @@
+// Synthetic CGM readings for test mode, to run the face through hours of data in the emulator.
+//
+// A seeded generator models glucose as a damped random walk, pulled towards 120 mg/dL, with meals
+// that spike it and are mostly covered by insulin, and now and then an insulin overdose that ends
+// in a hypo. Sensor noise is added to each reading, and runs of readings are dropped as signal
+// gaps. The same seed always gives the same readings.
+//
+// The readings are formatted like xDrip's messages and fed through xdrip_receive(), so they take
+// the same path as real ones. Since the rest of the face reads the real clock, simulated time can't
+// run ahead of it: the generator starts TEST_SIM_HOURS in the past, replays them TEST_SIM_SPEEDUP
+// times faster, and then keeps going at the real cadence. See test_mode.h for the settings.
+
+#pragma once
+
+#include <pebble.h>
+
+void simulator_start(void);
+void simulator_stop(void);
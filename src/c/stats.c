@@ -0,0 +1,37 @@
+#include "stats.h"
+#include "config.h"
+#include "history.h"
+#include "settings.h"
+
+void stats_compute(Stats *stats, uint32_t since) {
+    uint32_t sum = 0;
+    uint16_t in_range = 0;
+    const uint16_t low = settings_get()->target_low_mgdl;
+    const uint16_t high = settings_get()->target_high_mgdl;
+    *stats = (Stats){.min_mgdl = UINT16_MAX};
+
+    for (uint16_t age = 0; age < history_count(); age++) {
+        const Reading *reading = history_get(age);
+        if (reading->timestamp < since) {
+            break;
+        }
+        stats->count++;
+        sum += reading->mgdl;
+        if (reading->mgdl < stats->min_mgdl) {
+            stats->min_mgdl = reading->mgdl;
+        }
+        if (reading->mgdl > stats->max_mgdl) {
+            stats->max_mgdl = reading->mgdl;
+        }
+        if (reading->mgdl >= low && reading->mgdl <= high) {
+            in_range++;
+        }
+    }
+
+    if (stats->count == 0) {
+        stats->min_mgdl = 0;
+        return;
+    }
+    stats->mean_mgdl = (sum + stats->count / 2) / stats->count;
+    stats->in_range_percent = (in_range * 100 + stats->count / 2) / stats->count;
+}
@@ -0,0 +1,16 @@
+// Summary statistics over the reading history.
+
+#pragma once
+
+#include <pebble.h>
+
+typedef struct {
+    uint16_t count;
+    uint16_t mean_mgdl;
+    uint16_t min_mgdl;
+    uint16_t max_mgdl;
+    uint8_t in_range_percent; // Share of readings within the target range
+} Stats;
+
+// Computes statistics over readings newer than `since` [seconds since epoch].
+void stats_compute(Stats *stats, uint32_t since);
@@ -3,7 +3,27 @@
 
 #pragma once
 
-// #define TEST_MODE // Uncomment to enable test mode
+// #define TEST_MODE // Uncomment to enable test mode, or configure with --test-mode
+
+// Test mode reports metrics every minute instead of every hour, for short emulator runs
+#ifdef TEST_MODE
+#define METRICS_REPORT_EVERY_MINUTE 1
+#else
+#define METRICS_REPORT_EVERY_MINUTE 0
+#endif
+
+// Generated readings, see simulator.h. 0 shows the single fixed reading below instead. Off in
+// stress builds (--stress), where tools/run_emulator.py or tools/flood_inbox.py sends the readings.
+#ifdef TEST_STRESS
+#define TEST_SIMULATOR 0
+#else
+#define TEST_SIMULATOR 1
+#endif
+#define TEST_SIM_SEED 1
+#define TEST_SIM_CADENCE_SECONDS 300 // Between readings, a multiple of 60
+#define TEST_SIM_HOURS 24            // Replayed from the past before going on in real time
+#define TEST_SIM_SPEEDUP 60          // 24 hours take 24 minutes
+#define TEST_SIM_MMOL 1              // Unit of the generated strings
 
 #define TEST_BG_STRING "10.2"
 #define TEST_DELTA_STRING "+0.3"
@@ -0,0 +1,63 @@
+#include "units.h"
+#include <stdio.h>
+
+#define MGDL_PER_MMOL_X1000 18018
+
+uint16_t bg_parse_mgdl(const char *str, bool *is_mmol) {
+    uint32_t whole = 0;
+    int tenths = 0;
+    bool digits = false;
+    bool point = false;
+    bool decimal_seen = false;
+
+    for (const char *c = str; *c != '\0'; c++) {
+        if (*c >= '0' && *c <= '9') {
+            digits = true;
+            if (!point) {
+                whole = whole * 10 + (*c - '0');
+                if (whole > 999) {
+                    return 0;
+                }
+            } else if (!decimal_seen) {
+                tenths = *c - '0';
+                decimal_seen = true;
+            }
+        } else if ((*c == '.' || *c == ',') && !point) {
+            point = true;
+        } else {
+            return 0;
+        }
+    }
+
+    if (!digits) {
+        return 0;
+    }
+    *is_mmol = point;
+    if (!point) {
+        return whole;
+    }
+    return ((whole * 10 + tenths) * MGDL_PER_MMOL_X1000 + 5000) / 10000;
+}
+
+void bg_format(char *buf, size_t size, uint16_t mgdl, bool mmol) {
+    if (mmol) {
+        const uint32_t tenths =
+            ((uint32_t)mgdl * 10000 + MGDL_PER_MMOL_X1000 / 2) / MGDL_PER_MMOL_X1000;
+        snprintf(buf, size, "%d.%d", (int)(tenths / 10), (int)(tenths % 10));
+    } else {
+        snprintf(buf, size, "%d", mgdl);
+    }
+}
+
+void bg_convert_delta(char *buf, size_t size, const char *delta, bool mmol) {
+    const bool has_sign = delta[0] == '+' || delta[0] == '-';
+    bool is_mmol = mmol; // Left as is if not a number
+    const uint16_t mgdl = bg_parse_mgdl(delta + has_sign, &is_mmol);
+    if (is_mmol == mmol) {
+        snprintf(buf, size, "%s", delta);
+        return;
+    }
+    char value[6];
+    bg_format(value, sizeof(value), mgdl, mmol);
+    snprintf(buf, size, "%.*s%s", has_sign, delta, value);
+}
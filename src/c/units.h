@@ -0,0 +1,18 @@
+// BG unit parsing and formatting. Values are kept as mg/dL internally.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Parses a BG string as sent by xDrip, e.g. "7.5" or "135", into mg/dL. A decimal point means
+// mmol/L, and sets `is_mmol`. Returns 0 if the string is not a number, e.g. "---".
+uint16_t bg_parse_mgdl(const char *str, bool *is_mmol);
+
+// Formats a mg/dL value in the given unit, e.g. "7.5" or "135".
+void bg_format(char *buf, size_t size, uint16_t mgdl, bool mmol);
+
+// Converts a delta string as sent by xDrip, e.g. "+0.3" or "-5", to the given unit. Copies it
+// unchanged if it is already in that unit, or not a number.
+void bg_convert_delta(char *buf, size_t size, const char *delta, bool mmol);
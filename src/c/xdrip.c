@@ -0,0 +1,202 @@
+#include "xdrip.h"
+#include "units.h"
+#include <stdio.h>
+#include <string.h>
+
+// Expected type and length of the keys xDrip sends
+typedef struct {
+    uint32_t key;
+    XdripType type;
+    uint16_t length; // Exact length [bytes], or 0 for any
+} KeySpec;
+
+static const KeySpec KEY_SPECS[] = {
+    {XDRIP_KEY_BG_TIMESTAMP, XDRIP_TYPE_UINT, 4},
+    {XDRIP_KEY_BG_STRING, XDRIP_TYPE_STRING, 0},
+    {XDRIP_KEY_DELTA_STRING, XDRIP_TYPE_STRING, 0},
+    {XDRIP_KEY_ARROW_INDEX, XDRIP_TYPE_UINT, 1},
+    {XDRIP_KEY_IOB_STRING, XDRIP_TYPE_STRING, 0},
+    {XDRIP_KEY_COB_STRING, XDRIP_TYPE_STRING, 0},
+    {XDRIP_KEY_SENSOR_AGE_STRING, XDRIP_TYPE_STRING, 0},
+    {XDRIP_KEY_PHONE_BATTERY, XDRIP_TYPE_UINT, 1},
+    {XDRIP_KEY_HISTORY_BATCH, XDRIP_TYPE_BYTES, 0},
+    {XDRIP_KEY_SETTINGS, XDRIP_TYPE_BYTES, 0},
+};
+#define KEY_SPEC_COUNT (sizeof(KEY_SPECS) / sizeof(KEY_SPECS[0]))
+
+static XdripHandlers s_handlers;
+static XdripModel s_model = {
+    .bg_string = "---",
+    .phone_battery = XDRIP_PHONE_BATTERY_UNKNOWN,
+};
+
+// PebbleKit JS sends every number as an int32. An unsigned key also takes one if its value fits
+// the key's length, as the low bytes then read as the same value.
+static bool is_fitting_int32(const KeySpec *spec, const XdripField *field) {
+    if (spec->type != XDRIP_TYPE_UINT || field->type != XDRIP_TYPE_INT || field->length != 4 ||
+        (field->data[3] & 0x80)) {
+        return false;
+    }
+    for (uint16_t i = spec->length; i < field->length; i++) {
+        if (field->data[i] != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool field_is_valid(const XdripField *field) {
+    for (size_t i = 0; i < KEY_SPEC_COUNT; i++) {
+        const KeySpec *spec = &KEY_SPECS[i];
+        if (spec->key != field->key) {
+            continue;
+        }
+        if (is_fitting_int32(spec, field)) {
+            return true;
+        }
+        if (field->type != spec->type || (spec->length > 0 && field->length != spec->length)) {
+            return false;
+        }
+        // Strings must be terminated within the field, or copying them reads past it
+        return field->type != XDRIP_TYPE_STRING ||
+               (field->length > 0 && field->data[field->length - 1] == '\0');
+    }
+    return true;
+}
+
+static const XdripField *find(const XdripField *fields, size_t count, uint32_t key) {
+    for (size_t i = 0; i < count; i++) {
+        if (fields[i].key == key) {
+            return &fields[i];
+        }
+    }
+    return NULL;
+}
+
+// Copies a string field, truncated to `size`. Returns true if found.
+static bool copy_string(char *dest, size_t size, const XdripField *fields, size_t count,
+                        uint32_t key) {
+    const XdripField *field = find(fields, count, key);
+    if (!field) {
+        return false;
+    }
+    strncpy(dest, (const char *)field->data, size);
+    dest[size - 1] = '\0';
+    return true;
+}
+
+static uint32_t read_uint32(const uint8_t *data) {
+    return data[0] | (data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+void xdrip_init(const XdripHandlers *handlers) { s_handlers = *handlers; }
+
+const XdripModel *xdrip_model(void) { return &s_model; }
+
+bool xdrip_receive(const XdripField *fields, size_t count, uint32_t now,
+                   const XdripField **rejected) {
+    for (size_t i = 0; i < count; i++) {
+        if (!field_is_valid(&fields[i])) {
+            if (rejected) {
+                *rejected = &fields[i];
+            }
+            return false;
+        }
+    }
+
+    if (find(fields, count, XDRIP_KEY_DEBUG_DUMP)) {
+        if (s_handlers.debug_dump) {
+            s_handlers.debug_dump();
+        }
+        return true;
+    }
+    s_model.last_message_time = now;
+
+    const XdripField *settings = find(fields, count, XDRIP_KEY_SETTINGS);
+    if (settings && s_handlers.settings) {
+        s_handlers.settings(settings->data, settings->length);
+    }
+
+    const XdripField *batch = find(fields, count, XDRIP_KEY_HISTORY_BATCH);
+    if (batch && s_handlers.history_batch) {
+        s_handlers.history_batch(batch->data, batch->length);
+    }
+
+    // The timestamp is always present in data messages
+    const XdripField *timestamp = find(fields, count, XDRIP_KEY_BG_TIMESTAMP);
+    if (!timestamp) {
+        return true;
+    }
+
+    // xDrip re-sends the latest reading after every capability announcement. An older reading,
+    // e.g. one that was queued behind a newer one, leaves the model's reading as it is.
+    uint32_t changes = 0;
+    const uint32_t bg_timestamp = read_uint32(timestamp->data);
+    if (bg_timestamp >= s_model.bg_timestamp) {
+        changes |= XDRIP_CHANGED_READING;
+        if (bg_timestamp > s_model.bg_timestamp) {
+            s_model.bg_timestamp = bg_timestamp;
+            changes |= XDRIP_NEW_READING;
+        }
+        if (copy_string(s_model.bg_string, sizeof(s_model.bg_string), fields, count,
+                        XDRIP_KEY_BG_STRING)) {
+            s_model.bg_mgdl = bg_parse_mgdl(s_model.bg_string, &s_model.bg_is_mmol);
+        }
+        const XdripField *arrow = find(fields, count, XDRIP_KEY_ARROW_INDEX);
+        if (arrow) {
+            s_model.arrow_index = arrow->data[0];
+        }
+        copy_string(s_model.delta_string, sizeof(s_model.delta_string), fields, count,
+                    XDRIP_KEY_DELTA_STRING);
+    }
+
+    if (copy_string(s_model.iob_string, sizeof(s_model.iob_string), fields, count,
+                    XDRIP_KEY_IOB_STRING) |
+        copy_string(s_model.cob_string, sizeof(s_model.cob_string), fields, count,
+                    XDRIP_KEY_COB_STRING)) {
+        changes |= XDRIP_CHANGED_LOOP;
+    }
+
+    // Extended fields, only sent while asked for with XDRIP_CAP_EXTENDED
+    if (copy_string(s_model.sensor_age_string, sizeof(s_model.sensor_age_string), fields, count,
+                    XDRIP_KEY_SENSOR_AGE_STRING)) {
+        changes |= XDRIP_CHANGED_EXTENDED;
+    }
+    const XdripField *phone_battery = find(fields, count, XDRIP_KEY_PHONE_BATTERY);
+    if (phone_battery) {
+        s_model.phone_battery = phone_battery->data[0];
+        changes |= XDRIP_CHANGED_EXTENDED;
+    }
+
+    if (s_handlers.model_changed) {
+        s_handlers.model_changed(&s_model, changes);
+    }
+    return true;
+}
+
+bool xdrip_announce(uint32_t capabilities, uint16_t inbox_size) {
+    const uint8_t version = XDRIP_PROTOCOL_VERSION;
+    const uint8_t caps[4] = {capabilities, capabilities >> 8, capabilities >> 16,
+                             capabilities >> 24};
+    const uint8_t inbox[2] = {inbox_size, inbox_size >> 8};
+    const XdripField fields[] = {
+        {XDRIP_KEY_PROTOCOL_VERSION, XDRIP_TYPE_UINT, sizeof(version), &version},
+        {XDRIP_KEY_CAPABILITIES, XDRIP_TYPE_UINT, sizeof(caps), caps},
+        {XDRIP_KEY_INBOX_SIZE, XDRIP_TYPE_UINT, sizeof(inbox), inbox},
+    };
+    return s_handlers.send(fields, sizeof(fields) / sizeof(fields[0]));
+}
+
+void xdrip_format_time_ago(char *buf, size_t size, uint32_t now) {
+    // Don't populate until we have valid data.
+    if (s_model.bg_timestamp == 0) {
+        return;
+    }
+
+    const int minutes_ago = (int)(now - s_model.bg_timestamp) / 60;
+    if (minutes_ago < 60) {
+        snprintf(buf, size, "%dm", minutes_ago);
+    } else {
+        snprintf(buf, size, "%dh", minutes_ago / 60);
+    }
+}
@@ -0,0 +1,120 @@
+// Core of the xDrip-Pebble protocol: message keys and capabilities, validation and decoding of
+// received messages into a model, the capability announcement, and time-ago formatting.
+//
+// The core has no UI and doesn't depend on the Pebble SDK, so other watchfaces can reuse it, and it
+// builds on the host. The app turns each received AppMessage into XdripFields for
+// xdrip_receive(), gets model changes through XdripHandlers, and sends the fields the core asks it
+// to send. wscript also builds the core as a static library per platform, build/<platform>/
+// libxdrip.a, together with units.c and history_batch.c.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define XDRIP_PROTOCOL_VERSION 1 // Bump for breaking protocol changes
+
+// Message keys: Pebble -> xDrip capability announcement
+#define XDRIP_KEY_PROTOCOL_VERSION 0
+#define XDRIP_KEY_CAPABILITIES 1
+#define XDRIP_KEY_INBOX_SIZE 2 // Largest message the watchface accepts [bytes], for batching
+
+// Message keys: xDrip -> Pebble watchface data
+#define XDRIP_KEY_BG_TIMESTAMP 10      // UNIX epoch time [seconds]
+#define XDRIP_KEY_BG_STRING 11         // Formatted BG value, e.g. "7.5" or "135"
+#define XDRIP_KEY_DELTA_STRING 12      // Formatted delta, e.g. "+0.3" or "-5"
+#define XDRIP_KEY_ARROW_INDEX 13       // 0 unknown, 1 double up to 7 double down
+#define XDRIP_KEY_IOB_STRING 14        // Formatted insulin on board, e.g. "1.25U"
+#define XDRIP_KEY_COB_STRING 15        // Formatted carbs on board, e.g. "20g"
+#define XDRIP_KEY_SENSOR_AGE_STRING 16 // Formatted sensor age, e.g. "6d 4h"
+#define XDRIP_KEY_PHONE_BATTERY 17     // Phone battery [percent]
+#define XDRIP_KEY_HISTORY_BATCH 18     // Backfilled readings, see history_batch.h
+#define XDRIP_KEY_SETTINGS 19          // Versioned settings, see settings.h
+
+// Message keys: debug builds only (LOG_LEVEL above none)
+#define XDRIP_KEY_DEBUG_DUMP 100 // xDrip -> Pebble: request for the binary log
+#define XDRIP_KEY_DEBUG_LOG 101  // Pebble -> xDrip: binary log, see log.h
+
+// Capability bits (what data the watchface wants to receive)
+#define XDRIP_CAP_BG (1 << 0)
+#define XDRIP_CAP_TREND_ARROW (1 << 1)
+#define XDRIP_CAP_DELTA (1 << 2)
+#define XDRIP_CAP_LOOP (1 << 3)     // IOB and COB
+#define XDRIP_CAP_EXTENDED (1 << 4) // Sensor age and phone battery
+#define XDRIP_CAP_HISTORY (1 << 5)  // History batches
+
+// Field value types. Same values as Pebble's TupleType.
+typedef enum {
+    XDRIP_TYPE_BYTES = 0,
+    XDRIP_TYPE_STRING = 1,
+    XDRIP_TYPE_UINT = 2,
+    XDRIP_TYPE_INT = 3,
+} XdripType;
+
+// One key and value of a message. Integers are little endian.
+typedef struct {
+    uint32_t key;
+    XdripType type;
+    uint16_t length; // [bytes], for strings including the terminator
+    const uint8_t *data;
+} XdripField;
+
+#define XDRIP_PHONE_BATTERY_UNKNOWN 0xFF
+
+// Latest data from xDrip
+typedef struct {
+    uint32_t bg_timestamp;      // Seconds since epoch, 0 until the first reading
+    char bg_string[5];          // Fits '10.0'
+    uint16_t bg_mgdl;           // Parsed from bg_string, 0 if not a number
+    bool bg_is_mmol;            // Unit of the BG strings
+    char delta_string[6];       // Fits '+0.06'
+    uint8_t arrow_index;        // See XDRIP_KEY_ARROW_INDEX
+    char iob_string[7];         // Fits '12.25U'
+    char cob_string[5];         // Fits '120g'
+    char sensor_age_string[8];  // Fits '14d 23h'
+    uint8_t phone_battery;      // Percent, or XDRIP_PHONE_BATTERY_UNKNOWN
+    uint32_t last_message_time; // Seconds since epoch, 0 until the first message
+} XdripModel;
+
+// Parts of the model a message changed
+#define XDRIP_CHANGED_READING (1 << 0)  // Timestamp, BG, delta and arrow
+#define XDRIP_CHANGED_LOOP (1 << 1)     // IOB and COB
+#define XDRIP_CHANGED_EXTENDED (1 << 2) // Sensor age and phone battery
+#define XDRIP_NEW_READING (1 << 3)      // The reading is newer than the previous one
+
+typedef struct {
+    // A data message arrived. `changes` is a set of the XDRIP_CHANGED_* and XDRIP_NEW_READING
+    // bits, none if it only carried a reading older than the model's.
+    void (*model_changed)(const XdripModel *model, uint32_t changes);
+    // Settings arrived, see settings.h. Called first, so they apply to the rest of the message.
+    // Optional.
+    void (*settings)(const uint8_t *data, uint16_t length);
+    // A history batch arrived, see history_batch.h. Called before model_changed for a message
+    // that has both. Optional.
+    void (*history_batch)(const uint8_t *data, uint16_t length);
+    // xDrip asked for the binary log. Optional, only set by debug builds.
+    void (*debug_dump)(void);
+    // Sends a message. Returns false if it could not be sent.
+    bool (*send)(const XdripField *fields, size_t count);
+} XdripHandlers;
+
+void xdrip_init(const XdripHandlers *handlers);
+
+const XdripModel *xdrip_model(void);
+
+// Handles a received message at `now` [seconds since epoch]. A message with a known key of the
+// wrong type or length is rejected as a whole instead of being half applied, and `rejected`, if not
+// NULL, is set to the offending field. Unknown keys are skipped, so a newer xDrip can add keys
+// without breaking older watchfaces. Returns false if rejected.
+bool xdrip_receive(const XdripField *fields, size_t count, uint32_t now,
+                   const XdripField **rejected);
+
+// Sends the capability announcement, which also makes xDrip send fresh data. `inbox_size` is the
+// size the app opened its inbox with, so the sender can size history batches to it. Returns false
+// if it could not be sent.
+bool xdrip_announce(uint32_t capabilities, uint16_t inbox_size);
+
+// Formats the age of the latest reading at `now`, e.g. "5m" or "2h". Leaves `buf` as is until the
+// first reading.
+void xdrip_format_time_ago(char *buf, size_t size, uint32_t now);
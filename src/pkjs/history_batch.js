@@ -0,0 +1,86 @@
+// Encoder for history batches, the compact backfill format decoded by src/c/history_batch.c. See
+// src/c/history_batch.h for the layout.
+
+var VERSION = 1;
+var ESCAPE = -128;
+var MAX_SLOTS = 0xFFFF;
+
+// Slot of `timestamp` after `base` [seconds], rounded to the nearest one
+function slotOf(timestamp, base, intervalSeconds) {
+  return Math.round((timestamp - base) / intervalSeconds);
+}
+
+// Puts readings in slots, keeping the newest reading of a slot. `readings` are {timestamp, mgdl},
+// oldest first.
+function toSlots(readings, intervalSeconds) {
+  var slotted = [];
+  var base = readings[0].timestamp;
+  readings.forEach(function(reading) {
+    var slot = slotOf(reading.timestamp, base, intervalSeconds);
+    var last = slotted[slotted.length - 1];
+    if (last && last.slot === slot) {
+      last.mgdl = reading.mgdl;
+    } else {
+      slotted.push({slot: slot, mgdl: reading.mgdl});
+    }
+  });
+  return slotted;
+}
+
+function encode(slotted, base, intervalMinutes) {
+  var slotCount = slotted[slotted.length - 1].slot + 1;
+  var bitmapSize = Math.ceil(slotCount / 8);
+  var bytes = [VERSION, intervalMinutes, slotCount & 0xFF, slotCount >> 8,
+               base & 0xFF, (base >> 8) & 0xFF, (base >> 16) & 0xFF, (base >>> 24) & 0xFF,
+               slotted[0].mgdl & 0xFF, slotted[0].mgdl >> 8];
+  var bitmap = [];
+  for (var i = 0; i < bitmapSize; i++) {
+    bitmap.push(0);
+  }
+  var deltas = [];
+  slotted.forEach(function(entry, index) {
+    bitmap[entry.slot >> 3] |= 1 << (entry.slot & 7);
+    if (index === 0) {
+      return;
+    }
+    var delta = entry.mgdl - slotted[index - 1].mgdl;
+    if (delta > ESCAPE && delta <= 127) {
+      deltas.push(delta & 0xFF);
+    } else {
+      deltas.push(ESCAPE & 0xFF, entry.mgdl & 0xFF, entry.mgdl >> 8);
+    }
+  });
+  return bytes.concat(bitmap, deltas);
+}
+
+// Encodes `readings` ({timestamp [seconds], mgdl}, oldest first) into as few batches as possible
+// of at most `maxBytes` each. Returns the batches oldest first, as {bytes, count}, where `count` is
+// the number of readings from `readings` the batch covers.
+function encodeBatches(readings, intervalMinutes, maxBytes) {
+  var intervalSeconds = intervalMinutes * 60;
+  var batches = [];
+  var start = 0;
+  while (start < readings.length) {
+    // Grow the batch while it fits. Re-encoding each time is quadratic, but a day of readings
+    // still takes only milliseconds.
+    var base = readings[start].timestamp;
+    var batch = encode(toSlots([readings[start]], intervalSeconds), base, intervalMinutes);
+    var end = start + 1;
+    for (; end < readings.length; end++) {
+      if (slotOf(readings[end].timestamp, base, intervalSeconds) >= MAX_SLOTS) {
+        break;
+      }
+      var grown = encode(toSlots(readings.slice(start, end + 1), intervalSeconds), base,
+                         intervalMinutes);
+      if (grown.length > maxBytes) {
+        break;
+      }
+      batch = grown;
+    }
+    batches.push({bytes: batch, count: end - start});
+    start = end;
+  }
+  return batches;
+}
+
+module.exports.encodeBatches = encodeBatches;
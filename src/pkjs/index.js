@@ -0,0 +1,81 @@
+// Companion for phones where xDrip doesn't talk to the watch itself: polls xDrip's local web
+// service (xDrip Settings > Inter-app settings > xDrip Web Service) and sends the readings to the
+// watchface through a SendQueue, which merges what queues up while the watch is out of range.
+
+var SendQueue = require('./send_queue');
+
+var SGV_URL = 'http://127.0.0.1:17580/sgv.json?count=24';
+var POLL_INTERVAL_MS = 60 * 1000;
+var MGDL_PER_MMOL = 18.018; // As in src/c/units.c
+
+// Nightscout directions, as arrow indices (see XDRIP_KEY_ARROW_INDEX)
+var ARROWS = {
+  DoubleUp: 1,
+  SingleUp: 2,
+  FortyFiveUp: 3,
+  Flat: 4,
+  FortyFiveDown: 5,
+  SingleDown: 6,
+  DoubleDown: 7
+};
+
+var queue = new SendQueue(function(dict, onSuccess, onFailure) {
+  Pebble.sendAppMessage(dict, onSuccess, onFailure);
+});
+
+function formatBg(mgdl, mmol) {
+  return mmol ? (mgdl / MGDL_PER_MMOL).toFixed(1) : String(Math.round(mgdl));
+}
+
+function formatDelta(delta, mmol) {
+  if (typeof delta !== 'number') {
+    return '';
+  }
+  return (delta < 0 ? '-' : '+') + formatBg(Math.abs(delta), mmol);
+}
+
+// Entries are newest first. xDrip adds `units_hint` to the newest one.
+function onEntries(entries) {
+  var mmol = entries.length > 0 && entries[0].units_hint === 'mmol';
+  entries.slice().reverse().forEach(function(entry) {
+    // Below 39 mg/dL are sensor error codes, not readings
+    if (typeof entry.sgv !== 'number' || entry.sgv < 39 || entry.sgv > 1000) {
+      return;
+    }
+    var timestamp = Math.round(entry.date / 1000);
+    queue.push({
+      timestamp: timestamp,
+      mgdl: Math.round(entry.sgv),
+      fields: {
+        BgTimestamp: timestamp,
+        BgString: formatBg(entry.sgv, mmol),
+        DeltaString: formatDelta(entry.delta, mmol),
+        ArrowIndex: ARROWS[entry.direction] || 0
+      }
+    });
+  });
+}
+
+function poll() {
+  var request = new XMLHttpRequest();
+  request.onload = function() {
+    try {
+      onEntries(JSON.parse(request.responseText));
+    } catch (e) {
+      console.log('Unexpected response from xDrip: ' + e);
+    }
+  };
+  request.open('GET', SGV_URL);
+  request.send();
+}
+
+Pebble.addEventListener('ready', function() {
+  poll();
+  setInterval(poll, POLL_INTERVAL_MS);
+});
+
+Pebble.addEventListener('appmessage', function(e) {
+  if (e.payload.Capabilities !== undefined) {
+    queue.onAnnouncement(e.payload);
+  }
+});
@@ -0,0 +1,200 @@
+// Queue of readings for the watchface, merged so a reconnect costs a few messages instead of one
+// per reading missed while the watch was out of range.
+//
+// Only the newest reading is sent as a data message; a newer one supersedes it. Readings it
+// supersedes before they reach the watch are kept, and sent as history batches (see
+// history_batch.js) sized to the inbox the watchface announced. The last batch shares its message
+// with the newest reading if it fits. Batches are only sent while the watchface asks for them with
+// the history capability, which it does while its history has a gap, e.g. after a long disconnect.
+// Until then the readings wait, up to MAX_PENDING of them. They are only dropped for watchfaces
+// that never take batches.
+//
+// A failed send marks the watch as gone. Sending resumes with the next capability announcement,
+// which the watchface sends once its connection has settled.
+
+var historyBatch = require('./history_batch');
+
+var CAP_HISTORY = 1 << 5;
+var DEFAULT_INBOX_SIZE = 256; // Watchfaces that don't announce their inbox size
+
+// Dictionary overhead [bytes], see dict_calc_buffer_size(): a count, and a header per tuple
+var DICT_HEADER_SIZE = 1;
+var TUPLE_HEADER_SIZE = 7;
+
+var MAX_PENDING = 288; // A day of readings; older ones are dropped
+
+function dictSize(dict) {
+  var size = DICT_HEADER_SIZE;
+  Object.keys(dict).forEach(function(key) {
+    var value = dict[key];
+    size += TUPLE_HEADER_SIZE;
+    if (typeof value === 'string') {
+      size += value.length + 1;
+    } else if (Array.isArray(value)) {
+      size += value.length;
+    } else {
+      size += 4; // Numbers are sent as int32
+    }
+  });
+  return size;
+}
+
+// `send(dict, onSuccess, onFailure)` sends one AppMessage, e.g. Pebble.sendAppMessage.
+function SendQueue(send) {
+  this.send = send;
+  this.latest = null;        // Newest reading not yet delivered: {timestamp, mgdl, fields}
+  this.pending = [];         // Older readings not yet delivered: {timestamp, mgdl}, oldest first
+  this.delivered = 0;        // Timestamp of the newest delivered reading
+  this.capabilities = null;  // Until announced. Pending readings wait for it.
+  this.takesHistory = false; // Set once the watchface shows it takes history batches
+  this.inboxSize = DEFAULT_INBOX_SIZE;
+  this.isConnected = true; // Until a send fails
+  this.isSending = false;
+  this.messagesSent = 0;
+}
+
+// Adds a reading: {timestamp [seconds], mgdl, fields}, where `fields` is the data message for it.
+SendQueue.prototype.push = function(reading) {
+  if (reading.timestamp <= this.delivered) {
+    return;
+  }
+  if (!this.latest || reading.timestamp > this.latest.timestamp) {
+    if (this.latest) {
+      this.pending.push({timestamp: this.latest.timestamp, mgdl: this.latest.mgdl});
+    }
+    this.latest = reading;
+  } else if (reading.timestamp < this.latest.timestamp) {
+    this.insertPending(reading);
+  }
+  if (this.pending.length > MAX_PENDING) {
+    this.pending.splice(0, this.pending.length - MAX_PENDING);
+  }
+  this.flush();
+};
+
+SendQueue.prototype.insertPending = function(reading) {
+  var index = this.pending.length;
+  while (index > 0 && this.pending[index - 1].timestamp > reading.timestamp) {
+    index--;
+  }
+  if (index > 0 && this.pending[index - 1].timestamp === reading.timestamp) {
+    return;
+  }
+  this.pending.splice(index, 0, {timestamp: reading.timestamp, mgdl: reading.mgdl});
+};
+
+// Handles the watchface's capability announcement: the payload of its AppMessage.
+SendQueue.prototype.onAnnouncement = function(payload) {
+  this.capabilities = payload.Capabilities;
+  this.inboxSize = payload.InboxSize || DEFAULT_INBOX_SIZE;
+  // Watchfaces that take history batches announce their inbox size to size them by, and ask for
+  // them while their history has a gap. Older ones do neither.
+  if (payload.InboxSize !== undefined || (this.capabilities & CAP_HISTORY)) {
+    this.takesHistory = true;
+  }
+  this.isConnected = true;
+  this.flush();
+};
+
+// Slot interval for batching `readings` [minutes]: their median spacing, so one minute sensors
+// don't lose readings to five minute slots
+function intervalMinutes(readings) {
+  var spacings = [];
+  for (var i = 1; i < readings.length; i++) {
+    spacings.push(readings[i].timestamp - readings[i - 1].timestamp);
+  }
+  spacings.sort(function(a, b) {
+    return a - b;
+  });
+  var median = spacings.length > 0 ? spacings[spacings.length >> 1] : 5 * 60;
+  return Math.min(255, Math.max(1, Math.round(median / 60)));
+}
+
+function merge(a, b) {
+  var merged = {};
+  [a, b].forEach(function(dict) {
+    Object.keys(dict).forEach(function(key) {
+      merged[key] = dict[key];
+    });
+  });
+  return merged;
+}
+
+// Builds the messages for what is queued, oldest first, as {dict, newestPending, latest}: the
+// timestamp of the newest pending reading the message delivers, if any, and the latest reading if
+// it carries it.
+SendQueue.prototype.buildMessages = function() {
+  var messages = [];
+  if (this.pending.length > 0 && this.capabilities !== null) {
+    if (this.capabilities & CAP_HISTORY) {
+      var maxBytes = this.inboxSize - DICT_HEADER_SIZE - TUPLE_HEADER_SIZE;
+      var end = 0;
+      var interval = intervalMinutes(this.pending);
+      historyBatch.encodeBatches(this.pending, interval, maxBytes).forEach(function(batch) {
+        end += batch.count;
+        messages.push({dict: {HistoryBatch: batch.bytes},
+                       newestPending: this.pending[end - 1].timestamp});
+      }, this);
+    } else if (!this.takesHistory) {
+      this.pending = []; // Never wanted
+    }
+  }
+
+  if (this.latest) {
+    var last = messages[messages.length - 1];
+    var merged = last && merge(last.dict, this.latest.fields);
+    if (merged && dictSize(merged) <= this.inboxSize) {
+      last.dict = merged;
+      last.latest = this.latest;
+    } else {
+      messages.push({dict: this.latest.fields, latest: this.latest});
+    }
+  }
+  return messages;
+};
+
+SendQueue.prototype.markDelivered = function(message) {
+  var pending = this.pending;
+  var newest = message.newestPending || 0;
+  if (message.latest) {
+    this.delivered = Math.max(this.delivered, message.latest.timestamp);
+    if (this.latest === message.latest) {
+      this.latest = null;
+    }
+  }
+  this.pending = pending.filter(function(reading) {
+    // A latest reading superseded while it was being sent went to the pending ones
+    return reading.timestamp > newest &&
+        !(message.latest && reading.timestamp === message.latest.timestamp);
+  });
+};
+
+// Sends what is queued, one message at a time, while the watch is reachable.
+SendQueue.prototype.flush = function() {
+  if (this.isSending || !this.isConnected) {
+    return;
+  }
+  var messages = this.buildMessages();
+  if (messages.length === 0) {
+    return;
+  }
+  var self = this;
+  self.isSending = true;
+  (function sendNext(index) {
+    if (index === messages.length) {
+      self.isSending = false;
+      self.flush(); // Readings pushed while sending
+      return;
+    }
+    self.send(messages[index].dict, function() {
+      self.messagesSent++;
+      self.markDelivered(messages[index]);
+      sendNext(index + 1);
+    }, function() {
+      self.isSending = false;
+      self.isConnected = false;
+    });
+  })(0);
+};
+
+module.exports = SendQueue;
@@ -0,0 +1,135 @@
+// Benchmark of the UI-free modules for the watch's CPU: built for Thumb-2 with the SDK's compiler
+// and flags, and run under qemu-arm, which counts the instructions, see `make -C test bench-arm`.
+// Each run does one operation a given number of times; the Makefile subtracts a run of none, so
+// startup doesn't count. The Cortex-M3/M4 runs most instructions in a cycle, so the counts are
+// close to cycles, and a soft-float or 64 bit division helper shows up as a jump in them.
+//
+//   bench_arm                      lists the operations
+//   bench_arm operation rounds
+
+#include "config.h"
+#include "history.h"
+#include "history_batch.h"
+#include "settings.h"
+#include "stats.h"
+#include "units.h"
+#include "xdrip.h"
+
+#define NOW 1700000000
+#define CADENCE_SECONDS (5 * 60)
+
+static uint32_t s_sum; // Keeps the work from being optimized away
+
+// The defaults, instead of settings.c and the persistent storage it needs
+const Settings *settings_get(void) {
+    static const Settings s_settings = {.target_low_mgdl = 70, .target_high_mgdl = 180};
+    return &s_settings;
+}
+
+static void model_changed_handler(const XdripModel *model, uint32_t changes) {
+    s_sum += model->bg_mgdl ^ changes;
+}
+
+static bool send_handler(const XdripField *fields, size_t count) { return true; }
+
+static void sum_reading(uint32_t timestamp, uint16_t mgdl, void *context) { s_sum += mgdl; }
+
+// A reading as xDrip sends it
+static void receive_at(uint32_t timestamp) {
+    const uint8_t arrow = 4;
+    const XdripField reading[] = {
+        {XDRIP_KEY_BG_TIMESTAMP, XDRIP_TYPE_UINT, sizeof(timestamp), (const uint8_t *)&timestamp},
+        {XDRIP_KEY_BG_STRING, XDRIP_TYPE_STRING, 4, (const uint8_t *)"7.5"},
+        {XDRIP_KEY_DELTA_STRING, XDRIP_TYPE_STRING, 5, (const uint8_t *)"+0.3"},
+        {XDRIP_KEY_ARROW_INDEX, XDRIP_TYPE_UINT, sizeof(arrow), &arrow},
+        {XDRIP_KEY_IOB_STRING, XDRIP_TYPE_STRING, 6, (const uint8_t *)"1.25U"},
+        {XDRIP_KEY_COB_STRING, XDRIP_TYPE_STRING, 4, (const uint8_t *)"20g"},
+    };
+    s_sum += xdrip_receive(reading, sizeof(reading) / sizeof(reading[0]), timestamp, NULL);
+}
+
+// Each round newer than the last
+static void receive_reading(uint32_t round) { receive_at(NOW + round * CADENCE_SECONDS); }
+
+// Twelve slots, ten readings, and an escaped jump
+static void decode_batch(uint32_t round) {
+    static const uint8_t BATCH[] = {HISTORY_BATCH_VERSION, 5, 12, 0, 0x00, 0xF1, 0x53, 0x65, 120,
+                                    0, 0xDF, 0x0E, 3, 2, 0xFF, 0x80, 44, 1, 0xFE, 4, 5, 0xFD, 1};
+    s_sum += history_batch_decode(BATCH, sizeof(BATCH), sum_reading, NULL);
+}
+
+static void format_time_ago(uint32_t round) {
+    char buf[8] = "";
+    xdrip_format_time_ago(buf, sizeof(buf), NOW + round % 10000 * 60);
+    s_sum += buf[0];
+}
+
+static void parse_mmol(uint32_t round) {
+    bool is_mmol;
+    s_sum += bg_parse_mgdl(round % 2 ? "7.5" : "12.3", &is_mmol);
+}
+
+static void format_mmol(uint32_t round) {
+    char buf[8];
+    bg_format(buf, sizeof(buf), 40 + round % 360, true);
+    s_sum += buf[0];
+}
+
+static void add_reading(uint32_t round) {
+    s_sum += history_add(NOW + round * CADENCE_SECONDS, 40 + round % 360, 40 + round % 360);
+}
+
+// Statistics over a full history
+static void compute_stats(uint32_t round) {
+    Stats stats;
+    stats_compute(&stats, 0);
+    s_sum += stats.mean_mgdl;
+}
+
+typedef struct {
+    const char *name;
+    void (*run)(uint32_t round);
+} Operation;
+
+static const Operation OPERATIONS[] = {
+    {"receive_reading", receive_reading}, {"decode_batch", decode_batch},
+    {"format_time_ago", format_time_ago}, {"parse_mmol", parse_mmol},
+    {"format_mmol", format_mmol},         {"add_reading", add_reading},
+    {"compute_stats", compute_stats},
+};
+
+#define OPERATION_COUNT (sizeof(OPERATIONS) / sizeof(OPERATIONS[0]))
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        for (size_t i = 0; i < OPERATION_COUNT; i++) {
+            printf("%s\n", OPERATIONS[i].name);
+        }
+        return 0;
+    }
+    const Operation *operation = NULL;
+    for (size_t i = 0; i < OPERATION_COUNT; i++) {
+        if (strcmp(argv[1], OPERATIONS[i].name) == 0) {
+            operation = &OPERATIONS[i];
+        }
+    }
+    if (!operation) {
+        fprintf(stderr, "unknown operation %s\n", argv[1]);
+        return 2;
+    }
+    const uint32_t rounds = strtoul(argv[2], NULL, 10);
+
+    // Same setup whatever the rounds, so a run of none subtracts it
+    xdrip_init(&(XdripHandlers){.model_changed = model_changed_handler, .send = send_handler});
+    receive_at(NOW - CADENCE_SECONDS);
+    if (operation->run == compute_stats) {
+        for (uint32_t i = 0; i < HISTORY_SIZE; i++) {
+            add_reading(i);
+        }
+    }
+    for (uint32_t round = 0; round < rounds; round++) {
+        operation->run(round);
+    }
+    printf("%s: checksum %08x\n", operation->name, (unsigned)s_sum);
+    return 0;
+}
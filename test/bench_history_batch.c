@@ -0,0 +1,39 @@
+// Benchmark of the history batch decoder: decodes the day of readings from history_batch_vectors.js
+// (on stdin) repeatedly, and prints the time per batch and per reading. Host numbers only compare
+// changes to the decoder; the watch is one to two orders of magnitude slower.
+
+#include "history_batch.h"
+#include "host.h"
+#include "vectors.h"
+
+#define ROUNDS 200000
+
+static void sum_reading(uint32_t timestamp, uint16_t mgdl, void *context) {
+    *(uint32_t *)context += timestamp ^ mgdl;
+}
+
+static double now_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1e9 + now.tv_nsec;
+}
+
+int main(void) {
+    static Vectors vectors;
+    CHECK(vectors_read(stdin, &vectors));
+
+    uint32_t sum = 0; // Keeps the handler from being optimized away
+    const double start = now_ns();
+    for (int round = 0; round < ROUNDS; round++) {
+        for (size_t i = 0; i < vectors.batch_count; i++) {
+            CHECK(history_batch_decode(vectors.batches[i].bytes, vectors.batches[i].length,
+                                       sum_reading, &sum) > 0);
+        }
+    }
+    const double elapsed = now_ns() - start;
+
+    printf("history batch decode: %.0f ns per batch, %.1f ns per reading (checksum %08x)\n",
+           elapsed / ROUNDS / vectors.batch_count, elapsed / ROUNDS / vectors.reading_count,
+           (unsigned)sum);
+    return 0;
+}
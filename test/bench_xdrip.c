@@ -0,0 +1,71 @@
+// Benchmark of message handling: xdrip_receive() of a reading as xDrip sends it, of settings as
+// the phone re-sends them after a config page visit, decoded by settings_receive() as the face
+// does, and of a message rejected at its last field. Prints the time per message. Host numbers
+// only compare changes to the modules; the watch is one to two orders of magnitude slower.
+
+#include "host.h"
+#include "settings.h"
+#include "xdrip.h"
+
+#define ROUNDS 2000000
+#define NOW 1700000000
+
+static uint32_t s_sum; // Keeps the handlers from being optimized away
+
+static void settings_handler(const uint8_t *data, uint16_t length) {
+    s_sum += settings_receive(data, length);
+}
+
+static void model_changed_handler(const XdripModel *model, uint32_t changes) {
+    s_sum += model->bg_mgdl ^ changes;
+}
+
+static bool send_handler(const XdripField *fields, size_t count) { return true; }
+
+static double now_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1e9 + now.tv_nsec;
+}
+
+// Receives `fields` ROUNDS times, and prints the time per message.
+static void bench(const char *name, const XdripField *fields, size_t count, bool is_valid) {
+    const double start = now_ns();
+    for (int round = 0; round < ROUNDS; round++) {
+        CHECK(xdrip_receive(fields, count, NOW, NULL) == is_valid);
+    }
+    printf("xdrip receive, %s: %.0f ns per message\n", name, (now_ns() - start) / ROUNDS);
+}
+
+int main(void) {
+    xdrip_init(&(XdripHandlers){
+        .model_changed = model_changed_handler,
+        .settings = settings_handler,
+        .send = send_handler,
+    });
+
+    const uint8_t timestamp[] = {0xF1, 0xF0, 0x53, 0x65};
+    const uint8_t arrow[] = {4};
+    const XdripField reading[] = {
+        {XDRIP_KEY_BG_TIMESTAMP, XDRIP_TYPE_UINT, sizeof(timestamp), timestamp},
+        {XDRIP_KEY_BG_STRING, XDRIP_TYPE_STRING, 4, (const uint8_t *)"7.5"},
+        {XDRIP_KEY_DELTA_STRING, XDRIP_TYPE_STRING, 5, (const uint8_t *)"+0.3"},
+        {XDRIP_KEY_ARROW_INDEX, XDRIP_TYPE_UINT, sizeof(arrow), arrow},
+        {XDRIP_KEY_IOB_STRING, XDRIP_TYPE_STRING, 6, (const uint8_t *)"1.25U"},
+        {XDRIP_KEY_COB_STRING, XDRIP_TYPE_STRING, 4, (const uint8_t *)"20g"},
+    };
+    bench("reading", reading, sizeof(reading) / sizeof(reading[0]), true);
+
+    const uint8_t data[] = {SETTINGS_VERSION, SETTINGS_UNIT_MMOL, 70, 0, 180, 0, 0xFF, 0xFF};
+    const XdripField settings = {XDRIP_KEY_SETTINGS, XDRIP_TYPE_BYTES, sizeof(data), data};
+    CHECK(settings_receive(data, sizeof(data)) > 0); // Later ones are unchanged
+    bench("unchanged settings", &settings, 1, true);
+
+    XdripField rejected[sizeof(reading) / sizeof(reading[0])];
+    memcpy(rejected, reading, sizeof(reading));
+    rejected[5].type = XDRIP_TYPE_UINT;
+    bench("rejected", rejected, sizeof(rejected) / sizeof(rejected[0]), false);
+
+    printf("(checksum %08x)\n", (unsigned)s_sum);
+    return 0;
+}
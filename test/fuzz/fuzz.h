@@ -0,0 +1,24 @@
+// Fuzz targets. Each one defines LLVMFuzzerTestOneInput(), so it builds with libFuzzer
+// (-fsanitize=fuzzer), and a valid input as a seed for fuzz_main.c, the driver for compilers
+// without libFuzzer.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Checks a property of the code under test. Aborts, so the fuzzer keeps the input.
+#define FUZZ_CHECK(condition)                                                                      \
+    do {                                                                                           \
+        if (!(condition)) {                                                                        \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition);          \
+            abort();                                                                               \
+        }                                                                                          \
+    } while (0)
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+extern const uint8_t FUZZ_SEED[];
+extern const size_t FUZZ_SEED_SIZE;
@@ -0,0 +1,131 @@
+// Driver for the fuzz targets where libFuzzer isn't available, e.g. with gcc. Build it with
+// -fsanitize=address,undefined to catch memory errors.
+//
+//   fuzz_<target> [iterations [seed]]   runs random and mutated inputs, 1000000 by default
+//   fuzz_<target> <file>...             replays inputs, e.g. crashes found by libFuzzer
+//
+// Half of the inputs are random bytes, half are mutations of the target's FUZZ_SEED: flipped,
+// replaced, inserted and removed bytes, runs of 0x00 or 0xFF, truncation, and appended garbage.
+// Mutations keep the header mostly valid, so they get past the first checks to the code behind
+// them. With FUZZ_SAVE_INPUTS set, each input is written to fuzz-crash.bin before it runs, so a
+// crash leaves it behind for replaying.
+
+#include "fuzz.h"
+#include <stdbool.h>
+#include <string.h>
+
+#define MAX_SIZE 1024
+
+static uint32_t s_state;
+
+static uint32_t next_random(void) {
+    // xorshift32
+    s_state ^= s_state << 13;
+    s_state ^= s_state >> 17;
+    s_state ^= s_state << 5;
+    return s_state;
+}
+
+static size_t mutate(uint8_t *data, size_t size) {
+    const int mutations = 1 + next_random() % 4;
+    for (int i = 0; i < mutations; i++) {
+        const size_t at = size > 0 ? next_random() % size : 0;
+        switch (next_random() % 7) {
+        case 0: // Flip a bit
+            if (size > 0) {
+                data[at] ^= 1 << (next_random() % 8);
+            }
+            break;
+        case 1: // Replace a byte, often with an edge value
+            if (size > 0) {
+                static const uint8_t EDGES[] = {0x00, 0x01, 0x7F, 0x80, 0xFF};
+                data[at] = (next_random() & 1) ? EDGES[next_random() % sizeof(EDGES)]
+                                               : (uint8_t)next_random();
+            }
+            break;
+        case 2: // Insert a byte
+            if (size < MAX_SIZE) {
+                memmove(&data[at + 1], &data[at], size - at);
+                data[at] = next_random();
+                size++;
+            }
+            break;
+        case 3: // Remove a byte
+            if (size > 0) {
+                memmove(&data[at], &data[at + 1], size - at - 1);
+                size--;
+            }
+            break;
+        case 4: // Fill a run of bytes with an edge value, e.g. a 32 bit field with 0xFF
+            for (size_t n = 1 + next_random() % 4; n > 0 && at + n <= size; n--) {
+                data[at + n - 1] = (next_random() & 1) ? 0xFF : 0x00;
+            }
+            break;
+        case 5: // Truncate
+            size = at;
+            break;
+        default: // Append garbage
+            for (int n = next_random() % 16; n > 0 && size < MAX_SIZE; n--) {
+                data[size++] = next_random();
+            }
+            break;
+        }
+    }
+    return size;
+}
+
+static void save_input(const uint8_t *data, size_t size) {
+    FILE *file = fopen("fuzz-crash.bin", "wb");
+    if (file) {
+        fwrite(data, 1, size, file);
+        fclose(file);
+    }
+}
+
+static int replay(int count, char **paths) {
+    static uint8_t data[MAX_SIZE];
+    for (int i = 0; i < count; i++) {
+        FILE *file = fopen(paths[i], "rb");
+        if (!file) {
+            perror(paths[i]);
+            return 1;
+        }
+        const size_t size = fread(data, 1, sizeof(data), file);
+        fclose(file);
+        LLVMFuzzerTestOneInput(data, size);
+    }
+    printf("%d inputs replayed\n", count);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1 && (argv[1][0] < '0' || argv[1][0] > '9')) {
+        return replay(argc - 1, argv + 1);
+    }
+    const long iterations = argc > 1 ? atol(argv[1]) : 1000000;
+    s_state = argc > 2 ? (uint32_t)atol(argv[2]) : 1;
+    if (s_state == 0) {
+        s_state = 1;
+    }
+    const bool is_saving = getenv("FUZZ_SAVE_INPUTS") != NULL;
+
+    static uint8_t data[MAX_SIZE];
+    for (long i = 0; i < iterations; i++) {
+        size_t size;
+        if (next_random() & 1) {
+            size = next_random() % 300;
+            for (size_t j = 0; j < size; j++) {
+                data[j] = next_random();
+            }
+        } else {
+            memcpy(data, FUZZ_SEED, FUZZ_SEED_SIZE);
+            size = mutate(data, FUZZ_SEED_SIZE);
+        }
+        if (is_saving) {
+            save_input(data, size);
+        }
+        LLVMFuzzerTestOneInput(data, size);
+    }
+    printf("%ld inputs\n", iterations);
+    return 0;
+}
@@ -0,0 +1,119 @@
+// Fuzz target for the watch side of the xDrip protocol, see xdrip.h, with the settings and history
+// batches of a message decoded as the face does. Besides memory errors, it checks what
+// xdrip_receive() promises: a rejected message names a field of it, calls no handler and leaves
+// the model as it was, and an accepted one leaves terminated strings. Accepted settings must be
+// valid ones, and rejected settings must change nothing.
+//
+// The input is a message of up to MAX_FIELDS fields, each a key byte, a type byte (modulo the
+// four tuple types), a length byte and the data. Each field's data is copied to an allocation of
+// its exact length, so reading past a field is caught.
+
+#include "fuzz.h"
+#include "history_batch.h"
+#include "settings.h"
+#include "xdrip.h"
+#include <string.h>
+
+#define MAX_FIELDS 16
+#define NOW 1700000000
+
+static bool s_handler_called;
+
+static void settings_handler(const uint8_t *data, uint16_t length) {
+    s_handler_called = true;
+    const Settings before = *settings_get();
+    const int changes = settings_receive(data, length);
+    const Settings *settings = settings_get();
+    if (changes < 0) {
+        FUZZ_CHECK(memcmp(&before, settings, sizeof(before)) == 0);
+        return;
+    }
+    FUZZ_CHECK(settings->unit <= SETTINGS_UNIT_MMOL);
+    FUZZ_CHECK(settings->target_low_mgdl > 0);
+    FUZZ_CHECK(settings->target_low_mgdl < settings->target_high_mgdl);
+    FUZZ_CHECK(settings_receive(data, length) == 0); // Re-sent settings change nothing
+}
+
+static void count_reading(uint32_t timestamp, uint16_t mgdl, void *context) {
+    (*(int *)context)++;
+}
+
+static void history_batch_handler(const uint8_t *data, uint16_t length) {
+    s_handler_called = true;
+    int count = 0;
+    const int decoded = history_batch_decode(data, length, count_reading, &count);
+    FUZZ_CHECK(decoded == (decoded < 0 ? -1 : count));
+}
+
+static void model_changed_handler(const XdripModel *model, uint32_t changes) {
+    s_handler_called = true;
+    // A reading older than the model's changes nothing, a newer one the reading
+    FUZZ_CHECK(!(changes & XDRIP_NEW_READING) || (changes & XDRIP_CHANGED_READING));
+}
+
+static void debug_dump_handler(void) { s_handler_called = true; }
+
+static bool send_handler(const XdripField *fields, size_t count) { return true; }
+
+static bool is_terminated(const char *string, size_t size) { return memchr(string, '\0', size); }
+
+// A reading with settings and a history batch of two readings, for the mutation driver
+const uint8_t FUZZ_SEED[] = {
+    XDRIP_KEY_BG_TIMESTAMP, XDRIP_TYPE_UINT, 4, 0xF1, 0xF0, 0x53, 0x65,
+    XDRIP_KEY_BG_STRING, XDRIP_TYPE_STRING, 4, '7', '.', '5', 0,
+    XDRIP_KEY_DELTA_STRING, XDRIP_TYPE_STRING, 5, '+', '0', '.', '3', 0,
+    XDRIP_KEY_ARROW_INDEX, XDRIP_TYPE_INT, 4, 4, 0, 0, 0,
+    XDRIP_KEY_SETTINGS, XDRIP_TYPE_BYTES, 8, SETTINGS_VERSION, SETTINGS_UNIT_MMOL, 70, 0, 180, 0,
+    0xFF, 0xFF,
+    XDRIP_KEY_HISTORY_BATCH, XDRIP_TYPE_BYTES, 12, HISTORY_BATCH_VERSION, 5, 2, 0, 0x00, 0xF1, 0x53,
+    0x65, 120, 0, 0x03, 2,
+};
+const size_t FUZZ_SEED_SIZE = sizeof(FUZZ_SEED);
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    static bool is_initialized = false;
+    if (!is_initialized) {
+        is_initialized = true;
+        xdrip_init(&(XdripHandlers){
+            .model_changed = model_changed_handler,
+            .settings = settings_handler,
+            .history_batch = history_batch_handler,
+            .debug_dump = debug_dump_handler,
+            .send = send_handler,
+        });
+    }
+
+    XdripField fields[MAX_FIELDS];
+    size_t count = 0;
+    size_t at = 0;
+    while (count < MAX_FIELDS && at + 3 <= size) {
+        const uint16_t length = data[at + 2] < size - at - 3 ? data[at + 2] : size - at - 3;
+        uint8_t *copy = malloc(length > 0 ? length : 1);
+        memcpy(copy, &data[at + 3], length);
+        fields[count++] = (XdripField){data[at], data[at + 1] % 4, length, copy};
+        at += 3 + length;
+    }
+
+    const XdripModel before = *xdrip_model();
+    const XdripField *rejected = NULL;
+    s_handler_called = false;
+    const bool is_accepted = xdrip_receive(fields, count, NOW, &rejected);
+    const XdripModel *model = xdrip_model();
+    if (is_accepted) {
+        FUZZ_CHECK(rejected == NULL);
+        FUZZ_CHECK(is_terminated(model->bg_string, sizeof(model->bg_string)));
+        FUZZ_CHECK(is_terminated(model->delta_string, sizeof(model->delta_string)));
+        FUZZ_CHECK(is_terminated(model->iob_string, sizeof(model->iob_string)));
+        FUZZ_CHECK(is_terminated(model->cob_string, sizeof(model->cob_string)));
+        FUZZ_CHECK(is_terminated(model->sensor_age_string, sizeof(model->sensor_age_string)));
+    } else {
+        FUZZ_CHECK(rejected >= fields && rejected < fields + count);
+        FUZZ_CHECK(!s_handler_called);
+        FUZZ_CHECK(memcmp(&before, model, sizeof(before)) == 0);
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        free((void *)fields[i].data);
+    }
+    return 0;
+}
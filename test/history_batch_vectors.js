@@ -0,0 +1,49 @@
+// Encodes a day of readings with the phone-side encoder, src/pkjs/history_batch.js, and prints the
+// batches and the readings they hold, for test_history_batch.c and bench_history_batch.c:
+//
+//   batch <hex bytes>      per batch, oldest first
+//   reading <timestamp> <mg/dL>   per reading, oldest first
+//
+// The readings are a deterministic walk at 5 minute intervals, with gaps and jumps large enough to
+// need the escape, sized to the watch's 256 byte inbox as send_queue.js sizes them.
+
+var historyBatch = require('../src/pkjs/history_batch');
+
+var READINGS = 300;
+var INTERVAL_MINUTES = 5;
+var INBOX_SIZE = 256;
+var MAX_BYTES = INBOX_SIZE - 1 - 7; // Dictionary and tuple headers, see send_queue.js
+
+var seed = 1;
+function random() {
+  // xorshift32, so every run encodes the same readings
+  seed ^= seed << 13;
+  seed ^= seed >>> 17;
+  seed ^= seed << 5;
+  return (seed >>> 0) / 4294967296;
+}
+
+var readings = [];
+var timestamp = 1700000000;
+var mgdl = 120;
+while (readings.length < READINGS) {
+  timestamp += INTERVAL_MINUTES * 60;
+  if (random() < 0.03) {
+    continue; // Missed reading
+  }
+  if (random() < 0.02) {
+    mgdl = mgdl < 200 ? mgdl + 150 : mgdl - 150; // Sensor restart or calibration
+  } else {
+    mgdl = Math.min(400, Math.max(40, mgdl + Math.round((random() - 0.5) * 12)));
+  }
+  readings.push({timestamp: timestamp, mgdl: mgdl});
+}
+
+historyBatch.encodeBatches(readings, INTERVAL_MINUTES, MAX_BYTES).forEach(function(batch) {
+  console.log('batch ' + batch.bytes.map(function(byte) {
+    return (byte < 16 ? '0' : '') + byte.toString(16);
+  }).join(''));
+});
+readings.forEach(function(reading) {
+  console.log('reading ' + reading.timestamp + ' ' + reading.mgdl);
+});
@@ -0,0 +1,7 @@
+// The face, with its main() renamed to face_main(), so a test can run it with host_app_run().
+
+// Like a Pebble app's main(), it ends without a return
+#pragma GCC diagnostic ignored "-Wreturn-type"
+
+#define main face_main
+#include "main.c"
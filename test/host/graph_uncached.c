@@ -0,0 +1,9 @@
+// graph.c without the background cache, beside the cached one, so a test can compare the two.
+
+#define GRAPH_CACHE_BACKGROUND 0
+#define graph_layer_create graph_uncached_layer_create
+#define graph_layer_destroy graph_uncached_layer_destroy
+#define graph_layer_set_span graph_uncached_layer_set_span
+#define graph_layer_set_mmol graph_uncached_layer_set_mmol
+#define graph_layer_set_target graph_uncached_layer_set_target
+#include "graph.c"
@@ -0,0 +1,353 @@
+#include "host.h"
+#include <stdarg.h>
+#include <sys/time.h>
+
+// Persistent storage
+
+static HostPersist s_local_persist;
+static HostPersist *s_persist = &s_local_persist;
+static uint32_t s_writes_until_cut = 0; // 0 if no cut is set
+static void (*s_on_cut)(void) = NULL;
+
+void host_persist_use(HostPersist *persist) { s_persist = persist; }
+
+void host_persist_clear(void) { *s_persist = (HostPersist){0}; }
+
+size_t host_persist_size(void) {
+    size_t size = 0;
+    for (uint16_t i = 0; i < s_persist->count; i++) {
+        size += s_persist->lengths[i];
+    }
+    return size;
+}
+
+void host_persist_set_cut(uint32_t writes, void (*on_cut)(void)) {
+    s_writes_until_cut = writes > 0 ? writes + 1 : 0;
+    s_on_cut = on_cut;
+}
+
+static int find_key(uint32_t key) {
+    for (uint16_t i = 0; i < s_persist->count; i++) {
+        if (s_persist->keys[i] == key) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool persist_exists(const uint32_t key) { return find_key(key) >= 0; }
+
+int persist_get_size(const uint32_t key) {
+    const int i = find_key(key);
+    return i < 0 ? E_DOES_NOT_EXIST : s_persist->lengths[i];
+}
+
+int persist_read_data(const uint32_t key, void *buffer, const size_t buffer_size) {
+    const int i = find_key(key);
+    if (i < 0) {
+        return E_DOES_NOT_EXIST;
+    }
+    const size_t length = s_persist->lengths[i] < buffer_size ? s_persist->lengths[i] : buffer_size;
+    memcpy(buffer, s_persist->data[i], length);
+    return length;
+}
+
+int32_t persist_read_int(const uint32_t key) {
+    int32_t value = 0;
+    return persist_read_data(key, &value, sizeof(value)) == sizeof(value) ? value : 0;
+}
+
+int persist_write_data(const uint32_t key, const void *data, const size_t size) {
+    if (s_writes_until_cut > 0 && --s_writes_until_cut == 0) {
+        s_on_cut();
+        return 0;
+    }
+    int i = find_key(key);
+    if (i < 0) {
+        CHECK(s_persist->count < HOST_PERSIST_KEYS);
+        i = s_persist->count++;
+        s_persist->keys[i] = key;
+    }
+    const size_t length = size < PERSIST_DATA_MAX_LENGTH ? size : PERSIST_DATA_MAX_LENGTH;
+    memcpy(s_persist->data[i], data, length);
+    s_persist->lengths[i] = length;
+    s_persist->writes++;
+    return length;
+}
+
+int persist_write_int(const uint32_t key, const int32_t value) {
+    return persist_write_data(key, &value, sizeof(value)) == sizeof(value) ? S_SUCCESS : -1;
+}
+
+int persist_delete(const uint32_t key) {
+    const int i = find_key(key);
+    if (i < 0) {
+        return E_DOES_NOT_EXIST;
+    }
+    s_persist->count--;
+    s_persist->keys[i] = s_persist->keys[s_persist->count];
+    s_persist->lengths[i] = s_persist->lengths[s_persist->count];
+    memcpy(s_persist->data[i], s_persist->data[s_persist->count], PERSIST_DATA_MAX_LENGTH);
+    return S_SUCCESS;
+}
+
+// Clock
+
+#undef time
+
+static uint64_t s_clock_ms = 0; // 0 until a test sets it
+
+void host_clock_set_ms(uint64_t ms) { s_clock_ms = ms; }
+
+uint64_t host_clock_ms(void) {
+    if (s_clock_ms > 0) {
+        return s_clock_ms;
+    }
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return (uint64_t)now.tv_sec * 1000 + now.tv_usec / 1000;
+}
+
+time_t host_time(time_t *tloc) {
+    const time_t now = host_clock_ms() / 1000;
+    if (tloc) {
+        *tloc = now;
+    }
+    return now;
+}
+
+uint16_t time_ms(time_t *tloc, uint16_t *out_ms) {
+    const uint64_t now_ms = host_clock_ms();
+    const uint16_t ms = now_ms % 1000;
+    if (tloc) {
+        *tloc = now_ms / 1000;
+    }
+    if (out_ms) {
+        *out_ms = ms;
+    }
+    return ms;
+}
+
+time_t time_start_of_today(void) {
+    const time_t now = host_time(NULL);
+    struct tm *today = localtime(&now);
+    today->tm_hour = today->tm_min = today->tm_sec = 0;
+    return mktime(today);
+}
+
+bool clock_is_24h_style(void) { return true; }
+
+// Heap accounting. With -Wl,--wrap=malloc and so on, the calls of the code under test come here,
+// while the C library's own allocations don't.
+
+static size_t s_heap_in_use = 0;
+static uint32_t s_allocations = 0, s_frees = 0;
+
+// Allocations carry their size in front, aligned for any type
+typedef union {
+    size_t size;
+    max_align_t align;
+} Header;
+
+void *__real_malloc(size_t size);
+void __real_free(void *ptr);
+
+// First fit arena, see host_heap_use_arena(). Each block starts with a header holding its size
+// and that of the block before it, so a freed block merges with free neighbours on both sides.
+
+#define ARENA_UNIT 8
+#define ARENA_USED 1u // In ArenaHeader.size
+
+typedef struct {
+    uint32_t size;      // Of the block, header included [bytes], ORed with ARENA_USED if in use
+    uint32_t prev_size; // Of the block before, 0 for the first
+} ArenaHeader;
+
+static _Alignas(ARENA_UNIT) uint8_t s_arena[HOST_HEAP_SIZE];
+static bool s_use_arena = false;
+static size_t s_arena_used = 0; // Headers included
+static HostArenaStats s_arena_stats;
+
+static uint32_t block_size(const ArenaHeader *block) { return block->size & ~ARENA_USED; }
+
+static bool is_used(const ArenaHeader *block) { return block->size & ARENA_USED; }
+
+static ArenaHeader *next_block(ArenaHeader *block) {
+    uint8_t *next = (uint8_t *)block + block_size(block);
+    return next < s_arena + sizeof(s_arena) ? (ArenaHeader *)next : NULL;
+}
+
+static ArenaHeader *prev_block(ArenaHeader *block) {
+    return block->prev_size > 0 ? (ArenaHeader *)((uint8_t *)block - block->prev_size) : NULL;
+}
+
+// Sets the size of a free block, and tells the block after it.
+static void set_free_size(ArenaHeader *block, uint32_t size) {
+    block->size = size;
+    ArenaHeader *next = next_block(block);
+    if (next) {
+        next->prev_size = size;
+    }
+}
+
+static size_t largest_free_block(void) {
+    size_t largest = 0;
+    for (ArenaHeader *block = (ArenaHeader *)s_arena; block; block = next_block(block)) {
+        if (!is_used(block) && block_size(block) - sizeof(ArenaHeader) > largest) {
+            largest = block_size(block) - sizeof(ArenaHeader);
+        }
+    }
+    return largest;
+}
+
+static void update_arena_stats(void) {
+    s_arena_stats.largest_free = largest_free_block();
+    if (s_arena_stats.largest_free < s_arena_stats.min_largest_free) {
+        s_arena_stats.min_largest_free = s_arena_stats.largest_free;
+    }
+    if (s_arena_used > s_arena_stats.peak) {
+        s_arena_stats.peak = s_arena_used;
+    }
+}
+
+static void *arena_alloc(size_t size) {
+    const size_t needed = sizeof(ArenaHeader) + (size + ARENA_UNIT - 1) / ARENA_UNIT * ARENA_UNIT;
+    for (ArenaHeader *block = (ArenaHeader *)s_arena; block; block = next_block(block)) {
+        if (is_used(block) || block_size(block) < needed) {
+            continue;
+        }
+        // Splits off the rest, if it can hold a block of its own
+        if (block_size(block) - needed >= sizeof(ArenaHeader) + ARENA_UNIT) {
+            ArenaHeader *rest = (ArenaHeader *)((uint8_t *)block + needed);
+            rest->prev_size = needed;
+            set_free_size(rest, block_size(block) - needed);
+            block->size = needed;
+        }
+        block->size |= ARENA_USED;
+        s_arena_used += block_size(block);
+        update_arena_stats();
+        return block + 1;
+    }
+    if (s_arena_stats.failures++ == 0) {
+        s_arena_stats.first_failure_ms = host_clock_ms();
+        s_arena_stats.first_failure_size = size;
+        s_arena_stats.first_failure_free = sizeof(s_arena) - s_arena_used;
+    }
+    return NULL;
+}
+
+static void arena_free(void *ptr) {
+    ArenaHeader *block = (ArenaHeader *)ptr - 1;
+    CHECK(is_used(block));
+    s_arena_used -= block_size(block);
+    uint32_t size = block_size(block);
+    ArenaHeader *next = next_block(block);
+    if (next && !is_used(next)) {
+        size += block_size(next);
+    }
+    ArenaHeader *prev = prev_block(block);
+    if (prev && !is_used(prev)) {
+        size += block_size(prev);
+        block = prev;
+    }
+    set_free_size(block, size);
+    update_arena_stats();
+}
+
+void host_heap_use_arena(void) {
+    CHECK(s_heap_in_use == 0);
+    *(ArenaHeader *)s_arena = (ArenaHeader){.size = sizeof(s_arena)};
+    s_use_arena = true;
+    s_arena_used = 0;
+    s_arena_stats = (HostArenaStats){.min_largest_free = sizeof(s_arena)};
+    update_arena_stats();
+}
+
+const HostArenaStats *host_arena_stats(void) { return &s_arena_stats; }
+
+// Usable size of an allocation
+static size_t allocated_size(void *ptr) {
+    return s_use_arena ? block_size((ArenaHeader *)ptr - 1) - sizeof(ArenaHeader)
+                       : ((Header *)ptr - 1)->size;
+}
+
+void *__wrap_malloc(size_t size) {
+    void *ptr;
+    if (s_use_arena) {
+        ptr = arena_alloc(size);
+    } else {
+        Header *header = __real_malloc(sizeof(Header) + size);
+        if (header) {
+            header->size = size;
+        }
+        ptr = header ? header + 1 : NULL;
+    }
+    if (!ptr) {
+        return NULL;
+    }
+    s_heap_in_use += allocated_size(ptr);
+    s_allocations++;
+    return ptr;
+}
+
+void __wrap_free(void *ptr) {
+    if (ptr) {
+        s_heap_in_use -= allocated_size(ptr);
+        s_frees++;
+        if (s_use_arena) {
+            arena_free(ptr);
+        } else {
+            __real_free((Header *)ptr - 1);
+        }
+    }
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+    void *ptr = __wrap_malloc(count * size);
+    if (ptr) {
+        memset(ptr, 0, count * size);
+    }
+    return ptr;
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    void *moved = __wrap_malloc(size);
+    if (moved && ptr) {
+        const size_t old_size = allocated_size(ptr);
+        memcpy(moved, ptr, old_size < size ? old_size : size);
+        __wrap_free(ptr);
+    }
+    return moved;
+}
+
+size_t host_heap_in_use(void) { return s_heap_in_use; }
+
+uint32_t host_heap_allocations(void) { return s_allocations; }
+
+uint32_t host_heap_frees(void) { return s_frees; }
+
+size_t heap_bytes_used(void) { return s_use_arena ? s_arena_used : s_heap_in_use; }
+
+size_t heap_bytes_free(void) {
+    const size_t used = heap_bytes_used();
+    return used < HOST_HEAP_SIZE ? HOST_HEAP_SIZE - used : 0;
+}
+
+// Logging
+
+static FILE *s_log_file = NULL;
+
+void host_log_to(FILE *file) { s_log_file = file; }
+
+void app_log(uint8_t log_level, const char *src_filename, int src_line_number, const char *fmt,
+             ...) {
+    if (!s_log_file) {
+        return;
+    }
+    va_list args;
+    va_start(args, fmt);
+    fprintf(s_log_file, "[%d] %s:%d> ", log_level, src_filename, src_line_number);
+    vfprintf(s_log_file, fmt, args);
+    fputc('\n', s_log_file);
+    va_end(args);
+}
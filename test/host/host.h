@@ -0,0 +1,167 @@
+// Test controls for the host stand-in of the Pebble SDK (pebble.h) and the modules the tests link
+// instead of the watch's:
+//
+//   host.c     persistent storage, the clock, the heap and logging, for every program
+//   modules.c  the scheduler and flash metrics, for tests of single modules
+//   ui.c       windows, layers, drawing, AppMessage and the event services, for tests running the
+//              whole face, whose main() face.c renames to face_main()
+//
+// Also checks for the tests.
+
+#pragma once
+
+#include "scheduler.h"
+#include <pebble.h>
+
+// Checks a condition, and exits the test with the failed expression if it doesn't hold.
+#define CHECK(condition)                                                                           \
+    do {                                                                                           \
+        if (!(condition)) {                                                                        \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition);          \
+            exit(1);                                                                               \
+        }                                                                                          \
+    } while (0)
+
+// Persistent storage. Apps get 4 KB on the watch; the host store counts what is used against it,
+// but doesn't enforce it, so tests can check it themselves.
+#define HOST_PERSIST_KEYS 128
+#define HOST_PERSIST_LIMIT 4096
+
+typedef struct {
+    uint32_t keys[HOST_PERSIST_KEYS];
+    uint16_t lengths[HOST_PERSIST_KEYS];
+    uint8_t data[HOST_PERSIST_KEYS][PERSIST_DATA_MAX_LENGTH];
+    uint16_t count;
+    uint32_t writes; // Successful writes so far
+} HostPersist;
+
+// Makes the persist_* functions use `persist`, e.g. in memory shared with a parent process.
+void host_persist_use(HostPersist *persist);
+void host_persist_clear(void);
+
+// Bytes stored over all keys.
+size_t host_persist_size(void);
+
+// Cuts power after `writes` more writes: the next write after those is dropped, as writes are
+// atomic on the watch, and `on_cut` is called. 0 cancels the cut.
+void host_persist_set_cut(uint32_t writes, void (*on_cut)(void));
+
+// Clock. time() and time_ms() read the host's clock until a test sets the simulated one, which
+// then only moves when the test moves it, or the event loop in ui.c does, see host_advance().
+void host_clock_set_ms(uint64_t ms); // Milliseconds since epoch
+uint64_t host_clock_ms(void);
+
+// The app's heap on the watch [bytes]: the platform's app RAM less the app's code and static data.
+// That is estimated at 10 KB on aplite and 16 KB elsewhere, as the host can't measure it. Override
+// with -DHOST_HEAP_SIZE.
+#ifndef HOST_HEAP_SIZE
+#if defined(PBL_PLATFORM_EMERY)
+#define HOST_HEAP_SIZE ((128 - 16) * 1024)
+#elif defined(PBL_PLATFORM_APLITE)
+#define HOST_HEAP_SIZE ((24 - 10) * 1024)
+#else
+#define HOST_HEAP_SIZE ((64 - 16) * 1024)
+#endif
+#endif
+
+// Bytes allocated with malloc() and friends by the code under test and not freed yet. Needs the
+// program linked with HOST_WRAP_MALLOC, see test/Makefile.
+size_t host_heap_in_use(void);
+
+// Makes malloc() and friends allocate from an arena of HOST_HEAP_SIZE bytes instead of the C
+// library, first fit, with an 8 byte header per block and sizes rounded up to 8 bytes, as on the
+// watch. Allocations then fail where the watch's would, for lack of memory or of a free block
+// large enough. Sizes are those of the host, where pointers take 8 bytes instead of 4. Call with
+// nothing allocated.
+void host_heap_use_arena(void);
+
+// Use of the arena, since host_heap_use_arena()
+typedef struct {
+    size_t peak;              // Most bytes in use at once, headers included
+    size_t largest_free;      // Largest allocation that would succeed now [bytes]
+    size_t min_largest_free;  // Smallest largest_free after any allocation or free
+    uint32_t failures;        // Allocations that failed
+    uint64_t first_failure_ms; // Clock at the first failure
+    size_t first_failure_size; // Bytes it asked for, 0 if none failed
+    size_t first_failure_free; // Bytes free then, in all blocks
+} HostArenaStats;
+
+const HostArenaStats *host_arena_stats(void);
+
+// Calls that allocated and freed a block, since the program started. Their difference is the
+// number of blocks in use.
+uint32_t host_heap_allocations(void);
+uint32_t host_heap_frees(void);
+
+// Sends APP_LOG output to `file`, or nowhere if NULL, the default.
+void host_log_to(FILE *file);
+
+// Scheduler stand-in, see modules.c. Tasks run when the test says time has passed, not on a real
+// timer.
+void host_scheduler_run_due(uint32_t now_ms);
+uint8_t host_scheduler_count(void); // Scheduled tasks
+
+// Flash metrics stand-in, see modules.c
+uint32_t host_flash_bytes(void); // See metrics_record_flash_write()
+uint32_t host_flash_naive_bytes(void);
+
+// The face's main(), renamed by face.c.
+int face_main(void);
+
+// Runs an app from start to exit, like the watch does: `app_main` initializes the app and calls
+// app_event_loop(), which calls `events` to drive it; once `app_main` returns, the windows still
+// on the stack are removed and the AppMessage buffers freed, as at a real exit. Starts with a
+// connected phone and a full battery, no Quiet Time, and the current traffic counters.
+void host_app_run(int (*app_main)(void), void (*events)(void));
+
+// Moves the clock forward by `ms`, delivering the tick and timer events due on the way in order.
+// After every event, and after every event injected below, the phone gets the message the app
+// sent, if any, and the window on top of the stack is redrawn if a layer was marked dirty.
+void host_advance(uint32_t ms);
+
+// The phone: gets each message the app sends, once the event that sent it is over. It may reply
+// with host_inbox_begin() and host_inbox_deliver() right away. While the phone is disconnected,
+// messages are not sent.
+void host_set_phone(void (*on_message)(DictionaryIterator *message));
+
+// Starts a message to the app. Write it with the dict_write_* functions.
+DictionaryIterator *host_inbox_begin(void);
+
+// Delivers the message to the app's inbox handler, or to its dropped handler if it doesn't fit
+// the inbox. Returns APP_MSG_OK if it was delivered, and APP_MSG_NOT_CONNECTED while the phone is
+// disconnected.
+AppMessageResult host_inbox_deliver(void);
+
+// AppMessage traffic, since the program started
+typedef struct {
+    uint32_t in_messages, in_bytes; // Delivered to the app, dictionary sizes
+    uint32_t in_dropped;            // Didn't fit the inbox
+    uint32_t out_messages, out_bytes;
+    uint32_t out_failed; // Sent while disconnected or busy
+} HostTraffic;
+
+const HostTraffic *host_traffic(void);
+
+// Events
+void host_set_connected(bool connected);
+void host_set_battery(uint8_t charge_percent, bool is_plugged);
+void host_set_quiet_time(bool active);
+void host_tap(void);
+
+// Wakeups, drawing and vibrations, since the program started
+typedef struct {
+    uint32_t ticks;       // Tick events delivered
+    uint32_t timers;      // App timers fired
+    uint32_t frames;      // Windows redrawn
+    uint32_t api_pixels;  // Pixels written through the graphics_* functions
+    uint32_t vibe_pulses; // Pulses of vibes_*()
+} HostCounters;
+
+const HostCounters *host_counters(void);
+
+// The screen. Layers draw into it; the graph also writes it directly, see graph.c.
+GBitmap *host_frame_buffer(void);
+
+// Draws `layer` and its children into the frame buffer as they are, without redrawing the window
+// around them.
+void host_render_layer(Layer *layer);
@@ -0,0 +1,61 @@
+// Stand-ins for the scheduler and the flash metrics, for tests of modules that use them without
+// running the face. Tests of the whole face link the real scheduler.c and metrics.c instead.
+
+#include "host.h"
+#include "metrics.h"
+
+// Scheduler
+
+static SchedulerTask *s_tasks = NULL;
+static uint32_t s_now_ms = 0;
+
+void scheduler_schedule(SchedulerTask *task, uint32_t delay_ms, uint32_t slack_ms) {
+    scheduler_cancel(task);
+    task->deadline_ms = s_now_ms + delay_ms;
+    task->slack_ms = slack_ms;
+    task->is_scheduled = true;
+    task->next = s_tasks;
+    s_tasks = task;
+}
+
+void scheduler_cancel(SchedulerTask *task) {
+    for (SchedulerTask **link = &s_tasks; *link; link = &(*link)->next) {
+        if (*link == task) {
+            *link = task->next;
+            break;
+        }
+    }
+    task->is_scheduled = false;
+}
+
+void host_scheduler_run_due(uint32_t now_ms) {
+    s_now_ms = now_ms;
+    for (SchedulerTask *task = s_tasks; task;) {
+        SchedulerTask *next = task->next;
+        if ((int32_t)(now_ms - task->deadline_ms) >= 0) {
+            scheduler_cancel(task);
+            task->callback(task->context);
+            next = s_tasks; // The callback may have changed the list
+        }
+        task = next;
+    }
+}
+
+uint8_t host_scheduler_count(void) {
+    uint8_t count = 0;
+    for (SchedulerTask *task = s_tasks; task; task = task->next) {
+        count++;
+    }
+    return count;
+}
+
+// Metrics
+
+static uint32_t s_flash_bytes = 0;
+static uint32_t s_flash_naive_bytes = 0;
+
+void metrics_record_flash_write(uint32_t bytes) { s_flash_bytes += bytes; }
+void metrics_record_flash_naive(uint32_t bytes) { s_flash_naive_bytes += bytes; }
+
+uint32_t host_flash_bytes(void) { return s_flash_bytes; }
+uint32_t host_flash_naive_bytes(void) { return s_flash_naive_bytes; }
@@ -0,0 +1,422 @@
+// Host stand-in for the parts of the Pebble SDK the face uses. Persistent storage, the heap and
+// the clock are simulated in host.c, the UI, AppMessage and event services in ui.c; see host.h for
+// the test controls.
+//
+// Only what the face needs is here, with the SDK's names, types and values where the face depends
+// on them. Platforms are picked with -DPBL_PLATFORM_<NAME>, as the SDK's build does; without one
+// the modules see a rectangular black and white display.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Platforms
+
+#if defined(PBL_PLATFORM_BASALT)
+#define PBL_COLOR 1
+#define PBL_RECT 1
+#define PBL_DISPLAY_WIDTH 144
+#define PBL_DISPLAY_HEIGHT 168
+#elif defined(PBL_PLATFORM_CHALK)
+#define PBL_COLOR 1
+#define PBL_ROUND 1
+#define PBL_DISPLAY_WIDTH 180
+#define PBL_DISPLAY_HEIGHT 180
+#elif defined(PBL_PLATFORM_EMERY)
+#define PBL_COLOR 1
+#define PBL_RECT 1
+#define PBL_DISPLAY_WIDTH 200
+#define PBL_DISPLAY_HEIGHT 228
+#else // Aplite, diorite and flint
+#define PBL_BW 1
+#define PBL_RECT 1
+#define PBL_DISPLAY_WIDTH 144
+#define PBL_DISPLAY_HEIGHT 168
+#endif
+
+#ifdef PBL_COLOR
+#define PBL_IF_COLOR_ELSE(if_true, if_false) (if_true)
+#else
+#define PBL_IF_COLOR_ELSE(if_true, if_false) (if_false)
+#endif
+#ifdef PBL_ROUND
+#define PBL_IF_ROUND_ELSE(if_true, if_false) (if_true)
+#else
+#define PBL_IF_ROUND_ELSE(if_true, if_false) (if_false)
+#endif
+
+// Status codes, as in the SDK
+typedef enum {
+    S_SUCCESS = 0,
+    E_DOES_NOT_EXIST = -9,
+} StatusCode;
+
+// Time. time() reads the host clock, which tests can set and advance, see host.h.
+
+time_t host_time(time_t *tloc);
+#define time(tloc) host_time(tloc)
+
+uint16_t time_ms(time_t *tloc, uint16_t *out_ms);
+time_t time_start_of_today(void);
+bool clock_is_24h_style(void);
+
+// Persistent storage
+
+#define PERSIST_DATA_MAX_LENGTH 256
+
+bool persist_exists(const uint32_t key);
+int persist_get_size(const uint32_t key);
+int32_t persist_read_int(const uint32_t key);
+int persist_read_data(const uint32_t key, void *buffer, const size_t buffer_size);
+int persist_write_int(const uint32_t key, const int32_t value);
+int persist_write_data(const uint32_t key, const void *data, const size_t size);
+int persist_delete(const uint32_t key);
+
+// Heap
+
+size_t heap_bytes_free(void);
+size_t heap_bytes_used(void);
+
+// Logging. Lines go to the file set with host_log_to(), if any.
+
+typedef enum {
+    APP_LOG_LEVEL_ERROR = 1,
+    APP_LOG_LEVEL_WARNING = 50,
+    APP_LOG_LEVEL_INFO = 100,
+    APP_LOG_LEVEL_DEBUG = 200,
+    APP_LOG_LEVEL_DEBUG_VERBOSE = 255,
+} AppLogLevel;
+
+void app_log(uint8_t log_level, const char *src_filename, int src_line_number, const char *fmt,
+             ...) __attribute__((format(printf, 4, 5)));
+#define APP_LOG(level, fmt, ...) app_log(level, __FILE__, __LINE__, fmt, ##__VA_ARGS__)
+
+// Geometry and color
+
+typedef struct {
+    int16_t x, y;
+} GPoint;
+
+typedef struct {
+    int16_t w, h;
+} GSize;
+
+typedef struct {
+    GPoint origin;
+    GSize size;
+} GRect;
+
+#define GPoint(x, y) ((GPoint){(x), (y)})
+#define GSize(w, h) ((GSize){(w), (h)})
+#define GRect(x, y, w, h) ((GRect){{(x), (y)}, {(w), (h)}})
+#define GPointZero GPoint(0, 0)
+
+GRect grect_inset(GRect rect, int16_t inset);
+bool grect_contains_point(const GRect *rect, const GPoint *point);
+
+// 2 bits each of alpha, red, green and blue
+typedef union {
+    uint8_t argb;
+} GColor8;
+typedef GColor8 GColor;
+
+#define GColorClear ((GColor8){.argb = 0x00})
+#define GColorBlack ((GColor8){.argb = 0xC0})
+#define GColorWhite ((GColor8){.argb = 0xFF})
+#define GColorLightGray ((GColor8){.argb = 0xEA})
+#define GColorDarkGray ((GColor8){.argb = 0xD5})
+#define GColorRed ((GColor8){.argb = 0xF0})
+#define GColorOrange ((GColor8){.argb = 0xF4})
+#define GColorBlue ((GColor8){.argb = 0xC3})
+#define GColorCeleste ((GColor8){.argb = 0xEF})
+#define GColorPictonBlue ((GColor8){.argb = 0xDB})
+#define gcolor_equal(a, b) ((a).argb == (b).argb)
+
+typedef enum {
+    GTextAlignmentLeft,
+    GTextAlignmentCenter,
+    GTextAlignmentRight,
+} GTextAlignment;
+
+typedef enum {
+    GTextOverflowModeWordWrap,
+    GTextOverflowModeTrailingEllipsis,
+    GTextOverflowModeFill,
+} GTextOverflowMode;
+
+typedef enum {
+    GCompOpAssign,
+    GCompOpAssignInverted,
+    GCompOpOr,
+    GCompOpAnd,
+    GCompOpClear,
+    GCompOpSet,
+} GCompOp;
+
+typedef enum {
+    GCornerNone = 0,
+    GCornersAll = 15,
+} GCornerMask;
+
+// Bitmaps
+
+typedef enum {
+    GBitmapFormat1Bit,
+    GBitmapFormat8Bit,
+    GBitmapFormat1BitPalette,
+    GBitmapFormat2BitPalette,
+    GBitmapFormat4BitPalette,
+    GBitmapFormat8BitCircular,
+} GBitmapFormat;
+
+typedef struct GBitmap GBitmap;
+
+typedef struct {
+    uint8_t *data; // Byte of column 0 of the row
+    int16_t min_x; // First and last column of the row on the display
+    int16_t max_x;
+} GBitmapDataRowInfo;
+
+// Trend arrows, as generated from package.json on the watch
+#define RESOURCE_ID_ARROW_UP_DOUBLE 1
+#define RESOURCE_ID_ARROW_UP 2
+#define RESOURCE_ID_ARROW_UP_SLANT 3
+#define RESOURCE_ID_ARROW_FLAT 4
+#define RESOURCE_ID_ARROW_DOWN_SLANT 5
+#define RESOURCE_ID_ARROW_DOWN 6
+#define RESOURCE_ID_ARROW_DOWN_DOUBLE 7
+
+GBitmap *gbitmap_create_with_resource(uint32_t resource_id);
+GBitmap *gbitmap_create_blank(GSize size, GBitmapFormat format);
+void gbitmap_destroy(GBitmap *bitmap);
+uint8_t *gbitmap_get_data(const GBitmap *bitmap);
+uint16_t gbitmap_get_bytes_per_row(const GBitmap *bitmap);
+GBitmapFormat gbitmap_get_format(const GBitmap *bitmap);
+GRect gbitmap_get_bounds(const GBitmap *bitmap);
+GBitmapDataRowInfo gbitmap_get_data_row_info(const GBitmap *bitmap, uint16_t y);
+
+// Drawing
+
+typedef struct GContext GContext;
+typedef struct FontInfo *GFont;
+
+#define FONT_KEY_BITHAM_42_BOLD "RESOURCE_ID_BITHAM_42_BOLD"
+#define FONT_KEY_BITHAM_34_MEDIUM_NUMBERS "RESOURCE_ID_BITHAM_34_MEDIUM_NUMBERS"
+#define FONT_KEY_ROBOTO_BOLD_SUBSET_49 "RESOURCE_ID_ROBOTO_BOLD_SUBSET_49"
+#define FONT_KEY_GOTHIC_14 "RESOURCE_ID_GOTHIC_14"
+#define FONT_KEY_GOTHIC_18 "RESOURCE_ID_GOTHIC_18"
+#define FONT_KEY_GOTHIC_18_BOLD "RESOURCE_ID_GOTHIC_18_BOLD"
+#define FONT_KEY_GOTHIC_24_BOLD "RESOURCE_ID_GOTHIC_24_BOLD"
+
+GFont fonts_get_system_font(const char *font_key);
+
+void graphics_context_set_fill_color(GContext *ctx, GColor color);
+void graphics_context_set_stroke_color(GContext *ctx, GColor color);
+void graphics_context_set_text_color(GContext *ctx, GColor color);
+void graphics_fill_rect(GContext *ctx, GRect rect, uint16_t corner_radius,
+                        GCornerMask corner_mask);
+void graphics_draw_pixel(GContext *ctx, GPoint point);
+void graphics_draw_line(GContext *ctx, GPoint p0, GPoint p1);
+void graphics_draw_text(GContext *ctx, const char *text, const GFont font, const GRect box,
+                        const GTextOverflowMode overflow_mode, const GTextAlignment alignment,
+                        void *text_attributes);
+GBitmap *graphics_capture_frame_buffer(GContext *ctx);
+bool graphics_release_frame_buffer(GContext *ctx, GBitmap *buffer);
+
+// Layers
+
+typedef struct Layer Layer;
+typedef struct TextLayer TextLayer;
+typedef struct BitmapLayer BitmapLayer;
+
+typedef void (*LayerUpdateProc)(Layer *layer, GContext *ctx);
+
+Layer *layer_create(GRect frame);
+Layer *layer_create_with_data(GRect frame, size_t data_size);
+void layer_destroy(Layer *layer);
+void *layer_get_data(const Layer *layer);
+void layer_set_update_proc(Layer *layer, LayerUpdateProc update_proc);
+void layer_mark_dirty(Layer *layer);
+void layer_add_child(Layer *parent, Layer *child);
+void layer_remove_from_parent(Layer *child);
+GRect layer_get_frame(const Layer *layer);
+void layer_set_frame(Layer *layer, GRect frame);
+GRect layer_get_bounds(const Layer *layer);
+void layer_set_hidden(Layer *layer, bool hidden);
+bool layer_get_hidden(const Layer *layer);
+GPoint layer_convert_point_to_screen(const Layer *layer, GPoint point);
+
+TextLayer *text_layer_create(GRect frame);
+void text_layer_destroy(TextLayer *text_layer);
+Layer *text_layer_get_layer(TextLayer *text_layer);
+void text_layer_set_text(TextLayer *text_layer, const char *text);
+void text_layer_set_background_color(TextLayer *text_layer, GColor color);
+void text_layer_set_text_color(TextLayer *text_layer, GColor color);
+void text_layer_set_font(TextLayer *text_layer, GFont font);
+void text_layer_set_text_alignment(TextLayer *text_layer, GTextAlignment text_alignment);
+GSize text_layer_get_content_size(TextLayer *text_layer);
+
+BitmapLayer *bitmap_layer_create(GRect frame);
+void bitmap_layer_destroy(BitmapLayer *bitmap_layer);
+Layer *bitmap_layer_get_layer(const BitmapLayer *bitmap_layer);
+void bitmap_layer_set_bitmap(BitmapLayer *bitmap_layer, const GBitmap *bitmap);
+void bitmap_layer_set_compositing_mode(BitmapLayer *bitmap_layer, GCompOp mode);
+
+// Windows
+
+typedef struct Window Window;
+typedef void (*WindowHandler)(Window *window);
+
+typedef struct {
+    WindowHandler load;
+    WindowHandler appear;
+    WindowHandler disappear;
+    WindowHandler unload;
+} WindowHandlers;
+
+Window *window_create(void);
+void window_destroy(Window *window);
+void window_set_window_handlers(Window *window, WindowHandlers handlers);
+Layer *window_get_root_layer(const Window *window);
+void window_set_user_data(Window *window, void *data);
+void *window_get_user_data(const Window *window);
+void window_stack_push(Window *window, bool animated);
+bool window_stack_remove(Window *window, bool animated);
+
+// Runs the app's events until the test is done with it, see host_app_run().
+void app_event_loop(void);
+
+// Dictionaries and AppMessage
+
+typedef enum {
+    TUPLE_BYTE_ARRAY = 0,
+    TUPLE_CSTRING = 1,
+    TUPLE_UINT = 2,
+    TUPLE_INT = 3,
+} TupleType;
+
+typedef struct __attribute__((packed)) {
+    uint32_t key;
+    TupleType type : 8;
+    uint16_t length;
+    union {
+        uint8_t data[0];
+        char cstring[0];
+        uint8_t uint8;
+        uint16_t uint16;
+        uint32_t uint32;
+        int8_t int8;
+        int16_t int16;
+        int32_t int32;
+    } value[];
+} Tuple;
+
+// A message being written or read: a tuple count byte, then the tuples
+typedef struct {
+    uint8_t *buffer;
+    size_t size;   // Room in `buffer` [bytes]
+    size_t length; // Bytes written so far
+    Tuple *cursor; // Next tuple to read
+} DictionaryIterator;
+
+typedef enum {
+    DICT_OK = 0,
+    DICT_NOT_ENOUGH_STORAGE = 2,
+} DictionaryResult;
+
+Tuple *dict_read_first(DictionaryIterator *iter);
+Tuple *dict_read_next(DictionaryIterator *iter);
+Tuple *dict_find(const DictionaryIterator *iter, const uint32_t key);
+uint32_t dict_size(DictionaryIterator *iter);
+DictionaryResult dict_write_data(DictionaryIterator *iter, const uint32_t key,
+                                 const uint8_t *data, const uint16_t size);
+DictionaryResult dict_write_cstring(DictionaryIterator *iter, const uint32_t key,
+                                    const char *cstring);
+DictionaryResult dict_write_int(DictionaryIterator *iter, const uint32_t key, const void *integer,
+                                const uint8_t width_bytes, const bool is_signed);
+
+typedef enum {
+    APP_MSG_OK = 0,
+    APP_MSG_SEND_TIMEOUT = 2,
+    APP_MSG_NOT_CONNECTED = 8,
+    APP_MSG_BUSY = 64,
+    APP_MSG_BUFFER_OVERFLOW = 128,
+} AppMessageResult;
+
+typedef void (*AppMessageInboxReceived)(DictionaryIterator *iterator, void *context);
+typedef void (*AppMessageInboxDropped)(AppMessageResult reason, void *context);
+
+AppMessageResult app_message_open(const uint32_t size_inbound, const uint32_t size_outbound);
+AppMessageInboxReceived app_message_register_inbox_received(AppMessageInboxReceived handler);
+AppMessageInboxDropped app_message_register_inbox_dropped(AppMessageInboxDropped handler);
+void app_message_deregister_callbacks(void);
+AppMessageResult app_message_outbox_begin(DictionaryIterator **iterator);
+AppMessageResult app_message_outbox_send(void);
+
+// Timers and event services
+
+typedef enum {
+    SECOND_UNIT = 1 << 0,
+    MINUTE_UNIT = 1 << 1,
+    HOUR_UNIT = 1 << 2,
+    DAY_UNIT = 1 << 3,
+    MONTH_UNIT = 1 << 4,
+    YEAR_UNIT = 1 << 5,
+} TimeUnits;
+
+typedef void (*TickHandler)(struct tm *tick_time, TimeUnits units_changed);
+
+void tick_timer_service_subscribe(TimeUnits tick_units, TickHandler handler);
+void tick_timer_service_unsubscribe(void);
+
+typedef struct AppTimer AppTimer;
+typedef void (*AppTimerCallback)(void *data);
+
+AppTimer *app_timer_register(uint32_t timeout_ms, AppTimerCallback callback, void *callback_data);
+bool app_timer_reschedule(AppTimer *timer_handle, uint32_t new_timeout_ms);
+void app_timer_cancel(AppTimer *timer_handle);
+
+typedef void (*ConnectionHandler)(bool connected);
+
+typedef struct {
+    ConnectionHandler pebble_app_connection_handler;
+    ConnectionHandler pebblekit_connection_handler;
+} ConnectionHandlers;
+
+void connection_service_subscribe(ConnectionHandlers conn_handlers);
+void connection_service_unsubscribe(void);
+bool connection_service_peek_pebble_app_connection(void);
+
+typedef struct {
+    uint8_t charge_percent;
+    bool is_charging;
+    bool is_plugged;
+} BatteryChargeState;
+
+typedef void (*BatteryStateHandler)(BatteryChargeState charge);
+
+void battery_state_service_subscribe(BatteryStateHandler handler);
+void battery_state_service_unsubscribe(void);
+BatteryChargeState battery_state_service_peek(void);
+
+typedef enum {
+    ACCEL_AXIS_X = 0,
+    ACCEL_AXIS_Y = 1,
+    ACCEL_AXIS_Z = 2,
+} AccelAxisType;
+
+typedef void (*AccelTapHandler)(AccelAxisType axis, int32_t direction);
+
+void accel_tap_service_subscribe(AccelTapHandler handler);
+void accel_tap_service_unsubscribe(void);
+
+bool quiet_time_is_active(void);
+
+void vibes_short_pulse(void);
+void vibes_double_pulse(void);
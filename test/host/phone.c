@@ -0,0 +1,373 @@
+#include "phone.h"
+#include "history_batch.h"
+#include "xdrip.h"
+
+#define DEFAULT_INBOX_SIZE 256 // Watchfaces that don't announce their inbox size
+
+// Dictionary overhead [bytes], see dict_calc_buffer_size(): a count, and a header per tuple
+#define DICT_HEADER_SIZE 1
+#define TUPLE_HEADER_SIZE 7
+
+#define MAX_INBOX_SIZE 1024 // Largest inbox the phone sizes batches for
+#define MAX_SLOTS 0xFFFF
+#define NUMBER_SIZE 4 // Pebble.sendAppMessage() sends numbers as int32
+
+static Phone s_local_phone;
+static Phone *s_phone = &s_local_phone;
+
+// History batches, as src/pkjs/history_batch.js encodes them
+
+typedef struct {
+    uint16_t slot;
+    uint16_t mgdl;
+} Slotted;
+
+static Slotted s_slotted[PHONE_MAX_PENDING];
+static uint8_t s_encoded[10 + (MAX_SLOTS + 7) / 8 + 3 * PHONE_MAX_PENDING];
+
+// Slot of `timestamp` after `base`, rounded to the nearest one
+static uint32_t slot_of(uint32_t timestamp, uint32_t base, uint32_t interval_seconds) {
+    return (timestamp - base + interval_seconds / 2) / interval_seconds;
+}
+
+// Puts readings in slots, keeping the newest reading of a slot. Returns the number of slots used.
+static size_t to_slots(const PhoneReading *readings, size_t count, uint32_t interval_seconds) {
+    size_t used = 0;
+    for (size_t i = 0; i < count; i++) {
+        const uint16_t slot = slot_of(readings[i].timestamp, readings[0].timestamp,
+                                      interval_seconds);
+        if (used > 0 && s_slotted[used - 1].slot == slot) {
+            s_slotted[used - 1].mgdl = readings[i].mgdl;
+        } else {
+            s_slotted[used++] = (Slotted){slot, readings[i].mgdl};
+        }
+    }
+    return used;
+}
+
+// Encodes the `used` slots into s_encoded. Returns the length [bytes].
+static size_t encode(size_t used, uint32_t base, uint8_t interval_minutes) {
+    const uint16_t slot_count = s_slotted[used - 1].slot + 1;
+    const size_t bitmap_size = (slot_count + 7) / 8;
+    uint8_t *out = s_encoded;
+    *out++ = HISTORY_BATCH_VERSION;
+    *out++ = interval_minutes;
+    *out++ = slot_count;
+    *out++ = slot_count >> 8;
+    for (int shift = 0; shift < 32; shift += 8) {
+        *out++ = base >> shift;
+    }
+    *out++ = s_slotted[0].mgdl;
+    *out++ = s_slotted[0].mgdl >> 8;
+    uint8_t *bitmap = out;
+    memset(bitmap, 0, bitmap_size);
+    out += bitmap_size;
+    for (size_t i = 0; i < used; i++) {
+        bitmap[s_slotted[i].slot >> 3] |= 1 << (s_slotted[i].slot & 7);
+        if (i == 0) {
+            continue;
+        }
+        const int delta = s_slotted[i].mgdl - s_slotted[i - 1].mgdl;
+        if (delta > HISTORY_BATCH_ESCAPE && delta <= 127) {
+            *out++ = (uint8_t)delta;
+        } else {
+            *out++ = (uint8_t)HISTORY_BATCH_ESCAPE;
+            *out++ = s_slotted[i].mgdl;
+            *out++ = s_slotted[i].mgdl >> 8;
+        }
+    }
+    return out - s_encoded;
+}
+
+// Encodes the first batch of at most `max_bytes` of `readings` into `batch`. Returns the number of
+// readings it covers, and sets `length`.
+static size_t encode_batch(const PhoneReading *readings, size_t count, uint8_t interval_minutes,
+                           size_t max_bytes, uint8_t *batch, uint16_t *length) {
+    const uint32_t interval_seconds = interval_minutes * 60;
+    const uint32_t base = readings[0].timestamp;
+    *length = encode(to_slots(readings, 1, interval_seconds), base, interval_minutes);
+    memcpy(batch, s_encoded, *length);
+    size_t end = 1;
+    for (; end < count; end++) {
+        if (slot_of(readings[end].timestamp, base, interval_seconds) >= MAX_SLOTS) {
+            break;
+        }
+        const size_t grown = encode(to_slots(readings, end + 1, interval_seconds), base,
+                                    interval_minutes);
+        if (grown > max_bytes) {
+            break;
+        }
+        *length = grown;
+        memcpy(batch, s_encoded, grown);
+    }
+    return end;
+}
+
+// Slot interval for batching the pending readings [minutes]: their median spacing
+static uint8_t interval_minutes(void) {
+    static uint32_t s_spacings[PHONE_MAX_PENDING];
+    const size_t count = s_phone->pending_count > 0 ? s_phone->pending_count - 1 : 0;
+    for (size_t i = 0; i < count; i++) {
+        // Insertion sort, as there are at most a day of readings
+        const uint32_t spacing =
+            s_phone->pending[i + 1].timestamp - s_phone->pending[i].timestamp;
+        size_t j = i;
+        for (; j > 0 && s_spacings[j - 1] > spacing; j--) {
+            s_spacings[j] = s_spacings[j - 1];
+        }
+        s_spacings[j] = spacing;
+    }
+    const uint32_t median = count > 0 ? s_spacings[count >> 1] : 5 * 60;
+    const uint32_t minutes = (median + 30) / 60;
+    return minutes < 1 ? 1 : minutes > 255 ? 255 : minutes;
+}
+
+// Messages, as src/pkjs/send_queue.js builds them
+
+typedef struct {
+    uint8_t batch[MAX_INBOX_SIZE];
+    uint16_t batch_length;   // 0 if the message has no batch
+    uint16_t batch_count;    // Pending readings the batch delivers
+    uint32_t newest_pending; // Timestamp of the newest pending reading the batch delivers
+    bool has_latest;
+} Message;
+
+static Message s_messages[PHONE_MAX_PENDING + 1];
+
+static bool has(uint32_t capability) { return s_phone->capabilities & capability; }
+
+// Size of the data message of the latest reading, without the dictionary header
+static size_t latest_size(void) {
+    char bg[8], delta[8];
+    snprintf(bg, sizeof(bg), "%u", s_phone->latest.mgdl);
+    snprintf(delta, sizeof(delta), "%+d", s_phone->latest.delta);
+    size_t size = 2 * TUPLE_HEADER_SIZE + NUMBER_SIZE + strlen(bg) + 1;
+    if (has(XDRIP_CAP_DELTA)) {
+        size += TUPLE_HEADER_SIZE + strlen(delta) + 1;
+    }
+    if (has(XDRIP_CAP_TREND_ARROW)) {
+        size += TUPLE_HEADER_SIZE + NUMBER_SIZE;
+    }
+    if (has(XDRIP_CAP_LOOP)) {
+        size += 2 * TUPLE_HEADER_SIZE + strlen(s_phone->iob) + strlen(s_phone->cob) + 2;
+    }
+    if (has(XDRIP_CAP_EXTENDED)) {
+        size += 2 * TUPLE_HEADER_SIZE + strlen(s_phone->sensor_age) + 1 + NUMBER_SIZE;
+    }
+    return size;
+}
+
+static void write_number(DictionaryIterator *iter, uint32_t key, int32_t value) {
+    dict_write_int(iter, key, &value, NUMBER_SIZE, true);
+}
+
+static void write_latest(DictionaryIterator *iter) {
+    char bg[8], delta[8];
+    snprintf(bg, sizeof(bg), "%u", s_phone->latest.mgdl);
+    snprintf(delta, sizeof(delta), "%+d", s_phone->latest.delta);
+    write_number(iter, XDRIP_KEY_BG_TIMESTAMP, s_phone->latest.timestamp);
+    dict_write_cstring(iter, XDRIP_KEY_BG_STRING, bg);
+    if (has(XDRIP_CAP_DELTA)) {
+        dict_write_cstring(iter, XDRIP_KEY_DELTA_STRING, delta);
+    }
+    if (has(XDRIP_CAP_TREND_ARROW)) {
+        write_number(iter, XDRIP_KEY_ARROW_INDEX, s_phone->latest.arrow_index);
+    }
+    if (has(XDRIP_CAP_LOOP)) {
+        dict_write_cstring(iter, XDRIP_KEY_IOB_STRING, s_phone->iob);
+        dict_write_cstring(iter, XDRIP_KEY_COB_STRING, s_phone->cob);
+    }
+    if (has(XDRIP_CAP_EXTENDED)) {
+        dict_write_cstring(iter, XDRIP_KEY_SENSOR_AGE_STRING, s_phone->sensor_age);
+        write_number(iter, XDRIP_KEY_PHONE_BATTERY, s_phone->battery);
+    }
+}
+
+// Builds the messages for what is queued, oldest first. Returns their number.
+static size_t build_messages(void) {
+    size_t count = 0;
+    if (s_phone->pending_count > 0 && s_phone->announcements > 0) {
+        if (has(XDRIP_CAP_HISTORY)) {
+            const size_t max_bytes = s_phone->inbox_size - DICT_HEADER_SIZE - TUPLE_HEADER_SIZE;
+            const uint8_t interval = interval_minutes();
+            for (size_t start = 0; start < s_phone->pending_count;) {
+                Message *message = &s_messages[count++];
+                message->batch_count =
+                    encode_batch(&s_phone->pending[start], s_phone->pending_count - start,
+                                 interval, max_bytes, message->batch, &message->batch_length);
+                start += message->batch_count;
+                message->newest_pending = s_phone->pending[start - 1].timestamp;
+                message->has_latest = false;
+            }
+        } else if (!s_phone->takes_history) {
+            s_phone->pending_count = 0; // Never wanted
+        }
+    }
+
+    if (s_phone->has_latest) {
+        Message *last = count > 0 ? &s_messages[count - 1] : NULL;
+        if (last && DICT_HEADER_SIZE + TUPLE_HEADER_SIZE + last->batch_length + latest_size() <=
+                        s_phone->inbox_size) {
+            last->has_latest = true;
+        } else {
+            s_messages[count++] = (Message){.has_latest = true};
+        }
+    }
+    return count;
+}
+
+static void mark_delivered(const Message *message) {
+    const PhoneReading latest = s_phone->latest;
+    if (message->has_latest) {
+        if (latest.timestamp > s_phone->delivered.timestamp) {
+            s_phone->delivered = latest;
+        }
+        s_phone->has_latest = false;
+    }
+    uint16_t kept = 0;
+    for (uint16_t i = 0; i < s_phone->pending_count; i++) {
+        const PhoneReading *reading = &s_phone->pending[i];
+        if (reading->timestamp > message->newest_pending &&
+            !(message->has_latest && reading->timestamp == latest.timestamp)) {
+            s_phone->pending[kept++] = *reading;
+        }
+    }
+    s_phone->pending_count = kept;
+}
+
+static bool send(const Message *message) {
+    DictionaryIterator *iter = host_inbox_begin();
+    if (message->batch_length > 0) {
+        dict_write_data(iter, XDRIP_KEY_HISTORY_BATCH, message->batch, message->batch_length);
+    }
+    if (message->has_latest) {
+        write_latest(iter);
+    }
+    const uint32_t bytes = dict_size(iter);
+    if (host_inbox_deliver() != APP_MSG_OK) {
+        s_phone->totals.failed++;
+        return false;
+    }
+    PhoneTotals *totals = &s_phone->totals;
+    totals->messages++;
+    totals->bytes += bytes;
+    if (message->has_latest) {
+        totals->readings++;
+    }
+    if (message->batch_length > 0) {
+        totals->batches++;
+        totals->batch_readings += message->batch_count;
+    }
+    return true;
+}
+
+// Sends what is queued, one message at a time, while the watch is reachable
+static void flush(void) {
+    while (!s_phone->is_sending && s_phone->is_connected) {
+        const size_t count = build_messages();
+        if (count == 0) {
+            return;
+        }
+        s_phone->is_sending = true;
+        for (size_t i = 0; i < count; i++) {
+            if (!send(&s_messages[i])) {
+                s_phone->is_sending = false;
+                s_phone->is_connected = false;
+                return;
+            }
+            mark_delivered(&s_messages[i]);
+        }
+        s_phone->is_sending = false; // Then send readings pushed while sending
+    }
+}
+
+// The watch
+
+static uint32_t read_uint(const Tuple *tuple) {
+    uint32_t value = 0;
+    const size_t length = tuple->length < sizeof(value) ? tuple->length : sizeof(value);
+    memcpy(&value, tuple->value->data, length);
+    return value;
+}
+
+// Handles the watchface's messages. Only the capability announcement needs an answer.
+static void on_message(DictionaryIterator *message) {
+    const Tuple *capabilities = dict_find(message, XDRIP_KEY_CAPABILITIES);
+    if (!capabilities) {
+        return;
+    }
+    const Tuple *version = dict_find(message, XDRIP_KEY_PROTOCOL_VERSION);
+    const Tuple *inbox_size = dict_find(message, XDRIP_KEY_INBOX_SIZE);
+    s_phone->announcements++;
+    s_phone->protocol_version = version ? read_uint(version) : 0;
+    s_phone->capabilities = read_uint(capabilities);
+    s_phone->inbox_size = inbox_size ? read_uint(inbox_size) : DEFAULT_INBOX_SIZE;
+    CHECK(s_phone->inbox_size <= MAX_INBOX_SIZE);
+    // Watchfaces that take history batches announce their inbox size to size them by, and ask for
+    // them while their history has a gap. Older ones do neither.
+    if (inbox_size || (s_phone->capabilities & XDRIP_CAP_HISTORY)) {
+        s_phone->takes_history = true;
+    }
+    // xDrip answers with its newest reading, even if the watchface has it already
+    if (!s_phone->has_latest && s_phone->delivered.timestamp > 0) {
+        s_phone->latest = s_phone->delivered;
+        s_phone->has_latest = true;
+    }
+    s_phone->is_connected = true;
+    flush();
+}
+
+void phone_use(Phone *phone) {
+    s_phone = phone;
+    // A message in flight when the watch stopped was never acknowledged, and is sent again
+    s_phone->is_sending = false;
+    host_set_phone(on_message);
+}
+
+void phone_reset(void) {
+    *s_phone = (Phone){.inbox_size = DEFAULT_INBOX_SIZE, .is_connected = true,
+                       .battery = 100};
+    strcpy(s_phone->iob, "0.00U");
+    strcpy(s_phone->cob, "0g");
+    strcpy(s_phone->sensor_age, "1d 0h");
+}
+
+static void insert_pending(const PhoneReading *reading) {
+    uint16_t index = s_phone->pending_count;
+    while (index > 0 && s_phone->pending[index - 1].timestamp > reading->timestamp) {
+        index--;
+    }
+    if (index > 0 && s_phone->pending[index - 1].timestamp == reading->timestamp) {
+        return;
+    }
+    if (s_phone->pending_count == PHONE_MAX_PENDING) {
+        if (index == 0) {
+            return; // Older than what is kept
+        }
+        memmove(&s_phone->pending[0], &s_phone->pending[1],
+                (--index) * sizeof(PhoneReading));
+    } else {
+        memmove(&s_phone->pending[index + 1], &s_phone->pending[index],
+                (s_phone->pending_count++ - index) * sizeof(PhoneReading));
+    }
+    s_phone->pending[index] = *reading;
+}
+
+void phone_push(const PhoneReading *pushed) {
+    PhoneReading reading = *pushed;
+    reading.delta = s_phone->previous_mgdl > 0 ? reading.mgdl - s_phone->previous_mgdl : 0;
+    s_phone->previous_mgdl = reading.mgdl;
+    if (reading.timestamp <= s_phone->delivered.timestamp) {
+        return;
+    }
+    if (!s_phone->has_latest || reading.timestamp > s_phone->latest.timestamp) {
+        if (s_phone->has_latest) {
+            insert_pending(&s_phone->latest);
+        }
+        s_phone->latest = reading;
+        s_phone->has_latest = true;
+    } else if (reading.timestamp < s_phone->latest.timestamp) {
+        insert_pending(&reading);
+    }
+    flush();
+}
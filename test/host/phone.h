@@ -0,0 +1,67 @@
+// Reference phone for the tests that run the whole face: speaks the xDrip-Pebble protocol (see
+// src/c/xdrip.h) through the AppMessage stand-in in ui.c.
+//
+// Readings are queued the way src/pkjs/send_queue.js does: only the newest one goes as a data
+// message, the ones it supersedes before reaching the watch wait for history batches, sized to the
+// announced inbox, until the watchface asks for them. Like xDrip, the phone answers each
+// announcement with the newest reading, even if the watch already has it, and only sends the
+// fields the announced capabilities ask for. A send that fails, as the watch is out of range or
+// its inbox is full, holds everything back until the next announcement.
+
+#pragma once
+
+#include "host.h"
+
+#define PHONE_MAX_PENDING 288 // A day of readings; older ones are dropped
+
+typedef struct {
+    uint32_t timestamp; // Seconds since epoch
+    uint16_t mgdl;
+    uint8_t arrow_index;
+    int16_t delta; // [mg/dL], from the reading pushed before, set by phone_push()
+} PhoneReading;
+
+// Messages and bytes (dictionary sizes) delivered to the watch
+typedef struct {
+    uint32_t messages, bytes;
+    uint32_t readings; // Data messages
+    uint32_t batches;  // History batches
+    uint32_t batch_readings;
+    uint32_t failed; // Sends that didn't reach the watch
+} PhoneTotals;
+
+// State of the phone. Plain data, so a test can keep it in memory shared with the runs of the face.
+typedef struct {
+    // From the watch's last announcement
+    uint32_t announcements;
+    uint8_t protocol_version;
+    uint32_t capabilities; // XDRIP_CAP_* bits
+    uint16_t inbox_size;
+    bool takes_history; // Announced an inbox size or asked for history once
+
+    // The queue
+    bool has_latest;
+    PhoneReading latest;       // Newest reading not delivered yet
+    PhoneReading delivered;    // Newest delivered one, timestamp 0 if none
+    PhoneReading pending[PHONE_MAX_PENDING]; // Older readings not delivered yet, oldest first
+    uint16_t pending_count;
+    bool is_connected; // Until a send fails
+    bool is_sending;
+
+    // Sent with a reading, where the capabilities ask for them
+    char iob[8], cob[8];
+    char sensor_age[8];
+    uint8_t battery;
+    uint16_t previous_mgdl; // Of the reading pushed before, for the delta
+
+    PhoneTotals totals;
+} Phone;
+
+// Makes the phone answer the watch with `phone`, which starts connected and without readings
+// once cleared with phone_reset(). Call again for each run of the face: a run that ended in the
+// middle of a send leaves the message undelivered.
+void phone_use(Phone *phone);
+void phone_reset(void);
+
+// Queues a reading, and sends what is queued if the watch is reachable.
+void phone_push(const PhoneReading *reading);
@@ -0,0 +1,1005 @@
+// Host stand-in for the UI, AppMessage and event services of the Pebble SDK, so tests can run the
+// whole face: windows, layers and bitmaps are allocated on the heap like on the watch, so
+// host_heap_in_use() sees them; layers draw into a frame buffer; and events come from a simulated
+// clock and from the test.
+//
+// Drawing is approximate. Text is drawn as a pattern of pixels filling each character's cell, and
+// bitmaps from resources are patterns of their size. What is exact is which pixels each call may
+// write, so the frame buffer can be checked for what a layer wrote and where.
+
+#include "host.h"
+
+// Objects
+
+struct FontInfo {
+    uint8_t height; // [pixels]
+};
+
+struct GBitmap {
+    GSize size;
+    GBitmapFormat format;
+    uint16_t bytes_per_row;
+    uint8_t *data;
+    bool is_frame_buffer; // Not allocated by the app
+};
+
+struct Layer {
+    GRect frame;
+    GRect bounds;
+    bool hidden;
+    LayerUpdateProc update_proc;
+    Layer *parent;
+    Layer *first_child;
+    Layer *next_sibling;
+    void *data; // Of layer_create_with_data(), after the layer
+};
+
+struct TextLayer {
+    Layer layer;
+    const char *text;
+    GColor background_color;
+    GColor text_color;
+    GFont font;
+    GTextAlignment alignment;
+};
+
+struct BitmapLayer {
+    Layer layer;
+    const GBitmap *bitmap;
+    GCompOp compositing_mode;
+};
+
+struct Window {
+    Layer root_layer;
+    WindowHandlers handlers;
+    void *user_data;
+    bool is_loaded;
+    Window *below; // Next window down the stack, while on it
+};
+
+struct GContext {
+    GColor fill_color;
+    GColor stroke_color;
+    GColor text_color;
+    GPoint offset; // Screen position of the layer being drawn
+    GRect clip;    // Screen rect it may draw in
+};
+
+struct AppTimer {
+    uint64_t deadline_ms;
+    AppTimerCallback callback;
+    void *data;
+    bool is_used;
+};
+
+// State
+
+#ifdef PBL_COLOR
+#define FRAME_BUFFER_FORMAT GBitmapFormat8Bit
+#define FRAME_BUFFER_ROW_BYTES PBL_DISPLAY_WIDTH
+#else
+#define FRAME_BUFFER_FORMAT GBitmapFormat1Bit
+#define FRAME_BUFFER_ROW_BYTES ((PBL_DISPLAY_WIDTH + 31) / 32 * 4)
+#endif
+
+static uint8_t s_frame_buffer_data[PBL_DISPLAY_HEIGHT * FRAME_BUFFER_ROW_BYTES];
+static GBitmap s_frame_buffer = {
+    .size = {PBL_DISPLAY_WIDTH, PBL_DISPLAY_HEIGHT},
+    .format = FRAME_BUFFER_FORMAT,
+    .bytes_per_row = FRAME_BUFFER_ROW_BYTES,
+    .data = s_frame_buffer_data,
+    .is_frame_buffer = true,
+};
+static GContext s_context;
+
+static Window *s_top_window = NULL;
+static bool s_is_dirty = false;
+
+// Timers live in the system's memory, not the app heap
+#define TIMER_COUNT 8
+static AppTimer s_timers[TIMER_COUNT];
+
+static TimeUnits s_tick_units = 0;
+static TickHandler s_tick_handler = NULL;
+static ConnectionHandler s_connection_handler = NULL;
+static BatteryStateHandler s_battery_handler = NULL;
+static AccelTapHandler s_tap_handler = NULL;
+static bool s_connected = true;
+static BatteryChargeState s_battery = {.charge_percent = 100};
+static bool s_quiet_time = false;
+
+static AppMessageInboxReceived s_inbox_received = NULL;
+static AppMessageInboxDropped s_inbox_dropped = NULL;
+static uint8_t *s_inbox_buffer = NULL; // On the app heap, as app_message_open() allocates them
+static uint8_t *s_outbox_buffer = NULL;
+static uint32_t s_inbox_size = 0;
+static uint32_t s_outbox_size = 0;
+static DictionaryIterator s_outbox;
+static bool s_is_outbox_begun = false;
+static bool s_is_outbox_pending = false; // Sent, and not yet taken by the phone
+static uint8_t s_message_buffer[1024];  // Next message from the phone
+static DictionaryIterator s_message;
+static void (*s_phone)(DictionaryIterator *message) = NULL;
+
+static void (*s_events)(void) = NULL;
+static HostTraffic s_traffic;
+static HostCounters s_counters;
+
+// Drawing
+
+static bool rect_contains(GRect rect, int16_t x, int16_t y) {
+    return x >= rect.origin.x && x < rect.origin.x + rect.size.w && y >= rect.origin.y &&
+           y < rect.origin.y + rect.size.h;
+}
+
+static GRect rect_intersection(GRect a, GRect b) {
+    const int16_t x0 = a.origin.x > b.origin.x ? a.origin.x : b.origin.x;
+    const int16_t y0 = a.origin.y > b.origin.y ? a.origin.y : b.origin.y;
+    const int16_t ax1 = a.origin.x + a.size.w, bx1 = b.origin.x + b.size.w;
+    const int16_t ay1 = a.origin.y + a.size.h, by1 = b.origin.y + b.size.h;
+    const int16_t x1 = ax1 < bx1 ? ax1 : bx1;
+    const int16_t y1 = ay1 < by1 ? ay1 : by1;
+    return GRect(x0, y0, x1 > x0 ? x1 - x0 : 0, y1 > y0 ? y1 - y0 : 0);
+}
+
+static void write_pixel(int16_t x, int16_t y, GColor color) {
+    uint8_t *row = &s_frame_buffer_data[y * FRAME_BUFFER_ROW_BYTES];
+#ifdef PBL_COLOR
+    row[x] = color.argb;
+#else
+    if (gcolor_equal(color, GColorWhite)) {
+        row[x / 8] |= 1 << (x % 8);
+    } else {
+        row[x / 8] &= ~(1 << (x % 8));
+    }
+#endif
+}
+
+// Draws a pixel at `x`, `y` of the layer being drawn, if it's in the clip and not transparent.
+static void put_pixel(GContext *ctx, int16_t x, int16_t y, GColor color) {
+    x += ctx->offset.x;
+    y += ctx->offset.y;
+    if ((color.argb >> 6) == 0 || !rect_contains(ctx->clip, x, y)) {
+        return;
+    }
+    write_pixel(x, y, color);
+    s_counters.api_pixels++;
+}
+
+// `rect` [layer] on the screen, clipped
+static GRect on_screen(const GContext *ctx, GRect rect) {
+    rect.origin.x += ctx->offset.x;
+    rect.origin.y += ctx->offset.y;
+    return rect_intersection(rect, ctx->clip);
+}
+
+void graphics_context_set_fill_color(GContext *ctx, GColor color) { ctx->fill_color = color; }
+void graphics_context_set_stroke_color(GContext *ctx, GColor color) { ctx->stroke_color = color; }
+void graphics_context_set_text_color(GContext *ctx, GColor color) { ctx->text_color = color; }
+
+void graphics_fill_rect(GContext *ctx, GRect rect, uint16_t corner_radius,
+                        GCornerMask corner_mask) {
+    if ((ctx->fill_color.argb >> 6) == 0) {
+        return;
+    }
+    const GRect area = on_screen(ctx, rect);
+    for (int16_t y = area.origin.y; y < area.origin.y + area.size.h; y++) {
+        for (int16_t x = area.origin.x; x < area.origin.x + area.size.w; x++) {
+            write_pixel(x, y, ctx->fill_color);
+        }
+    }
+    s_counters.api_pixels += area.size.w * area.size.h;
+}
+
+void graphics_draw_pixel(GContext *ctx, GPoint point) {
+    put_pixel(ctx, point.x, point.y, ctx->stroke_color);
+}
+
+void graphics_draw_line(GContext *ctx, GPoint p0, GPoint p1) {
+    // Bresenham
+    const int dx = abs(p1.x - p0.x), dy = -abs(p1.y - p0.y);
+    const int sx = p0.x < p1.x ? 1 : -1, sy = p0.y < p1.y ? 1 : -1;
+    int error = dx + dy;
+    for (;;) {
+        put_pixel(ctx, p0.x, p0.y, ctx->stroke_color);
+        if (p0.x == p1.x && p0.y == p1.y) {
+            break;
+        }
+        if (2 * error >= dy) {
+            error += dy;
+            p0.x += sx;
+        }
+        if (2 * error <= dx) {
+            error += dx;
+            p0.y += sy;
+        }
+    }
+}
+
+static int16_t char_width(GFont font) { return font->height / 2; }
+
+static GSize text_size(const char *text, GFont font, GSize box) {
+    const int16_t width = strlen(text) * char_width(font);
+    return GSize(width < box.w ? width : box.w, text[0] ? font->height : 0);
+}
+
+void graphics_draw_text(GContext *ctx, const char *text, const GFont font, const GRect box,
+                        const GTextOverflowMode overflow_mode, const GTextAlignment alignment,
+                        void *text_attributes) {
+    const GSize size = text_size(text, font, box.size);
+    int16_t left = box.origin.x;
+    if (alignment == GTextAlignmentCenter) {
+        left += (box.size.w - size.w) / 2;
+    } else if (alignment == GTextAlignmentRight) {
+        left += box.size.w - size.w;
+    }
+    // Glyphs: every third pixel of the character cells, below the line gap at the top
+    const int16_t top = box.origin.y + font->height / 4;
+    const GRect cells = GRect(left, top, size.w, box.origin.y + size.h - top);
+    if ((ctx->text_color.argb >> 6) == 0) {
+        return;
+    }
+    const GRect area = on_screen(ctx, cells);
+    for (int16_t y = area.origin.y; y < area.origin.y + area.size.h; y++) {
+        for (int16_t x = area.origin.x; x < area.origin.x + area.size.w; x++) {
+            if ((x - ctx->offset.x + y - ctx->offset.y) % 3 == 0) {
+                write_pixel(x, y, ctx->text_color);
+                s_counters.api_pixels++;
+            }
+        }
+    }
+}
+
+GBitmap *graphics_capture_frame_buffer(GContext *ctx) { return &s_frame_buffer; }
+
+bool graphics_release_frame_buffer(GContext *ctx, GBitmap *buffer) {
+    return buffer == &s_frame_buffer;
+}
+
+GFont fonts_get_system_font(const char *font_key) {
+    // One font per height, which is the number in the key
+    static struct FontInfo s_fonts[64];
+    const char *digits = font_key + strcspn(font_key, "0123456789");
+    const int height = atoi(digits);
+    CHECK(height > 0 && height < 64);
+    s_fonts[height].height = height;
+    return &s_fonts[height];
+}
+
+GRect grect_inset(GRect rect, int16_t inset) {
+    return GRect(rect.origin.x + inset, rect.origin.y + inset, rect.size.w - 2 * inset,
+                 rect.size.h - 2 * inset);
+}
+
+bool grect_contains_point(const GRect *rect, const GPoint *point) {
+    return rect_contains(*rect, point->x, point->y);
+}
+
+// Bitmaps
+
+static uint16_t bytes_per_row(GBitmapFormat format, int16_t width) {
+    switch (format) {
+    case GBitmapFormat8Bit:
+        return width;
+    case GBitmapFormat2BitPalette:
+        return (width + 3) / 4;
+    default:
+        return (width + 31) / 32 * 4; // 1 bit, rows padded to words
+    }
+}
+
+GBitmap *gbitmap_create_blank(GSize size, GBitmapFormat format) {
+    GBitmap *bitmap = malloc(sizeof(GBitmap));
+    if (!bitmap) {
+        return NULL;
+    }
+    *bitmap = (GBitmap){.size = size, .format = format};
+    bitmap->bytes_per_row = bytes_per_row(format, size.w);
+    bitmap->data = calloc(size.h, bitmap->bytes_per_row);
+    if (!bitmap->data) {
+        free(bitmap);
+        return NULL;
+    }
+    return bitmap;
+}
+
+// The trend arrows: 30 px square, with a 2 bit palette on color displays. Pixels of palette index
+// 0 are transparent, any other index is black.
+GBitmap *gbitmap_create_with_resource(uint32_t resource_id) {
+    CHECK(resource_id >= RESOURCE_ID_ARROW_UP_DOUBLE &&
+          resource_id <= RESOURCE_ID_ARROW_DOWN_DOUBLE);
+    GBitmap *bitmap =
+        gbitmap_create_blank(GSize(30, 30), PBL_IF_COLOR_ELSE(GBitmapFormat2BitPalette,
+                                                              GBitmapFormat1Bit));
+    if (bitmap) {
+        for (uint16_t i = 0; i < bitmap->size.h * bitmap->bytes_per_row; i++) {
+            bitmap->data[i] = (i + resource_id) % 3 == 0 ? 0xFF : 0;
+        }
+    }
+    return bitmap;
+}
+
+void gbitmap_destroy(GBitmap *bitmap) {
+    CHECK(!bitmap->is_frame_buffer);
+    free(bitmap->data);
+    free(bitmap);
+}
+
+uint8_t *gbitmap_get_data(const GBitmap *bitmap) { return bitmap->data; }
+uint16_t gbitmap_get_bytes_per_row(const GBitmap *bitmap) { return bitmap->bytes_per_row; }
+GBitmapFormat gbitmap_get_format(const GBitmap *bitmap) { return bitmap->format; }
+GRect gbitmap_get_bounds(const GBitmap *bitmap) { return (GRect){GPointZero, bitmap->size}; }
+
+GBitmapDataRowInfo gbitmap_get_data_row_info(const GBitmap *bitmap, uint16_t y) {
+    CHECK(y < bitmap->size.h);
+    return (GBitmapDataRowInfo){&bitmap->data[y * bitmap->bytes_per_row], 0,
+                                bitmap->size.w - 1};
+}
+
+static bool is_bitmap_pixel_set(const GBitmap *bitmap, int16_t x, int16_t y) {
+    const uint8_t *row = &bitmap->data[y * bitmap->bytes_per_row];
+    if (bitmap->format == GBitmapFormat2BitPalette) {
+        return (row[x / 4] >> (2 * (3 - x % 4))) & 3;
+    }
+    return (row[x / 8] >> (x % 8)) & 1;
+}
+
+// Layers
+
+static void layer_init(Layer *layer, GRect frame) {
+    *layer = (Layer){.frame = frame, .bounds = {GPointZero, frame.size}};
+}
+
+Layer *layer_create(GRect frame) { return layer_create_with_data(frame, 0); }
+
+Layer *layer_create_with_data(GRect frame, size_t data_size) {
+    Layer *layer = malloc(sizeof(Layer) + data_size);
+    if (layer) {
+        layer_init(layer, frame);
+        layer->data = data_size > 0 ? layer + 1 : NULL;
+    }
+    return layer;
+}
+
+void layer_remove_from_parent(Layer *child) {
+    if (!child->parent) {
+        return;
+    }
+    for (Layer **link = &child->parent->first_child; *link; link = &(*link)->next_sibling) {
+        if (*link == child) {
+            *link = child->next_sibling;
+            break;
+        }
+    }
+    child->parent = NULL;
+    child->next_sibling = NULL;
+    s_is_dirty = true;
+}
+
+// Detaches a layer from its parent and its children, before it's freed
+static void layer_deinit(Layer *layer) {
+    layer_remove_from_parent(layer);
+    while (layer->first_child) {
+        layer_remove_from_parent(layer->first_child);
+    }
+}
+
+void layer_destroy(Layer *layer) {
+    if (layer) {
+        layer_deinit(layer);
+        free(layer);
+    }
+}
+
+void *layer_get_data(const Layer *layer) { return layer->data; }
+
+void layer_set_update_proc(Layer *layer, LayerUpdateProc update_proc) {
+    layer->update_proc = update_proc;
+}
+
+void layer_mark_dirty(Layer *layer) { s_is_dirty = true; }
+
+void layer_add_child(Layer *parent, Layer *child) {
+    layer_remove_from_parent(child);
+    Layer **link = &parent->first_child;
+    while (*link) {
+        link = &(*link)->next_sibling;
+    }
+    *link = child;
+    child->parent = parent;
+    s_is_dirty = true;
+}
+
+GRect layer_get_frame(const Layer *layer) { return layer->frame; }
+
+void layer_set_frame(Layer *layer, GRect frame) {
+    layer->frame = frame;
+    layer->bounds.size = frame.size;
+    s_is_dirty = true;
+}
+
+GRect layer_get_bounds(const Layer *layer) { return layer->bounds; }
+
+void layer_set_hidden(Layer *layer, bool hidden) {
+    if (hidden != layer->hidden) {
+        layer->hidden = hidden;
+        s_is_dirty = true;
+    }
+}
+
+bool layer_get_hidden(const Layer *layer) { return layer->hidden; }
+
+GPoint layer_convert_point_to_screen(const Layer *layer, GPoint point) {
+    for (; layer; layer = layer->parent) {
+        point.x += layer->frame.origin.x + layer->bounds.origin.x;
+        point.y += layer->frame.origin.y + layer->bounds.origin.y;
+    }
+    return point;
+}
+
+static void text_layer_update_proc(Layer *layer, GContext *ctx) {
+    TextLayer *text_layer = (TextLayer *)layer;
+    graphics_context_set_fill_color(ctx, text_layer->background_color);
+    graphics_fill_rect(ctx, layer->bounds, 0, GCornerNone);
+    if (text_layer->text) {
+        graphics_context_set_text_color(ctx, text_layer->text_color);
+        graphics_draw_text(ctx, text_layer->text, text_layer->font, layer->bounds,
+                           GTextOverflowModeWordWrap, text_layer->alignment, NULL);
+    }
+}
+
+TextLayer *text_layer_create(GRect frame) {
+    TextLayer *text_layer = malloc(sizeof(TextLayer));
+    if (text_layer) {
+        *text_layer = (TextLayer){
+            .background_color = GColorWhite,
+            .text_color = GColorBlack,
+            .font = fonts_get_system_font(FONT_KEY_GOTHIC_14),
+        };
+        layer_init(&text_layer->layer, frame);
+        text_layer->layer.update_proc = text_layer_update_proc;
+    }
+    return text_layer;
+}
+
+void text_layer_destroy(TextLayer *text_layer) {
+    if (text_layer) {
+        layer_deinit(&text_layer->layer);
+        free(text_layer);
+    }
+}
+
+Layer *text_layer_get_layer(TextLayer *text_layer) { return &text_layer->layer; }
+
+void text_layer_set_text(TextLayer *text_layer, const char *text) {
+    text_layer->text = text;
+    s_is_dirty = true;
+}
+
+void text_layer_set_background_color(TextLayer *text_layer, GColor color) {
+    text_layer->background_color = color;
+    s_is_dirty = true;
+}
+
+void text_layer_set_text_color(TextLayer *text_layer, GColor color) {
+    text_layer->text_color = color;
+    s_is_dirty = true;
+}
+
+void text_layer_set_font(TextLayer *text_layer, GFont font) {
+    text_layer->font = font;
+    s_is_dirty = true;
+}
+
+void text_layer_set_text_alignment(TextLayer *text_layer, GTextAlignment text_alignment) {
+    text_layer->alignment = text_alignment;
+    s_is_dirty = true;
+}
+
+GSize text_layer_get_content_size(TextLayer *text_layer) {
+    return text_size(text_layer->text ? text_layer->text : "", text_layer->font,
+                     text_layer->layer.frame.size);
+}
+
+// Centered in the layer, as by default on the watch
+static void bitmap_layer_update_proc(Layer *layer, GContext *ctx) {
+    BitmapLayer *bitmap_layer = (BitmapLayer *)layer;
+    const GBitmap *bitmap = bitmap_layer->bitmap;
+    if (!bitmap) {
+        return;
+    }
+    const int16_t left = (layer->bounds.size.w - bitmap->size.w) / 2;
+    const int16_t top = (layer->bounds.size.h - bitmap->size.h) / 2;
+    for (int16_t y = 0; y < bitmap->size.h; y++) {
+        for (int16_t x = 0; x < bitmap->size.w; x++) {
+            if (is_bitmap_pixel_set(bitmap, x, y)) {
+                put_pixel(ctx, left + x, top + y, GColorBlack);
+            } else if (bitmap_layer->compositing_mode != GCompOpSet) {
+                put_pixel(ctx, left + x, top + y, GColorWhite);
+            }
+        }
+    }
+}
+
+BitmapLayer *bitmap_layer_create(GRect frame) {
+    BitmapLayer *bitmap_layer = malloc(sizeof(BitmapLayer));
+    if (bitmap_layer) {
+        *bitmap_layer = (BitmapLayer){.compositing_mode = GCompOpAssign};
+        layer_init(&bitmap_layer->layer, frame);
+        bitmap_layer->layer.update_proc = bitmap_layer_update_proc;
+    }
+    return bitmap_layer;
+}
+
+void bitmap_layer_destroy(BitmapLayer *bitmap_layer) {
+    if (bitmap_layer) {
+        layer_deinit(&bitmap_layer->layer);
+        free(bitmap_layer);
+    }
+}
+
+Layer *bitmap_layer_get_layer(const BitmapLayer *bitmap_layer) {
+    return (Layer *)&bitmap_layer->layer;
+}
+
+void bitmap_layer_set_bitmap(BitmapLayer *bitmap_layer, const GBitmap *bitmap) {
+    bitmap_layer->bitmap = bitmap;
+    s_is_dirty = true;
+}
+
+void bitmap_layer_set_compositing_mode(BitmapLayer *bitmap_layer, GCompOp mode) {
+    bitmap_layer->compositing_mode = mode;
+    s_is_dirty = true;
+}
+
+// Rendering
+
+// Draws `layer` and its children, clipped to `clip` [screen].
+static void render_layer(Layer *layer, GRect clip) {
+    if (layer->hidden) {
+        return;
+    }
+    const GPoint origin = layer_convert_point_to_screen(layer, GPointZero);
+    const GPoint frame_origin = layer_convert_point_to_screen(layer->parent, layer->frame.origin);
+    clip = rect_intersection(clip, (GRect){frame_origin, layer->frame.size});
+    if (layer->update_proc) {
+        s_context = (GContext){
+            .fill_color = GColorBlack,
+            .stroke_color = GColorBlack,
+            .text_color = GColorBlack,
+            .offset = origin,
+            .clip = clip,
+        };
+        layer->update_proc(layer, &s_context);
+    }
+    for (Layer *child = layer->first_child; child; child = child->next_sibling) {
+        render_layer(child, clip);
+    }
+}
+
+static const GRect SCREEN = {{0, 0}, {PBL_DISPLAY_WIDTH, PBL_DISPLAY_HEIGHT}};
+
+void host_render_layer(Layer *layer) { render_layer(layer, SCREEN); }
+
+// Redraws the window on top of the stack: its white background, then its layers
+static void render(void) {
+    memset(s_frame_buffer_data, 0xFF, sizeof(s_frame_buffer_data)); // White in either format
+    render_layer(&s_top_window->root_layer, SCREEN);
+    s_counters.frames++;
+    s_is_dirty = false;
+}
+
+GBitmap *host_frame_buffer(void) { return &s_frame_buffer; }
+
+// Windows
+
+Window *window_create(void) {
+    Window *window = malloc(sizeof(Window));
+    if (window) {
+        *window = (Window){0};
+        layer_init(&window->root_layer, SCREEN);
+    }
+    return window;
+}
+
+static bool is_on_stack(const Window *window) {
+    for (const Window *on_stack = s_top_window; on_stack; on_stack = on_stack->below) {
+        if (on_stack == window) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void window_destroy(Window *window) {
+    if (!window) {
+        return;
+    }
+    if (is_on_stack(window)) {
+        window_stack_remove(window, false);
+    }
+    layer_deinit(&window->root_layer);
+    free(window);
+}
+
+void window_set_window_handlers(Window *window, WindowHandlers handlers) {
+    window->handlers = handlers;
+}
+
+Layer *window_get_root_layer(const Window *window) { return (Layer *)&window->root_layer; }
+void window_set_user_data(Window *window, void *data) { window->user_data = data; }
+void *window_get_user_data(const Window *window) { return window->user_data; }
+
+void window_stack_push(Window *window, bool animated) {
+    CHECK(!is_on_stack(window));
+    window->below = s_top_window;
+    s_top_window = window;
+    if (!window->is_loaded) {
+        window->is_loaded = true;
+        if (window->handlers.load) {
+            window->handlers.load(window);
+        }
+    }
+    s_is_dirty = true;
+}
+
+// The unload handler may destroy the window, so it's the last thing to touch it
+bool window_stack_remove(Window *window, bool animated) {
+    Window **link = &s_top_window;
+    while (*link && *link != window) {
+        link = &(*link)->below;
+    }
+    if (!*link) {
+        return false;
+    }
+    *link = window->below;
+    window->below = NULL;
+    s_is_dirty = true;
+    if (window->is_loaded) {
+        window->is_loaded = false;
+        if (window->handlers.unload) {
+            window->handlers.unload(window);
+        }
+    }
+    return true;
+}
+
+// Dictionaries
+
+#define TUPLE_HEADER_SIZE offsetof(Tuple, value)
+
+static void dict_begin(DictionaryIterator *iter, uint8_t *buffer, size_t size) {
+    *iter = (DictionaryIterator){.buffer = buffer, .size = size, .length = 1};
+    buffer[0] = 0;
+}
+
+Tuple *dict_read_first(DictionaryIterator *iter) {
+    iter->cursor = (Tuple *)&iter->buffer[1];
+    return iter->buffer[0] > 0 ? iter->cursor : NULL;
+}
+
+Tuple *dict_read_next(DictionaryIterator *iter) {
+    uint8_t *next = (uint8_t *)iter->cursor + TUPLE_HEADER_SIZE + iter->cursor->length;
+    if (next >= iter->buffer + iter->length) {
+        return NULL;
+    }
+    return iter->cursor = (Tuple *)next;
+}
+
+Tuple *dict_find(const DictionaryIterator *iter, const uint32_t key) {
+    DictionaryIterator copy = *iter;
+    for (Tuple *tuple = dict_read_first(&copy); tuple; tuple = dict_read_next(&copy)) {
+        if (tuple->key == key) {
+            return tuple;
+        }
+    }
+    return NULL;
+}
+
+uint32_t dict_size(DictionaryIterator *iter) { return iter->length; }
+
+static DictionaryResult dict_write(DictionaryIterator *iter, uint32_t key, TupleType type,
+                                   const void *data, uint16_t size) {
+    if (iter->length + TUPLE_HEADER_SIZE + size > iter->size) {
+        return DICT_NOT_ENOUGH_STORAGE;
+    }
+    Tuple *tuple = (Tuple *)&iter->buffer[iter->length];
+    tuple->key = key;
+    tuple->type = type;
+    tuple->length = size;
+    memcpy(tuple->value->data, data, size);
+    iter->length += TUPLE_HEADER_SIZE + size;
+    iter->buffer[0]++;
+    return DICT_OK;
+}
+
+DictionaryResult dict_write_data(DictionaryIterator *iter, const uint32_t key,
+                                 const uint8_t *data, const uint16_t size) {
+    return dict_write(iter, key, TUPLE_BYTE_ARRAY, data, size);
+}
+
+DictionaryResult dict_write_cstring(DictionaryIterator *iter, const uint32_t key,
+                                    const char *cstring) {
+    return dict_write(iter, key, TUPLE_CSTRING, cstring, strlen(cstring) + 1);
+}
+
+DictionaryResult dict_write_int(DictionaryIterator *iter, const uint32_t key, const void *integer,
+                                const uint8_t width_bytes, const bool is_signed) {
+    return dict_write(iter, key, is_signed ? TUPLE_INT : TUPLE_UINT, integer, width_bytes);
+}
+
+// AppMessage
+
+AppMessageResult app_message_open(const uint32_t size_inbound, const uint32_t size_outbound) {
+    CHECK(!s_inbox_buffer);
+    s_inbox_buffer = malloc(size_inbound);
+    s_outbox_buffer = malloc(size_outbound);
+    CHECK(s_inbox_buffer && s_outbox_buffer);
+    s_inbox_size = size_inbound;
+    s_outbox_size = size_outbound;
+    return APP_MSG_OK;
+}
+
+AppMessageInboxReceived app_message_register_inbox_received(AppMessageInboxReceived handler) {
+    const AppMessageInboxReceived previous = s_inbox_received;
+    s_inbox_received = handler;
+    return previous;
+}
+
+AppMessageInboxDropped app_message_register_inbox_dropped(AppMessageInboxDropped handler) {
+    const AppMessageInboxDropped previous = s_inbox_dropped;
+    s_inbox_dropped = handler;
+    return previous;
+}
+
+void app_message_deregister_callbacks(void) {
+    s_inbox_received = NULL;
+    s_inbox_dropped = NULL;
+}
+
+AppMessageResult app_message_outbox_begin(DictionaryIterator **iterator) {
+    if (s_is_outbox_begun || s_is_outbox_pending) {
+        return APP_MSG_BUSY;
+    }
+    dict_begin(&s_outbox, s_outbox_buffer, s_outbox_size);
+    s_is_outbox_begun = true;
+    *iterator = &s_outbox;
+    return APP_MSG_OK;
+}
+
+AppMessageResult app_message_outbox_send(void) {
+    CHECK(s_is_outbox_begun);
+    s_is_outbox_begun = false;
+    s_is_outbox_pending = true;
+    return APP_MSG_OK;
+}
+
+void host_set_phone(void (*on_message)(DictionaryIterator *message)) { s_phone = on_message; }
+
+DictionaryIterator *host_inbox_begin(void) {
+    dict_begin(&s_message, s_message_buffer, sizeof(s_message_buffer));
+    return &s_message;
+}
+
+static void after_event(void);
+
+AppMessageResult host_inbox_deliver(void) {
+    if (!s_connected) {
+        return APP_MSG_NOT_CONNECTED;
+    }
+    if (!s_inbox_received || s_message.length > s_inbox_size) {
+        s_traffic.in_dropped++;
+        if (s_inbox_dropped) {
+            s_inbox_dropped(APP_MSG_BUFFER_OVERFLOW, NULL);
+            after_event();
+        }
+        return APP_MSG_BUFFER_OVERFLOW;
+    }
+    DictionaryIterator inbox;
+    dict_begin(&inbox, s_inbox_buffer, s_inbox_size);
+    memcpy(inbox.buffer, s_message.buffer, s_message.length);
+    inbox.length = s_message.length;
+    s_traffic.in_messages++;
+    s_traffic.in_bytes += inbox.length;
+    s_inbox_received(&inbox, NULL);
+    after_event();
+    return APP_MSG_OK;
+}
+
+const HostTraffic *host_traffic(void) { return &s_traffic; }
+
+// Events
+
+void tick_timer_service_subscribe(TimeUnits tick_units, TickHandler handler) {
+    s_tick_units = tick_units;
+    s_tick_handler = handler;
+}
+
+void tick_timer_service_unsubscribe(void) { s_tick_handler = NULL; }
+
+AppTimer *app_timer_register(uint32_t timeout_ms, AppTimerCallback callback, void *callback_data) {
+    for (AppTimer *timer = s_timers; timer < s_timers + TIMER_COUNT; timer++) {
+        if (!timer->is_used) {
+            *timer = (AppTimer){host_clock_ms() + timeout_ms, callback, callback_data, true};
+            return timer;
+        }
+    }
+    CHECK(!"out of timers");
+    return NULL;
+}
+
+bool app_timer_reschedule(AppTimer *timer_handle, uint32_t new_timeout_ms) {
+    if (!timer_handle->is_used) {
+        return false;
+    }
+    timer_handle->deadline_ms = host_clock_ms() + new_timeout_ms;
+    return true;
+}
+
+void app_timer_cancel(AppTimer *timer_handle) { timer_handle->is_used = false; }
+
+void connection_service_subscribe(ConnectionHandlers conn_handlers) {
+    s_connection_handler = conn_handlers.pebble_app_connection_handler;
+}
+
+void connection_service_unsubscribe(void) { s_connection_handler = NULL; }
+bool connection_service_peek_pebble_app_connection(void) { return s_connected; }
+
+void battery_state_service_subscribe(BatteryStateHandler handler) { s_battery_handler = handler; }
+void battery_state_service_unsubscribe(void) { s_battery_handler = NULL; }
+BatteryChargeState battery_state_service_peek(void) { return s_battery; }
+
+void accel_tap_service_subscribe(AccelTapHandler handler) { s_tap_handler = handler; }
+void accel_tap_service_unsubscribe(void) { s_tap_handler = NULL; }
+
+bool quiet_time_is_active(void) { return s_quiet_time; }
+
+void vibes_short_pulse(void) { s_counters.vibe_pulses++; }
+void vibes_double_pulse(void) { s_counters.vibe_pulses += 2; }
+
+const HostCounters *host_counters(void) { return &s_counters; }
+
+// Hands the message the app sent to the phone, and redraws
+static void after_event(void) {
+    if (s_is_outbox_pending) {
+        s_is_outbox_pending = false;
+        if (!s_connected) {
+            s_traffic.out_failed++;
+        } else {
+            s_traffic.out_messages++;
+            s_traffic.out_bytes += s_outbox.length;
+            DictionaryIterator message = s_outbox;
+            if (s_phone) {
+                s_phone(&message);
+            }
+        }
+    }
+    if (s_is_dirty && s_top_window) {
+        render();
+    }
+}
+
+void host_set_connected(bool connected) {
+    if (connected != s_connected) {
+        s_connected = connected;
+        if (s_connection_handler) {
+            s_connection_handler(connected);
+            after_event();
+        }
+    }
+}
+
+void host_set_battery(uint8_t charge_percent, bool is_plugged) {
+    s_battery = (BatteryChargeState){.charge_percent = charge_percent, .is_plugged = is_plugged};
+    if (s_battery_handler) {
+        s_battery_handler(s_battery);
+        after_event();
+    }
+}
+
+void host_set_quiet_time(bool active) { s_quiet_time = active; }
+
+void host_tap(void) {
+    if (s_tap_handler) {
+        s_tap_handler(ACCEL_AXIS_Z, 1);
+        after_event();
+    }
+}
+
+static uint32_t tick_period_ms(void) {
+    if (s_tick_units & SECOND_UNIT) {
+        return 1000;
+    }
+    if (s_tick_units & MINUTE_UNIT) {
+        return 60 * 1000;
+    }
+    if (s_tick_units & HOUR_UNIT) {
+        return 60 * 60 * 1000;
+    }
+    return 24 * 60 * 60 * 1000; // The clock runs in UTC, see host_app_run()
+}
+
+static void tick(void) {
+    const time_t now = host_clock_ms() / 1000;
+    struct tm tick_time = *localtime(&now);
+    TimeUnits units_changed = SECOND_UNIT;
+    if (tick_time.tm_sec == 0) {
+        units_changed |= MINUTE_UNIT;
+        if (tick_time.tm_min == 0) {
+            units_changed |= HOUR_UNIT;
+            if (tick_time.tm_hour == 0) {
+                units_changed |= DAY_UNIT;
+            }
+        }
+    }
+    s_counters.ticks++;
+    s_tick_handler(&tick_time, units_changed);
+}
+
+void host_advance(uint32_t ms) {
+    const uint64_t end_ms = host_clock_ms() + ms;
+    for (;;) {
+        const uint64_t now_ms = host_clock_ms();
+        AppTimer *due = NULL;
+        for (AppTimer *timer = s_timers; timer < s_timers + TIMER_COUNT; timer++) {
+            if (timer->is_used && (!due || timer->deadline_ms < due->deadline_ms)) {
+                due = timer;
+            }
+        }
+        const uint64_t timer_ms = due ? (due->deadline_ms > now_ms ? due->deadline_ms : now_ms)
+                                      : UINT64_MAX;
+        const uint64_t tick_ms =
+            s_tick_handler ? (now_ms / tick_period_ms() + 1) * tick_period_ms() : UINT64_MAX;
+        if (timer_ms > end_ms && tick_ms > end_ms) {
+            break;
+        }
+        if (timer_ms <= tick_ms) {
+            host_clock_set_ms(timer_ms);
+            due->is_used = false;
+            s_counters.timers++;
+            due->callback(due->data);
+        } else {
+            host_clock_set_ms(tick_ms);
+            tick();
+        }
+        after_event();
+    }
+    host_clock_set_ms(end_ms);
+}
+
+// Apps
+
+void app_event_loop(void) {
+    after_event(); // Sends what init sent, and draws the first frame
+    if (s_events) {
+        s_events();
+    }
+}
+
+void host_app_run(int (*app_main)(void), void (*events)(void)) {
+    setenv("TZ", "UTC", 1);
+    tzset();
+    CHECK(!s_top_window && !s_inbox_buffer);
+    s_connected = true;
+    s_battery = (BatteryChargeState){.charge_percent = 100};
+    s_quiet_time = false;
+    s_events = events;
+
+    app_main();
+
+    // The system's part of the exit
+    while (s_top_window) {
+        window_stack_remove(s_top_window, false);
+    }
+    free(s_inbox_buffer);
+    free(s_outbox_buffer);
+    s_inbox_buffer = s_outbox_buffer = NULL;
+    s_is_outbox_begun = s_is_outbox_pending = false;
+    app_message_deregister_callbacks();
+    s_tick_handler = NULL;
+    s_connection_handler = NULL;
+    s_battery_handler = NULL;
+    s_tap_handler = NULL;
+    memset(s_timers, 0, sizeof(s_timers));
+    s_events = NULL;
+}
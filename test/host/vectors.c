@@ -0,0 +1,48 @@
+#include "vectors.h"
+
+static int hex_digit(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    return -1;
+}
+
+static bool read_batch(const char *hex, VectorBatch *batch) {
+    batch->length = 0;
+    for (const char *c = hex; *c != '\0' && *c != '\n'; c += 2) {
+        const int high = hex_digit(c[0]);
+        const int low = high < 0 ? -1 : hex_digit(c[1]);
+        if (low < 0 || batch->length == VECTORS_MAX_BATCH_SIZE) {
+            return false;
+        }
+        batch->bytes[batch->length++] = high << 4 | low;
+    }
+    return batch->length > 0;
+}
+
+bool vectors_read(FILE *file, Vectors *vectors) {
+    *vectors = (Vectors){0};
+    char line[2 * VECTORS_MAX_BATCH_SIZE + 16];
+    while (fgets(line, sizeof(line), file)) {
+        unsigned long timestamp;
+        unsigned int mgdl;
+        if (strncmp(line, "batch ", 6) == 0) {
+            if (vectors->batch_count == VECTORS_MAX_BATCHES ||
+                !read_batch(line + 6, &vectors->batches[vectors->batch_count++])) {
+                return false;
+            }
+        } else if (sscanf(line, "reading %lu %u", &timestamp, &mgdl) == 2) {
+            if (vectors->reading_count == VECTORS_MAX_READINGS) {
+                return false;
+            }
+            vectors->timestamps[vectors->reading_count] = timestamp;
+            vectors->mgdl[vectors->reading_count++] = mgdl;
+        } else {
+            return false;
+        }
+    }
+    return vectors->batch_count > 0 && vectors->reading_count > 0;
+}
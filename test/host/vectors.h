@@ -0,0 +1,25 @@
+// Reader for the history batch vectors printed by test/history_batch_vectors.js.
+
+#pragma once
+
+#include <pebble.h>
+
+#define VECTORS_MAX_BATCHES 8
+#define VECTORS_MAX_BATCH_SIZE 256
+#define VECTORS_MAX_READINGS 512
+
+typedef struct {
+    uint8_t bytes[VECTORS_MAX_BATCH_SIZE];
+    size_t length;
+} VectorBatch;
+
+typedef struct {
+    VectorBatch batches[VECTORS_MAX_BATCHES];
+    size_t batch_count;
+    uint32_t timestamps[VECTORS_MAX_READINGS];
+    uint16_t mgdl[VECTORS_MAX_READINGS];
+    size_t reading_count;
+} Vectors;
+
+// Reads the vectors from `file`. Returns false if they are malformed or don't fit.
+bool vectors_read(FILE *file, Vectors *vectors);
@@ -0,0 +1,116 @@
+// Replay of the face in the standard scenarios of tools/energy_model.py: the real main.c, with the
+// modules of the platform's profile, runs against the host SDK in host/, fed by the reference phone
+// in host/phone.c, and prints its log, with the hourly metrics reports, see metrics_report().
+// energy_model.py turns the counters in the reports into events per hour.
+//
+// The simulated BG swings between about 60 and 220 mg/dL over the day, so the default alerts go
+// off about as often as on a typical day.
+//
+//   replay_<platform> scenario [hours]   24 hours by default
+//
+// Scenarios:
+//   normal_day       a reading every 5 minutes
+//   flaky_bluetooth  the same, with the phone out of range for 2 minutes every 20
+//   one_minute_cgm   a reading every minute
+//   quiet_night      a reading every 5 minutes, all in Quiet Time
+
+#include "config.h"
+#include "host.h"
+#include "phone.h"
+#include <math.h>
+
+#define START_TIME 1704067200 // 2024-01-01 00:00 UTC
+
+#define FLAKY_PERIOD_SECONDS (20 * 60)
+#define FLAKY_OUTAGE_SECONDS (2 * 60)
+
+typedef struct {
+    const char *name;
+    uint32_t cadence_seconds;
+    bool is_flaky;
+    bool is_quiet;
+} Scenario;
+
+static const Scenario SCENARIOS[] = {
+    {.name = "normal_day", .cadence_seconds = 5 * 60},
+    {.name = "flaky_bluetooth", .cadence_seconds = 5 * 60, .is_flaky = true},
+    {.name = "one_minute_cgm", .cadence_seconds = 60},
+    {.name = "quiet_night", .cadence_seconds = 5 * 60, .is_quiet = true},
+};
+
+#define SCENARIO_COUNT (sizeof(SCENARIOS) / sizeof(SCENARIOS[0]))
+
+static const Scenario *s_scenario;
+static uint32_t s_hours = 24;
+static Phone s_phone;
+
+static uint32_t now(void) { return host_clock_ms() / 1000; }
+
+static double mgdl_at(uint32_t time) {
+    const double t = time - START_TIME;
+    return 140 + 70 * sin(2 * M_PI * t / (24 * 60 * 60)) + 15 * sin(2 * M_PI * t / (97 * 60));
+}
+
+// Arrow index for the rate of change, as xDrip's slope names
+static uint8_t arrow_for(double mgdl_per_minute) {
+    static const double LIMITS[] = {3.5, 2, 1, -1, -2, -3.5}; // Double up to single down
+    uint8_t arrow = 1;
+    while (arrow <= 6 && mgdl_per_minute < LIMITS[arrow - 1]) {
+        arrow++;
+    }
+    return arrow;
+}
+
+static void push_reading(void) {
+    const double mgdl = mgdl_at(now());
+    const double slope = (mgdl - mgdl_at(now() - 5 * 60)) / 5;
+    phone_push(&(PhoneReading){.timestamp = now(), .mgdl = (uint16_t)lround(mgdl),
+                               .arrow_index = arrow_for(slope)});
+}
+
+static bool is_out_of_range(uint32_t time) {
+    return s_scenario->is_flaky &&
+           (time - START_TIME) % FLAKY_PERIOD_SECONDS >=
+               FLAKY_PERIOD_SECONDS - FLAKY_OUTAGE_SECONDS;
+}
+
+// Moves the clock a minute at a time, with the readings and range changes of the scenario on the
+// way.
+static void events(void) {
+    if (s_scenario->is_quiet) {
+        host_set_quiet_time(true);
+    }
+    bool is_connected = true;
+    const uint32_t end = START_TIME + s_hours * 60 * 60;
+    while (now() < end) {
+        host_advance(60 * 1000);
+        if (is_out_of_range(now()) == is_connected) {
+            is_connected = !is_connected;
+            host_set_connected(is_connected);
+        }
+        if ((now() - START_TIME) % s_scenario->cadence_seconds == 0) {
+            push_reading();
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    for (size_t i = 0; i < SCENARIO_COUNT && argc > 1; i++) {
+        if (strcmp(argv[1], SCENARIOS[i].name) == 0) {
+            s_scenario = &SCENARIOS[i];
+        }
+    }
+    if (!s_scenario) {
+        fprintf(stderr, "usage: %s scenario [hours]\n", argv[0]);
+        return 2;
+    }
+    if (argc > 2) {
+        s_hours = atoi(argv[2]);
+    }
+    host_log_to(stdout);
+    phone_use(&s_phone);
+    phone_reset();
+    host_clock_set_ms((uint64_t)START_TIME * 1000);
+    host_app_run(face_main, events);
+    return 0;
+}
@@ -0,0 +1,345 @@
+// Soak test of the face's heap on the watch's allocator: the real main.c, detail.c and graph.c
+// (those the profile builds) run against the host SDK in host/, fed by the reference phone in
+// host/phone.c, with every allocation in a first fit arena the size of the platform's app heap,
+// see host_heap_use_arena(). Over weeks of 5 minute readings, with the arrow changing, the face
+// restarts every 1 to 49 hours, loading and unloading its main window, layers and arrow bitmaps;
+// taps open and close the detail window, and reconnect storms and outages make the phone re-send
+// and backfill. A third of the runs end in a power cut at a random write of the persistent storage.
+//
+// Reports the peak heap use, the largest free block, now and at its lowest, and the first
+// allocation failure, and fails if there was one. With the history, also checks that each start
+// restores only readings the phone sent, in order, those the previous run held if it exited
+// cleanly, and that the persistent storage stays within the app's 4 KB.
+//
+// Each run of the face is a forked process, so it starts with the module state of a fresh start;
+// only the persistent storage, the phone and the soak's bookkeeping are shared.
+//
+//   soak_<platform> [days [seed]]   28 days by default
+
+#include "config.h"
+#include "detail.h"
+#include "history.h"
+#include "host.h"
+#include "phone.h"
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#if defined(PBL_PLATFORM_APLITE)
+#define PLATFORM "aplite"
+#elif defined(PBL_PLATFORM_EMERY)
+#define PLATFORM "emery"
+#else
+#define PLATFORM "host"
+#endif
+
+#define MAX_DAYS 90
+#define CADENCE_SECONDS (5 * 60)
+#define SLOTS_PER_DAY (24 * 60 * 60 / CADENCE_SECONDS)
+#define MAX_SLOTS (MAX_DAYS * SLOTS_PER_DAY)
+#define START_TIME 1704067200 // 2024-01-01 00:00 UTC
+
+// Chances per slot [1 in n]
+#define SENSOR_GAP_CHANCE 33
+#define TAP_CHANCE 24
+#define STORM_CHANCE 150
+#define OUTAGE_CHANCE 3 // Of a storm, leaving the phone disconnected for 1 to 11 hours
+#define CUT_CHANCE 3    // Of a run
+
+#define STORM_FLAPS 6
+
+// Shared between the runs of the face
+typedef struct {
+    HostPersist persist;
+    Phone phone;
+    uint32_t random;     // State of next_random()
+    uint32_t now;        // Seconds since epoch, where the last run stopped
+    uint32_t slot;       // Next reading slot
+    uint32_t slot_count; // Slots to simulate
+    int16_t mgdl;        // Of the simulated BG
+    int16_t velocity;    // Of the simulated BG [mg/dL per reading]
+    uint8_t arrow;       // Of the last reading
+    uint16_t sent_mgdl[MAX_SLOTS]; // Reading the phone sent for the slot, 0 if none
+#if FEATURE_HISTORY
+    Reading at_exit[HISTORY_SIZE]; // History at the end of the last run, if it exited
+    uint16_t at_exit_count;
+#endif
+    bool was_cut; // The last run ended in a power cut
+
+    // Heap over all runs, see HostArenaStats
+    size_t peak, min_largest_free, last_largest_free;
+    uint32_t failures;
+    uint32_t first_failure_time; // Seconds since epoch
+    size_t first_failure_size, first_failure_free;
+
+    // Totals for the report
+    uint32_t runs, cuts, detail_views, arrow_changes, storms, outages, restored;
+    size_t persist_peak;
+} Soak;
+
+static Soak *s_soak;
+
+static uint32_t next_random(uint32_t n) {
+    // xorshift32
+    uint32_t x = s_soak->random;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    s_soak->random = x;
+    return x % n;
+}
+
+static uint32_t now(void) { return host_clock_ms() / 1000; }
+
+static uint32_t timestamp_of(uint32_t slot) { return START_TIME + slot * CADENCE_SECONDS; }
+
+// Adds the arena use of this run to that of the soak.
+static void record_heap(void) {
+    const HostArenaStats *stats = host_arena_stats();
+    if (stats->peak > s_soak->peak) {
+        s_soak->peak = stats->peak;
+    }
+    if (stats->min_largest_free < s_soak->min_largest_free) {
+        s_soak->min_largest_free = stats->min_largest_free;
+    }
+    s_soak->last_largest_free = stats->largest_free;
+    if (stats->failures > 0 && s_soak->failures == 0) {
+        s_soak->first_failure_time = stats->first_failure_ms / 1000;
+        s_soak->first_failure_size = stats->first_failure_size;
+        s_soak->first_failure_free = stats->first_failure_free;
+    }
+    s_soak->failures += stats->failures;
+}
+
+static void on_cut(void) {
+    record_heap();
+    s_soak->now = now();
+    s_soak->slot++; // The slot it happened in is over, its reading sent or not
+    s_soak->was_cut = true;
+    s_soak->cuts++;
+    s_soak->runs++;
+    fflush(stdout);
+    _exit(0);
+}
+
+// Checks the history the face restored at its start, and got from the phone since, against the
+// readings the phone sent
+static void check_restored(void) {
+#if FEATURE_HISTORY
+    static bool s_is_restored[MAX_SLOTS];
+    memset(s_is_restored, 0, sizeof(s_is_restored));
+    for (uint16_t age = 0; age < history_count(); age++) {
+        const Reading *reading = history_get(age);
+        CHECK(age == 0 || reading->timestamp < history_get(age - 1)->timestamp);
+        CHECK(reading->timestamp >= START_TIME &&
+              (reading->timestamp - START_TIME) % CADENCE_SECONDS == 0);
+        const uint32_t slot = (reading->timestamp - START_TIME) / CADENCE_SECONDS;
+        CHECK(slot < s_soak->slot);
+        CHECK(reading->mgdl == s_soak->sent_mgdl[slot]);
+        s_is_restored[slot] = true;
+    }
+    // The phone may have backfilled readings already, which push the oldest out of a full history
+    if (!s_soak->was_cut && history_count() > 0) {
+        const uint32_t oldest = history_get(history_count() - 1)->timestamp;
+        for (uint16_t i = 0; i < s_soak->at_exit_count; i++) {
+            const uint32_t timestamp = s_soak->at_exit[i].timestamp;
+            CHECK(timestamp < oldest || s_is_restored[(timestamp - START_TIME) / CADENCE_SECONDS]);
+        }
+    }
+    s_soak->restored += history_count();
+#endif
+}
+
+static void save_history(void) {
+#if FEATURE_HISTORY
+    s_soak->at_exit_count = history_count();
+    for (uint16_t age = 0; age < history_count(); age++) {
+        s_soak->at_exit[age] = *history_get(age);
+    }
+#endif
+}
+
+// Arrow index for a change per reading, as xDrip's slope thresholds do at 5 minute readings
+static uint8_t arrow_for(int16_t velocity) {
+    static const int16_t THRESHOLDS[] = {15, 10, 5, -5, -10, -15};
+    uint8_t arrow = 1;
+    while (arrow <= 6 && velocity < THRESHOLDS[arrow - 1]) {
+        arrow++;
+    }
+    return arrow;
+}
+
+// The phone's reading for the slot: a random walk of the BG, with sensor gaps
+static void push_reading(uint32_t slot) {
+    if (next_random(SENSOR_GAP_CHANCE) == 0) {
+        return;
+    }
+    int16_t velocity = s_soak->velocity + (int16_t)next_random(7) - 3;
+    velocity = velocity > 20 ? 20 : velocity < -20 ? -20 : velocity;
+    int16_t mgdl = s_soak->mgdl + velocity;
+    if (mgdl < 50 || mgdl > 350) {
+        velocity = -velocity;
+        mgdl = s_soak->mgdl + velocity;
+    }
+    const uint8_t arrow = arrow_for(velocity);
+    if (arrow != s_soak->arrow) {
+        s_soak->arrow_changes++;
+    }
+    s_soak->velocity = velocity;
+    s_soak->mgdl = mgdl;
+    s_soak->arrow = arrow;
+    s_soak->sent_mgdl[slot] = mgdl;
+    phone_push(
+        &(PhoneReading){.timestamp = timestamp_of(slot), .mgdl = mgdl, .arrow_index = arrow});
+}
+
+// Opens the detail window with a tap, and closes it with another tap or by its timeout
+static void view_detail(void) {
+    host_tap();
+    CHECK(detail_is_visible());
+    s_soak->detail_views++;
+    if (next_random(2)) {
+        host_advance(1000 + next_random(5000));
+        host_tap();
+    } else {
+        host_advance(12000);
+    }
+    CHECK(!detail_is_visible());
+}
+
+// Flaps the connection faster than it settles, and leaves it connected, or disconnected until
+// the returned time, if it's an outage.
+static uint32_t reconnect_storm(void) {
+    s_soak->storms++;
+    for (int i = 0; i < STORM_FLAPS; i++) {
+        host_set_connected(false);
+        host_advance(100 + next_random(2000));
+        host_set_connected(true);
+        host_advance(100 + next_random(2000));
+    }
+    if (next_random(OUTAGE_CHANCE) > 0) {
+        return 0;
+    }
+    s_soak->outages++;
+    host_set_connected(false);
+    return now() + 60 * 60 + next_random(10 * 60 * 60);
+}
+
+static void events(void) {
+    check_restored();
+    s_soak->was_cut = false;
+    const uint32_t length = 12 + next_random(2 * SLOTS_PER_DAY); // 1 to 49 hours
+    const uint32_t end = s_soak->slot + length < s_soak->slot_count ? s_soak->slot + length
+                                                                    : s_soak->slot_count;
+    if (next_random(CUT_CHANCE) == 0) {
+        // The journal writes a bit more than once per reading
+        host_persist_set_cut(1 + next_random(2 * length), on_cut);
+    }
+
+    uint32_t reconnect_time = 0; // While disconnected
+    for (; s_soak->slot < end; s_soak->slot++) {
+        const uint32_t slot = s_soak->slot;
+        host_advance((timestamp_of(slot) - now()) * 1000);
+        if (reconnect_time > 0 && now() >= reconnect_time) {
+            host_set_connected(true);
+            reconnect_time = 0;
+        }
+        push_reading(slot);
+        host_advance(1000);
+        if (next_random(TAP_CHANCE) == 0) {
+            view_detail();
+        }
+        if (reconnect_time == 0 && next_random(STORM_CHANCE) == 0) {
+            reconnect_time = reconnect_storm();
+        }
+
+        const size_t persist_size = host_persist_size();
+        CHECK(persist_size <= HOST_PERSIST_LIMIT);
+        if (persist_size > s_soak->persist_peak) {
+            s_soak->persist_peak = persist_size;
+        }
+    }
+    if (reconnect_time > 0) {
+        host_set_connected(true);
+    }
+    host_advance(60 * 1000);
+    CHECK(!s_soak->phone.has_latest); // Connected, so the face got the newest reading
+    host_persist_set_cut(0, NULL);
+    save_history();
+    s_soak->now = now();
+}
+
+// Runs the face once, from start to exit or a power cut, in a child process.
+static void run(void) {
+    fflush(stdout);
+    const pid_t pid = fork();
+    CHECK(pid >= 0);
+    if (pid == 0) {
+        host_heap_use_arena();
+        host_persist_use(&s_soak->persist);
+        phone_use(&s_soak->phone);
+        host_clock_set_ms((uint64_t)s_soak->now * 1000);
+        host_app_run(face_main, events);
+        CHECK(host_heap_in_use() == 0);
+        record_heap();
+        s_soak->runs++;
+        fflush(stdout);
+        _exit(0);
+    }
+    int status;
+    CHECK(waitpid(pid, &status, 0) == pid);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "soak: run %u failed on day %u\n", (unsigned)s_soak->runs + 1,
+                (unsigned)(s_soak->slot / SLOTS_PER_DAY + 1));
+        exit(1);
+    }
+}
+
+int main(int argc, char **argv) {
+    const int days = argc > 1 ? atoi(argv[1]) : 28;
+    CHECK(days > 0 && days <= MAX_DAYS);
+    s_soak = mmap(NULL, sizeof(Soak), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    CHECK(s_soak != MAP_FAILED);
+    *s_soak = (Soak){
+        .random = argc > 2 ? (uint32_t)atol(argv[2]) : 1,
+        .now = START_TIME,
+        .slot_count = days * SLOTS_PER_DAY,
+        .mgdl = 120,
+        .min_largest_free = HOST_HEAP_SIZE,
+    };
+    CHECK(s_soak->random != 0);
+    phone_use(&s_soak->phone);
+    phone_reset();
+
+    // Runs until the days are over, and once more to check the last restart
+    while (s_soak->slot < s_soak->slot_count) {
+        run();
+    }
+    run();
+
+    printf("soak (" PLATFORM "): %d days, %u runs (%u power cuts), %u detail views, %u arrow "
+           "changes, %u reconnect storms (%u outages)\n",
+           days, (unsigned)s_soak->runs, (unsigned)s_soak->cuts, (unsigned)s_soak->detail_views,
+           (unsigned)s_soak->arrow_changes, (unsigned)s_soak->storms, (unsigned)s_soak->outages);
+    printf("soak (" PLATFORM "): heap peak %u of %u B, largest free block %u B at the end, %u B "
+           "at the lowest\n",
+           (unsigned)s_soak->peak, (unsigned)HOST_HEAP_SIZE, (unsigned)s_soak->last_largest_free,
+           (unsigned)s_soak->min_largest_free);
+    if (s_soak->failures > 0) {
+        const uint32_t seconds = s_soak->first_failure_time - START_TIME;
+        printf("soak (" PLATFORM "): %u allocations failed, the first on day %u at %02u:%02u: "
+               "%u B asked with %u B free\n",
+               (unsigned)s_soak->failures, (unsigned)(seconds / 86400 + 1),
+               (unsigned)(seconds % 86400 / 3600), (unsigned)(seconds % 3600 / 60),
+               (unsigned)s_soak->first_failure_size, (unsigned)s_soak->first_failure_free);
+    } else {
+        printf("soak (" PLATFORM "): no allocation failed\n");
+    }
+#if FEATURE_HISTORY
+    printf("soak (" PLATFORM "): %u readings restored, persist peak %u B\n",
+           (unsigned)s_soak->restored, (unsigned)s_soak->persist_peak);
+#endif
+    CHECK(s_soak->failures == 0);
+    CHECK(s_soak->storms > 0 && s_soak->detail_views > 0);
+    return 0;
+}
@@ -0,0 +1,135 @@
+// Time-of-day profile, see agp.h, fed as the face feeds it, through readings.h: two weeks of
+// readings with disconnects, the backfills after them, and re-sent readings, and a crash that
+// loses the last hour of them from the histograms. Each bucket must count every reading exactly
+// once, and its percentiles must be close to the exact ones of its readings.
+
+#include "agp.h"
+#include "host.h"
+#include "readings.h"
+#include <math.h>
+
+#define CADENCE_SECONDS (5 * 60)
+#define DAY_SECONDS (24 * 60 * 60)
+#define WEEK_SECONDS (7 * DAY_SECONDS)
+#define READINGS (2 * WEEK_SECONDS / CADENCE_SECONDS)
+#define DAY_READINGS (DAY_SECONDS / CADENCE_SECONDS)
+#define BUCKET_READINGS (READINGS / AGP_BUCKETS)
+#define UNWRITTEN_READINGS 12 // Added after the last write before the crash
+
+static uint32_t s_random = 1;
+
+static uint32_t next_random(void) {
+    // xorshift32
+    s_random ^= s_random << 13;
+    s_random ^= s_random >> 17;
+    s_random ^= s_random << 5;
+    return s_random;
+}
+
+// A daily pattern, with log-normal noise
+static uint16_t reading_at(uint32_t timestamp) {
+    const double mean = 130 + 50 * sin(2 * M_PI * (timestamp % DAY_SECONDS) / DAY_SECONDS);
+    double noise = -6;
+    for (int i = 0; i < 12; i++) {
+        noise += next_random() / (double)UINT32_MAX;
+    }
+    const double mgdl = mean * exp(0.25 * noise);
+    return mgdl < 40 ? 40 : mgdl > 400 ? 400 : mgdl;
+}
+
+static int compare(const void *a, const void *b) {
+    return *(const uint16_t *)a - *(const uint16_t *)b;
+}
+
+int main(void) {
+    setenv("TZ", "UTC", 1);
+    tzset();
+    agp_init();
+
+    // The previous and the current week, as agp_init() sees them
+    const uint32_t start = (time(NULL) / WEEK_SECONDS - 1) * WEEK_SECONDS;
+    static uint16_t mgdl[READINGS];
+    for (uint32_t i = 0; i < READINGS; i++) {
+        mgdl[i] = reading_at(start + i * CADENCE_SECONDS);
+    }
+
+    static bool is_missed[READINGS];
+    uint32_t away_until = 0; // Reading the phone is out of range before
+    uint32_t backfills = 0, resent = 0;
+    for (uint32_t i = 0; i < READINGS; i++) {
+        if (i >= away_until && next_random() % 300 == 0) {
+            away_until = i + 1 + next_random() % 24; // Up to two hours
+        }
+        if (i < away_until) {
+            is_missed[i] = true;
+            continue;
+        }
+
+        // Back in range, the phone sends the last day, most of which the history has
+        const uint32_t timestamp = start + i * CADENCE_SECONDS;
+        if (i > 0 && is_missed[i - 1]) {
+            for (uint32_t j = i > DAY_READINGS ? i - DAY_READINGS : 0; j < i; j++) {
+                CHECK(readings_insert(start + j * CADENCE_SECONDS, mgdl[j], mgdl[j]) ==
+                      is_missed[j]);
+                is_missed[j] = false;
+            }
+            backfills++;
+        }
+        CHECK(readings_add(timestamp, mgdl[i], mgdl[i]));
+
+        // xDrip re-sends the latest reading after every announcement. After a restart, it is new
+        // to xdrip.h, but the history the journal restored already has it.
+        if (next_random() % 10 == 0) {
+            CHECK(!readings_add(timestamp, mgdl[i], mgdl[i]));
+            resent++;
+        }
+
+        if (i == READINGS - 1 - UNWRITTEN_READINGS) {
+            agp_deinit(); // The last write of the histograms
+        }
+    }
+
+    // The crash: the histograms start again from what was written, the history has the rest
+    agp_init();
+
+    // Exact percentiles per bucket, of the readings of both weeks
+    static uint16_t sorted[AGP_BUCKETS][BUCKET_READINGS];
+    static uint16_t counts[AGP_BUCKETS];
+    for (uint32_t i = 0; i < READINGS; i++) {
+        CHECK(!is_missed[i] || i + 24 >= READINGS); // Missed at the end, never backfilled
+        if (!is_missed[i]) {
+            const uint8_t bucket = i * CADENCE_SECONDS % DAY_SECONDS / AGP_BUCKET_SECONDS;
+            sorted[bucket][counts[bucket]++] = mgdl[i];
+        }
+    }
+    static const uint8_t PERCENTS[] = {10, 25, 50, 75, 90};
+    double error_sum = 0;
+    uint16_t error_max = 0; // Within the target range, where the bins are narrow
+    uint16_t error_max_outside = 0;
+    for (uint8_t bucket = 0; bucket < AGP_BUCKETS; bucket++) {
+        AgpBucket agp;
+        agp_get(start + bucket * AGP_BUCKET_SECONDS, &agp);
+        CHECK(agp.count == counts[bucket]);
+
+        qsort(sorted[bucket], counts[bucket], sizeof(uint16_t), compare);
+        const uint16_t percentiles[] = {agp.p10_mgdl, agp.p25_mgdl, agp.p50_mgdl, agp.p75_mgdl,
+                                        agp.p90_mgdl};
+        for (uint8_t i = 0; i < sizeof(PERCENTS); i++) {
+            const uint16_t exact = sorted[bucket][(counts[bucket] - 1) * PERCENTS[i] / 100];
+            const uint16_t error = abs(percentiles[i] - exact);
+            uint16_t *max = (exact >= 70 && exact < 180) ? &error_max : &error_max_outside;
+            *max = error > *max ? error : *max;
+            error_sum += error;
+        }
+    }
+    const double error_mean = error_sum / (AGP_BUCKETS * sizeof(PERCENTS));
+    printf("agp: %d readings, %u backfills, %u re-sent\n", READINGS, (unsigned)backfills,
+           (unsigned)resent);
+    printf("agp: percentiles off by %.1f mg/dL on average, at most %u in the target range and %u "
+           "outside it\n",
+           error_mean, error_max, error_max_outside);
+    // Accurate to a bin width, see agp.h
+    CHECK(error_mean < 3);
+    CHECK(error_max <= 15 && error_max_outside <= 50);
+    return 0;
+}
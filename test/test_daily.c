@@ -0,0 +1,45 @@
+// Episodes of the daily archive, see daily.h: a day with a low run long enough to be an episode,
+// a high run split by an outage, whose halves are each too short, and a run too short anyway.
+// Once archived at midnight, the day must count one low episode and no high one.
+
+#include "daily.h"
+#include "host.h"
+
+#define START_TIME 1704067200 // 2024-01-01 00:00 UTC
+#define CADENCE_SECONDS (5 * 60)
+
+static uint32_t s_time = START_TIME;
+
+// Adds `count` readings of `mgdl`, 5 minutes apart, starting at the next cadence.
+static void add(uint16_t count, uint16_t mgdl) {
+    for (uint16_t i = 0; i < count; i++) {
+        s_time += CADENCE_SECONDS;
+        daily_add(s_time, mgdl);
+    }
+}
+
+int main(void) {
+    setenv("TZ", "UTC", 1);
+    tzset();
+    host_clock_set_ms((uint64_t)START_TIME * 1000);
+    daily_init();
+
+    add(12, 120);
+    add(5, 60); // 20 minutes below the target range
+    add(12, 120);
+    add(3, 220); // 10 minutes above it, then an hour without readings
+    s_time += 60 * 60;
+    add(3, 220); // And 10 more
+    add(12, 120);
+    add(2, 60);
+    add(12, 120);
+
+    daily_update(START_TIME + 24 * 60 * 60);
+    CHECK(daily_count() == 1);
+    const DailyRecord *record = daily_get(0);
+    printf("daily: %u low and %u high episodes\n", (unsigned)(record->episodes & 0x0F),
+           (unsigned)(record->episodes >> 4));
+    CHECK((record->episodes & 0x0F) == 1);
+    CHECK(record->episodes >> 4 == 0);
+    return 0;
+}
@@ -0,0 +1,117 @@
+// Pixels the graph writes per frame with the background cache of graph.c and without it
+// (host/graph_uncached.c), drawn into the frame buffer of the host SDK in host/ui.c.
+//
+// A pixel counts as written if a frame leaves it the same whether the frame buffer started all
+// black or all white. Pixels written through the graphics API, the slow path on the watch, are
+// counted separately. Both ways must draw the same frames, and nothing outside the layer.
+
+#include "config.h"
+#include "graph.h"
+#include "history.h"
+#include "host.h"
+
+#define START_TIME 1704067200 // 2024-01-01 00:00 UTC
+#define CADENCE_SECONDS (5 * 60)
+#define FRAMES 24 // Steady frames, each after a new reading
+
+#define SCREEN_PIXELS (PBL_DISPLAY_WIDTH * PBL_DISPLAY_HEIGHT) // A byte each, in color
+
+Layer *graph_uncached_layer_create(GRect frame);
+void graph_uncached_layer_destroy(Layer *layer);
+
+typedef struct {
+    const char *name;
+    Layer *(*create)(GRect frame);
+    void (*destroy)(Layer *layer);
+    Layer *layer;
+    uint32_t first_api_pixels; // In the first frame, which draws the background
+    uint32_t written;          // Pixels written in the steady frames
+    uint32_t api_pixels;       // Of those, through the graphics API
+    uint8_t frame[SCREEN_PIXELS]; // Last one drawn
+} Graph;
+
+static Graph s_graphs[] = {
+    {.name = "cached", .create = graph_layer_create, .destroy = graph_layer_destroy},
+    {.name = "uncached", .create = graph_uncached_layer_create,
+     .destroy = graph_uncached_layer_destroy},
+};
+
+#define GRAPH_COUNT (sizeof(s_graphs) / sizeof(s_graphs[0]))
+
+static const GRect FRAME = {{0, 84}, {200, 84}}; // As main.c lays out emery
+
+static uint32_t s_reading_count;
+
+// Adds the next reading, and moves the clock to it.
+static void add_reading(void) {
+    const uint32_t timestamp = START_TIME + s_reading_count * CADENCE_SECONDS;
+    const uint16_t mgdl = 60 + (s_reading_count * 37) % 240;
+    CHECK(history_add(timestamp, mgdl, mgdl));
+    host_clock_set_ms((uint64_t)timestamp * 1000);
+    s_reading_count++;
+}
+
+static uint32_t api_pixels(void) { return host_counters()->api_pixels; }
+
+// Draws the graph over a frame buffer filled with `fill`, and copies the result to `out`.
+static void render(const Graph *graph, uint8_t fill, uint8_t *out) {
+    uint8_t *data = gbitmap_get_data(host_frame_buffer());
+    memset(data, fill, SCREEN_PIXELS);
+    host_render_layer(graph->layer);
+    memcpy(out, data, SCREEN_PIXELS);
+}
+
+// Draws a steady frame, and counts what it writes.
+static void measure(Graph *graph) {
+    static uint8_t s_over_black[SCREEN_PIXELS];
+    const uint32_t before = api_pixels();
+    render(graph, 0x00, s_over_black);
+    render(graph, 0xFF, graph->frame);
+    graph->api_pixels += (api_pixels() - before) / 2;
+    for (int16_t y = 0; y < PBL_DISPLAY_HEIGHT; y++) {
+        for (int16_t x = 0; x < PBL_DISPLAY_WIDTH; x++) {
+            const size_t i = y * PBL_DISPLAY_WIDTH + x;
+            if (s_over_black[i] == graph->frame[i]) {
+                CHECK(grect_contains_point(&FRAME, &GPoint(x, y)));
+                graph->written++;
+            }
+        }
+    }
+}
+
+int main(void) {
+    while (s_reading_count < HISTORY_SIZE / 2) {
+        add_reading();
+    }
+    for (Graph *graph = s_graphs; graph < s_graphs + GRAPH_COUNT; graph++) {
+        graph->layer = graph->create(FRAME);
+        // The first frame draws over the white of the window, as on the watch
+        const uint32_t before = api_pixels();
+        render(graph, 0xFF, graph->frame);
+        graph->first_api_pixels = api_pixels() - before;
+    }
+    for (int frame = 0; frame < FRAMES; frame++) {
+        add_reading();
+        for (Graph *graph = s_graphs; graph < s_graphs + GRAPH_COUNT; graph++) {
+            measure(graph);
+        }
+        CHECK(memcmp(s_graphs[0].frame, s_graphs[1].frame, SCREEN_PIXELS) == 0);
+    }
+
+    for (Graph *graph = s_graphs; graph < s_graphs + GRAPH_COUNT; graph++) {
+        graph->destroy(graph->layer);
+        printf("graph: %s background, %u of %u px written per frame, %u through the graphics "
+               "API (%u in the first frame)\n",
+               graph->name, (unsigned)(graph->written / FRAMES),
+               (unsigned)(FRAME.size.w * FRAME.size.h), (unsigned)(graph->api_pixels / FRAMES),
+               (unsigned)graph->first_api_pixels);
+    }
+    CHECK(host_heap_in_use() == 0);
+
+    // The cache draws the background through the API once, then copies it whole
+    const Graph *cached = &s_graphs[0], *uncached = &s_graphs[1];
+    CHECK(cached->first_api_pixels > 0 && cached->api_pixels == 0);
+    CHECK(cached->written == (uint32_t)(FRAMES * FRAME.size.w * FRAME.size.h));
+    CHECK(uncached->api_pixels / FRAMES == cached->first_api_pixels);
+    return 0;
+}
@@ -0,0 +1,79 @@
+// Round trip of history batches: the phone-side encoder, src/pkjs/history_batch.js, against the
+// watch-side decoder. Reads the vectors from history_batch_vectors.js on stdin, and checks that the
+// day of readings takes two batches that decode to exactly the encoded readings. Also checks that
+// truncated and corrupted batches, and those with bitmap bits set past the last slot, are rejected
+// before any reading is handed out.
+
+#include "history_batch.h"
+#include "host.h"
+#include "vectors.h"
+
+typedef struct {
+    const Vectors *vectors;
+    size_t decoded; // Readings decoded so far, over all batches
+} RoundTrip;
+
+static void check_reading(uint32_t timestamp, uint16_t mgdl, void *context) {
+    RoundTrip *round_trip = context;
+    const size_t i = round_trip->decoded++;
+    CHECK(i < round_trip->vectors->reading_count);
+    CHECK(timestamp == round_trip->vectors->timestamps[i]);
+    CHECK(mgdl == round_trip->vectors->mgdl[i]);
+}
+
+static void count_reading(uint32_t timestamp, uint16_t mgdl, void *context) {
+    (*(int *)context)++;
+}
+
+int main(void) {
+    static Vectors vectors;
+    CHECK(vectors_read(stdin, &vectors));
+    CHECK(vectors.reading_count == 300);
+    CHECK(vectors.batch_count == 2);
+
+    RoundTrip round_trip = {.vectors = &vectors};
+    for (size_t i = 0; i < vectors.batch_count; i++) {
+        const VectorBatch *batch = &vectors.batches[i];
+        const size_t before = round_trip.decoded;
+        const int count = history_batch_decode(batch->bytes, batch->length, check_reading,
+                                               &round_trip);
+        CHECK(count > 0);
+        CHECK(round_trip.decoded == before + count);
+    }
+    CHECK(round_trip.decoded == vectors.reading_count);
+
+    // Every truncation, and a trailing byte, reject the batch as a whole
+    const VectorBatch *batch = &vectors.batches[0];
+    for (size_t length = 0; length < batch->length; length++) {
+        int calls = 0;
+        CHECK(history_batch_decode(batch->bytes, length, count_reading, &calls) == -1);
+        CHECK(calls == 0);
+    }
+    VectorBatch longer = *batch;
+    longer.bytes[longer.length++] = 0;
+    int calls = 0;
+    CHECK(history_batch_decode(longer.bytes, longer.length, count_reading, &calls) == -1);
+    CHECK(calls == 0);
+
+    // A wrong version, or a missing base reading
+    VectorBatch corrupt = *batch;
+    corrupt.bytes[0] = HISTORY_BATCH_VERSION + 1;
+    CHECK(history_batch_decode(corrupt.bytes, corrupt.length, count_reading, &calls) == -1);
+    corrupt = *batch;
+    corrupt.bytes[10] &= ~1;
+    CHECK(history_batch_decode(corrupt.bytes, corrupt.length, count_reading, &calls) == -1);
+    CHECK(calls == 0);
+
+    // Five slots, four readings, and a padding bit set past the fifth slot
+    uint8_t padded[] = {HISTORY_BATCH_VERSION, 5, 5, 0, 0x00, 0xF1, 0x53, 0x65, 120, 0, 0x1B, 3,
+                        0x80, 44, 1, 0xFE};
+    CHECK(history_batch_decode(padded, sizeof(padded), NULL, NULL) == 4);
+    padded[10] |= 1 << 5;
+    CHECK(history_batch_decode(padded, sizeof(padded), count_reading, &calls) == -1);
+    CHECK(calls == 0);
+
+    printf("history batch: %d readings in %d batches of %d and %d B\n", (int)vectors.reading_count,
+           (int)vectors.batch_count, (int)vectors.batches[0].length,
+           (int)vectors.batches[1].length);
+    return 0;
+}
@@ -0,0 +1,131 @@
+// Journal of the reading history, see journal.h: what it writes to flash per day against
+// rewriting the whole history on every reading, and that a restart restores the full history
+// after power cuts at every write of a compaction, including the one that finishes an interrupted
+// compaction at startup.
+//
+// Each restart of the face is a forked process, so it starts with the module state of a fresh
+// start; only the persistent storage and the expected history are shared.
+
+#include "config.h"
+#include "history.h"
+#include "host.h"
+#include "journal.h"
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define CADENCE_SECONDS (5 * 60)
+#define START_TIMESTAMP 1700000100
+#define DAY_READINGS (24 * 60 * 60 / CADENCE_SECONDS)
+#define FILL_READINGS 300 // More than the history holds
+
+#define EXIT_CUT 0
+#define EXIT_DONE 3 // The run wrote everything before the cut point
+
+// Shared with the restarts
+typedef struct {
+    HostPersist persist;
+    Reading expected[HISTORY_SIZE];
+    uint16_t expected_count;
+} Shared;
+
+static Shared *s_shared;
+static uint32_t s_reading_count;
+
+static void on_cut(void) { _exit(EXIT_CUT); }
+
+// Adds the next reading, as main.c does. Returns true if the journal requested a compaction.
+static bool add_reading(void) {
+    const uint32_t timestamp = START_TIMESTAMP + s_reading_count * CADENCE_SECONDS;
+    const uint16_t mgdl = 100 + s_reading_count * 7 % 150;
+    CHECK(history_add(timestamp, mgdl, mgdl));
+    journal_append();
+    s_reading_count++;
+    return host_scheduler_count() > 0;
+}
+
+// Runs the tasks due by the time of the next reading, i.e. a requested compaction.
+static void run_due(void) { host_scheduler_run_due(s_reading_count * CADENCE_SECONDS * 1000); }
+
+// Runs `run` in a child process, and returns its exit status.
+static int fork_run(void (*run)(uint32_t), uint32_t argument) {
+    fflush(stdout);
+    const pid_t pid = fork();
+    CHECK(pid >= 0);
+    if (pid == 0) {
+        host_persist_use(&s_shared->persist);
+        run(argument);
+        fflush(stdout);
+        _exit(EXIT_DONE);
+    }
+    int status;
+    CHECK(waitpid(pid, &status, 0) == pid);
+    CHECK(WIFEXITED(status));
+    CHECK(WEXITSTATUS(status) == EXIT_CUT || WEXITSTATUS(status) == EXIT_DONE);
+    return WEXITSTATUS(status);
+}
+
+// Fills the history and the tail, then cuts power after `writes` writes of the compaction that
+// the full tail requests.
+static void fill_and_compact(uint32_t writes) {
+    host_persist_clear();
+    journal_init();
+    while (!add_reading() || s_reading_count < FILL_READINGS) {
+        run_due();
+    }
+    s_shared->expected_count = history_count();
+    for (uint16_t age = 0; age < history_count(); age++) {
+        s_shared->expected[age] = *history_get(age);
+    }
+    host_persist_set_cut(writes, on_cut);
+    run_due();
+}
+
+// Restarts, cutting power after `writes` writes, if any.
+static void restart(uint32_t writes) {
+    host_persist_set_cut(writes, on_cut);
+    journal_init();
+    CHECK(history_count() == s_shared->expected_count);
+    for (uint16_t age = 0; age < history_count(); age++) {
+        CHECK(history_get(age)->timestamp == s_shared->expected[age].timestamp);
+        CHECK(history_get(age)->mgdl == s_shared->expected[age].mgdl);
+    }
+}
+
+static void check_flash_per_day(uint32_t unused) {
+    journal_init();
+    while (s_reading_count < FILL_READINGS) {
+        add_reading();
+        run_due();
+    }
+    const uint32_t bytes = host_flash_bytes() * DAY_READINGS / FILL_READINGS;
+    const uint32_t naive_bytes = host_flash_naive_bytes() * DAY_READINGS / FILL_READINGS;
+    printf("journal: %u B of flash per day, %u B rewriting the history on every reading\n",
+           (unsigned)bytes, (unsigned)naive_bytes);
+    CHECK(bytes * 5 < naive_bytes);
+}
+
+int main(void) {
+    s_shared =
+        mmap(NULL, sizeof(Shared), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    CHECK(s_shared != MAP_FAILED);
+
+    CHECK(fork_run(check_flash_per_day, 0) == EXIT_DONE);
+
+    // Cuts after every write of the compaction, then after every write of the one finishing it at
+    // the restart. A cut point counts the writes that complete before it.
+    uint32_t cut_points = 0;
+    for (uint32_t first = 1; fork_run(fill_and_compact, first) == EXIT_CUT; first++) {
+        const HostPersist cut = s_shared->persist;
+        for (uint32_t second = 1;; second++) {
+            s_shared->persist = cut;
+            cut_points++;
+            if (fork_run(restart, second) == EXIT_DONE) {
+                break;
+            }
+            CHECK(fork_run(restart, 0) == EXIT_DONE);
+        }
+    }
+    printf("journal: full history restored after %u pairs of power cuts\n", (unsigned)cut_points);
+    return 0;
+}
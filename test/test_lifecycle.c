@@ -0,0 +1,237 @@
+// Heap of the face over a simulated week: the real main.c, detail.c and graph.c run against the
+// host SDK in host/, fed by the reference phone in host/phone.c, through the window, layer and
+// bitmap lifecycles of a week. Restarts every 12 to 36 hours load and unload the main window with
+// its graph and arrow bitmaps, taps open the detail window, which its timeout or another tap
+// closes, readings change the arrow, and reconnect storms and outages make the phone backfill.
+//
+// Fails on net allocation growth: a closed detail window must give back every block it took, the
+// face must hold the same blocks and bytes whenever it is idle, in every run, and an exit must
+// free everything.
+//
+// Each run of the face is a forked process, so it starts with the module state of a fresh start;
+// only the persistent storage, the phone and the totals are shared.
+
+#include "detail.h"
+#include "host.h"
+#include "phone.h"
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define START_TIME 1704067200 // 2024-01-01 00:00 UTC
+#define WEEK_SECONDS (7 * 24 * 60 * 60)
+#define CADENCE_SECONDS (5 * 60)
+#define RUN_MIN_SECONDS (12 * 60 * 60)
+#define RUN_MAX_SECONDS (36 * 60 * 60)
+
+// Chances per reading [1 in n]
+#define TAP_CHANCE 24
+#define STORM_CHANCE 150
+#define OUTAGE_CHANCE 3 // Of a storm, leaving the phone disconnected for an hour or two
+
+#define STORM_FLAPS 6
+
+// Heap of the face while idle: no detail window, no message in flight
+typedef struct {
+    size_t bytes;
+    uint32_t blocks;
+} Heap;
+
+// Shared with the runs
+typedef struct {
+    HostPersist persist;
+    Phone phone;
+    uint32_t now;      // Seconds since epoch, where the last run stopped
+    uint32_t random;   // State of next_random()
+    uint16_t mgdl;     // Of the last reading
+    int16_t velocity;  // Of the simulated BG [mg/dL per reading]
+    uint8_t arrow;     // Of the last reading
+    bool has_steady;   // Set by the first run
+    Heap steady;       // Idle heap of the first run
+    size_t peak_bytes; // Over all runs
+    uint32_t allocations, frees;
+    uint32_t runs, detail_views, storms, outages, arrow_changes;
+} Shared;
+
+static Shared *s_shared;
+
+static uint32_t next_random(uint32_t n) {
+    s_shared->random = s_shared->random * 1103515245 + 12345;
+    return (s_shared->random >> 16) % n;
+}
+
+static uint32_t now(void) { return host_clock_ms() / 1000; }
+
+static Heap heap(void) {
+    const size_t bytes = host_heap_in_use();
+    if (bytes > s_shared->peak_bytes) {
+        s_shared->peak_bytes = bytes;
+    }
+    return (Heap){bytes, host_heap_allocations() - host_heap_frees()};
+}
+
+// Checks the heap against the idle heap of the first run
+static void check_idle(void) {
+    const Heap idle = heap();
+    if (!s_shared->has_steady) {
+        s_shared->steady = idle;
+        s_shared->has_steady = true;
+    }
+    CHECK(idle.bytes == s_shared->steady.bytes);
+    CHECK(idle.blocks == s_shared->steady.blocks);
+}
+
+// Arrow index for a change per reading, as xDrip's slope thresholds do at 5 minute readings
+static uint8_t arrow_for(int16_t velocity) {
+    static const int16_t THRESHOLDS[] = {15, 10, 5, -5, -10, -15};
+    uint8_t arrow = 1;
+    while (arrow <= 6 && velocity < THRESHOLDS[arrow - 1]) {
+        arrow++;
+    }
+    return arrow;
+}
+
+// Sends the next reading: a random walk of the BG
+static void push_reading(void) {
+    int16_t velocity = s_shared->velocity + (int16_t)next_random(7) - 3;
+    velocity = velocity > 20 ? 20 : velocity < -20 ? -20 : velocity;
+    int16_t mgdl = s_shared->mgdl + velocity;
+    if (mgdl < 50 || mgdl > 350) {
+        velocity = -velocity;
+        mgdl = s_shared->mgdl + velocity;
+    }
+    const uint8_t arrow = arrow_for(velocity);
+    if (arrow != s_shared->arrow) {
+        s_shared->arrow_changes++;
+    }
+    s_shared->velocity = velocity;
+    s_shared->mgdl = mgdl;
+    s_shared->arrow = arrow;
+    phone_push(&(PhoneReading){.timestamp = now(), .mgdl = mgdl, .arrow_index = arrow});
+}
+
+// Opens the detail window with a tap, and closes it with another tap or by its timeout
+static void view_detail(void) {
+    const Heap before = heap();
+    host_tap();
+    CHECK(detail_is_visible());
+    heap();
+    s_shared->detail_views++;
+    if (next_random(2)) {
+        host_advance(1000 + next_random(5000));
+        host_tap();
+    } else {
+        host_advance(12000);
+    }
+    CHECK(!detail_is_visible());
+    const Heap after = heap();
+    CHECK(after.bytes == before.bytes);
+    CHECK(after.blocks == before.blocks);
+}
+
+// Flaps the connection faster than it settles, and leaves it connected, or disconnected until
+// the returned time, if it's an outage.
+static uint32_t reconnect_storm(void) {
+    s_shared->storms++;
+    for (int i = 0; i < STORM_FLAPS; i++) {
+        host_set_connected(false);
+        host_advance(100 + next_random(2000));
+        host_set_connected(true);
+        host_advance(100 + next_random(2000));
+    }
+    if (next_random(OUTAGE_CHANCE) > 0) {
+        return 0;
+    }
+    s_shared->outages++;
+    host_set_connected(false);
+    return now() + 60 * 60 + next_random(60 * 60);
+}
+
+static void events(void) {
+    const uint32_t run_seconds = RUN_MIN_SECONDS + next_random(RUN_MAX_SECONDS - RUN_MIN_SECONDS);
+    const uint32_t end = now() + run_seconds < START_TIME + WEEK_SECONDS
+                             ? now() + run_seconds
+                             : START_TIME + WEEK_SECONDS;
+    uint32_t reconnect_time = 0; // While disconnected
+    host_advance(1000);
+    while (now() < end) {
+        const uint32_t next_reading = now() + CADENCE_SECONDS;
+        if (reconnect_time > 0 && now() >= reconnect_time) {
+            host_set_connected(true);
+            reconnect_time = 0;
+        }
+        push_reading();
+        if (reconnect_time == 0) {
+            host_advance(60 * 1000); // Past a reconnect settling
+            check_idle();
+        }
+        if (next_random(TAP_CHANCE) == 0) {
+            view_detail();
+        }
+        if (reconnect_time == 0 && next_random(STORM_CHANCE) == 0) {
+            reconnect_time = reconnect_storm();
+        }
+        host_advance((next_reading - now()) * 1000);
+    }
+    if (reconnect_time > 0) {
+        host_set_connected(true);
+        host_advance(60 * 1000);
+    }
+    check_idle();
+    s_shared->now = now();
+}
+
+// Runs the face once, from start to exit, in a child process.
+static void run(void) {
+    fflush(stdout);
+    const pid_t pid = fork();
+    CHECK(pid >= 0);
+    if (pid == 0) {
+        host_persist_use(&s_shared->persist);
+        phone_use(&s_shared->phone);
+        host_clock_set_ms((uint64_t)s_shared->now * 1000);
+        host_app_run(face_main, events);
+        CHECK(host_heap_in_use() == 0);
+        CHECK(host_heap_allocations() == host_heap_frees());
+        s_shared->allocations += host_heap_allocations();
+        s_shared->frees += host_heap_frees();
+        fflush(stdout);
+        _exit(0);
+    }
+    int status;
+    CHECK(waitpid(pid, &status, 0) == pid);
+    CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    s_shared->runs++;
+}
+
+int main(void) {
+    s_shared =
+        mmap(NULL, sizeof(Shared), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    CHECK(s_shared != MAP_FAILED);
+    *s_shared = (Shared){.now = START_TIME, .random = 1, .mgdl = 120};
+    phone_use(&s_shared->phone);
+    phone_reset();
+
+    while (s_shared->now < START_TIME + WEEK_SECONDS) {
+        run();
+    }
+
+    const Phone *phone = &s_shared->phone;
+    printf("lifecycle: %u runs, %u detail views, %u arrow changes, %u reconnect storms (%u "
+           "outages) in a week\n",
+           (unsigned)s_shared->runs, (unsigned)s_shared->detail_views,
+           (unsigned)s_shared->arrow_changes, (unsigned)s_shared->storms,
+           (unsigned)s_shared->outages);
+    printf("lifecycle: %u allocations, %u frees; idle %u B in %u blocks, peak %u B of %u B\n",
+           (unsigned)s_shared->allocations, (unsigned)s_shared->frees,
+           (unsigned)s_shared->steady.bytes, (unsigned)s_shared->steady.blocks,
+           (unsigned)s_shared->peak_bytes, (unsigned)HOST_HEAP_SIZE);
+    printf("lifecycle: phone sent %u messages, %u B: %u readings, %u batches of %u readings\n",
+           (unsigned)phone->totals.messages, (unsigned)phone->totals.bytes,
+           (unsigned)phone->totals.readings, (unsigned)phone->totals.batches,
+           (unsigned)phone->totals.batch_readings);
+    CHECK(s_shared->storms > 0 && s_shared->outages > 0 && s_shared->detail_views > 0);
+    CHECK(phone->totals.batches > 0);
+    CHECK(s_shared->peak_bytes <= HOST_HEAP_SIZE);
+    return 0;
+}
@@ -0,0 +1,348 @@
+// Protocol conformance of the face: the real main.c, with the modules of the emery profile, runs
+// against the host SDK in host/ and talks to the reference phone in host/phone.c, which answers
+// the way xDrip and src/pkjs/send_queue.js do. Each scenario checks what the face does with what
+// it receives, and the messages and bytes that crossed in each direction, so a change that makes
+// the protocol chattier fails here until the expected totals are updated on purpose.
+//
+// Each run of the face is a forked process, so it starts with the module state of a fresh start;
+// only the persistent storage, the phone and the traffic totals are shared.
+
+#include "config.h"
+#include "detail.h"
+#include "history.h"
+#include "host.h"
+#include "phone.h"
+#include "xdrip.h"
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define START_TIME 1704110400 // 2024-01-01 12:00 UTC, outside the quiet hours
+#define CADENCE_SECONDS (5 * 60)
+
+// What the face announces with the default settings: everything but the extended fields, which
+// the detail view asks for. It also asks for history until the first backfill.
+#define STEADY_CAPABILITIES                                                                        \
+    (XDRIP_CAP_BG | XDRIP_CAP_TREND_ARROW | XDRIP_CAP_DELTA | XDRIP_CAP_LOOP)
+#define DEFAULT_CAPABILITIES (STEADY_CAPABILITIES | XDRIP_CAP_HISTORY)
+
+// Sizes of messages and their fields [bytes], see dict_calc_buffer_size()
+#define DICT_HEADER 1
+#define TUPLE(length) (7 + (length))
+#define ANNOUNCEMENT_SIZE (DICT_HEADER + TUPLE(1) + TUPLE(4) + TUPLE(2))
+
+typedef struct {
+    const char *name;
+    uint8_t runs;
+    void (*events)(uint8_t run);
+    HostTraffic expected;
+} Scenario;
+
+// Shared with the runs
+typedef struct {
+    HostPersist persist;
+    Phone phone;
+    HostTraffic traffic; // Over all runs of the scenario
+    uint32_t now;        // Seconds since epoch, where the last run stopped
+    uint16_t mgdl;       // Of the last reading pushed
+} Shared;
+
+static Shared *s_shared;
+static uint8_t s_run;
+
+static uint32_t now(void) { return host_clock_ms() / 1000; }
+
+static Phone *phone(void) { return &s_shared->phone; }
+
+// Pushes a reading at the current time, and lets the face handle it.
+static void push(void) {
+    s_shared->mgdl = 100 + (s_shared->mgdl + 7) % 150;
+    phone_push(&(PhoneReading){.timestamp = now(), .mgdl = s_shared->mgdl, .arrow_index = 4});
+    host_advance(1000);
+}
+
+// Pushes a reading every 5 minutes, `count` times, starting in 5 minutes.
+static void push_readings(uint16_t count) {
+    for (uint16_t i = 0; i < count; i++) {
+        host_advance(CADENCE_SECONDS * 1000 - 1000);
+        push();
+    }
+}
+
+static const HostTraffic *traffic(void) { return host_traffic(); }
+
+// Size of the data message for the last reading pushed, which changed by `delta`, with the fields
+// of `capabilities`
+static uint32_t reading_size(uint32_t capabilities, int16_t delta) {
+    char bg[8], delta_string[8];
+    snprintf(bg, sizeof(bg), "%u", s_shared->mgdl);
+    snprintf(delta_string, sizeof(delta_string), "%+d", delta);
+    uint32_t size = DICT_HEADER + TUPLE(4) + TUPLE(strlen(bg) + 1);
+    if (capabilities & XDRIP_CAP_DELTA) {
+        size += TUPLE(strlen(delta_string) + 1);
+    }
+    if (capabilities & XDRIP_CAP_TREND_ARROW) {
+        size += TUPLE(4);
+    }
+    if (capabilities & XDRIP_CAP_LOOP) {
+        size += TUPLE(strlen(phone()->iob) + 1) + TUPLE(strlen(phone()->cob) + 1);
+    }
+    if (capabilities & XDRIP_CAP_EXTENDED) {
+        size += TUPLE(strlen(phone()->sensor_age) + 1) + TUPLE(4);
+    }
+    return size;
+}
+
+// Scenarios
+
+// The face announces itself once at startup, and takes each reading as it comes.
+static void announce_and_readings(uint8_t run) {
+    host_advance(1000);
+    CHECK(phone()->announcements == 1);
+    CHECK(phone()->protocol_version == XDRIP_PROTOCOL_VERSION);
+    CHECK(phone()->capabilities == DEFAULT_CAPABILITIES);
+    CHECK(phone()->inbox_size == 256);
+    CHECK(traffic()->out_bytes == ANNOUNCEMENT_SIZE);
+
+    push_readings(12);
+    CHECK(xdrip_model()->bg_timestamp == phone()->delivered.timestamp);
+    CHECK(xdrip_model()->bg_mgdl == s_shared->mgdl);
+    CHECK(history_count() == 12);
+    CHECK(phone()->announcements == 1);
+}
+
+// A restart announces again, and xDrip answers with the reading the face already had, which
+// restores the display at once. The history comes back from the journal.
+static void restart(uint8_t run) {
+    host_advance(1000);
+    if (run == 0) {
+        push_readings(6);
+        return;
+    }
+    CHECK(phone()->announcements == 2);
+    CHECK(xdrip_model()->bg_timestamp == phone()->delivered.timestamp);
+    CHECK(history_count() == 6);
+    push_readings(1);
+    CHECK(history_count() == 7);
+}
+
+// Delivers a message written by `write`, bypassing the phone's queue
+static AppMessageResult deliver(void (*write)(DictionaryIterator *iter)) {
+    DictionaryIterator *iter = host_inbox_begin();
+    write(iter);
+    return host_inbox_deliver();
+}
+
+static void write_newer_reading(DictionaryIterator *iter) {
+    const uint32_t timestamp = now();
+    dict_write_int(iter, XDRIP_KEY_BG_TIMESTAMP, &timestamp, 4, false);
+    dict_write_cstring(iter, XDRIP_KEY_BG_STRING, "142");
+    dict_write_cstring(iter, 50, "a key from a newer xDrip");
+}
+
+static void write_malformed_reading(DictionaryIterator *iter) {
+    dict_write_cstring(iter, XDRIP_KEY_BG_TIMESTAMP, "1704110400");
+    dict_write_cstring(iter, XDRIP_KEY_BG_STRING, "99");
+}
+
+static void write_oversized(DictionaryIterator *iter) {
+    static const uint8_t s_padding[300];
+    dict_write_data(iter, 51, s_padding, sizeof(s_padding));
+}
+
+// Keys the face doesn't know are skipped, a malformed message changes nothing, and one too large
+// for the inbox is dropped before the face sees it. None of them stops the readings after them.
+static void unknown_and_malformed(uint8_t run) {
+    host_advance(1000);
+    push_readings(1);
+
+    host_advance(CADENCE_SECONDS * 1000);
+    CHECK(deliver(write_newer_reading) == APP_MSG_OK);
+    CHECK(xdrip_model()->bg_timestamp == now() && xdrip_model()->bg_mgdl == 142);
+
+    host_advance(1000);
+    const XdripModel before = *xdrip_model();
+    CHECK(deliver(write_malformed_reading) == APP_MSG_OK);
+    CHECK(xdrip_model()->bg_timestamp == before.bg_timestamp);
+    CHECK(strcmp(xdrip_model()->bg_string, before.bg_string) == 0);
+
+    CHECK(deliver(write_oversized) == APP_MSG_BUFFER_OVERFLOW);
+    CHECK(traffic()->in_dropped == 1);
+
+    push_readings(1);
+    CHECK(xdrip_model()->bg_timestamp == phone()->delivered.timestamp);
+}
+
+// Waits out the face's limit on announcements, so the next change is announced at once
+static void wait_announce_interval(void) { host_advance(6000); }
+
+// Checks the announced capabilities, and that the next reading has just their fields.
+static void check_capabilities(uint32_t expected) {
+    CHECK(phone()->capabilities == expected);
+    const uint32_t bytes = traffic()->in_bytes;
+    const uint16_t previous_mgdl = s_shared->mgdl;
+    push();
+    CHECK(traffic()->in_bytes - bytes == reading_size(expected, s_shared->mgdl - previous_mgdl));
+    CHECK(xdrip_model()->bg_timestamp == now() - 1);
+}
+
+// The capabilities the face announces as its view changes: loop fields while they are shown,
+// which the battery saver stops, and the extended fields while the detail view is open. Each
+// announcement gets the newest reading again, with the fields asked for.
+static void face_capabilities(uint8_t run) {
+    host_advance(1000);
+    push();
+    for (int battery_saver = 0; battery_saver < 2; battery_saver++) {
+        host_set_battery(battery_saver ? BATTERY_SAVER_PERCENT : 100, false);
+        wait_announce_interval();
+        const uint32_t capabilities =
+            battery_saver ? DEFAULT_CAPABILITIES & ~XDRIP_CAP_LOOP : DEFAULT_CAPABILITIES;
+        check_capabilities(capabilities);
+
+        host_tap();
+        wait_announce_interval();
+        CHECK(detail_is_visible());
+        check_capabilities(capabilities | XDRIP_CAP_EXTENDED);
+        host_tap();
+        CHECK(!detail_is_visible());
+        wait_announce_interval();
+        check_capabilities(capabilities);
+    }
+}
+
+// Every capability set a phone may answer with, whatever the face asked for: the face takes the
+// fields it gets, and keeps the ones it doesn't get.
+static void phone_capabilities(uint8_t run) {
+    host_advance(1000);
+    for (uint32_t capabilities = 0; capabilities < 64; capabilities++) {
+        phone()->capabilities = capabilities | XDRIP_CAP_BG;
+        snprintf(phone()->iob, sizeof(phone()->iob), "%u.0U", (unsigned)capabilities % 10);
+        snprintf(phone()->sensor_age, sizeof(phone()->sensor_age), "%ud", (unsigned)capabilities);
+        const XdripModel before = *xdrip_model();
+        const uint32_t bytes = traffic()->in_bytes;
+        const uint16_t previous_mgdl = s_shared->mgdl;
+        push_readings(1);
+        CHECK(traffic()->in_bytes - bytes ==
+              reading_size(phone()->capabilities, s_shared->mgdl - previous_mgdl));
+        CHECK(xdrip_model()->bg_mgdl == s_shared->mgdl);
+        const bool has_loop = capabilities & XDRIP_CAP_LOOP;
+        CHECK(strcmp(xdrip_model()->iob_string, has_loop ? phone()->iob : before.iob_string) == 0);
+        const bool has_extended = capabilities & XDRIP_CAP_EXTENDED;
+        CHECK(strcmp(xdrip_model()->sensor_age_string,
+                     has_extended ? phone()->sensor_age : before.sensor_age_string) == 0);
+    }
+}
+
+// Connection flaps faster than it settles cost one announcement once it has settled, and one
+// re-sent reading.
+static void reconnect_storm(uint8_t run) {
+    host_advance(1000);
+    push_readings(1);
+    for (int i = 0; i < 6; i++) {
+        host_set_connected(false);
+        host_advance(700);
+        host_set_connected(true);
+        host_advance(300);
+    }
+    CHECK(phone()->announcements == 1);
+    host_advance(CONNECTION_SETTLE_MS + 3000);
+    CHECK(phone()->announcements == 2);
+    CHECK(phone()->capabilities == DEFAULT_CAPABILITIES);
+    push_readings(1);
+}
+
+// After two hours away, the face asks for history, and the phone backfills what the face missed
+// in one batch, sharing its message with the newest reading. Then the face stops asking, until
+// the next gap.
+static void outage(uint8_t run) {
+    host_advance(1000);
+    push_readings(3);
+    host_set_connected(false);
+    push_readings(24);
+    CHECK(phone()->pending_count == 23 && phone()->has_latest);
+    CHECK(history_count() == 3);
+    host_set_connected(true);
+    host_advance(CONNECTION_SETTLE_MS + 3000);
+    CHECK(phone()->totals.batches == 1 && phone()->totals.batch_readings == 23);
+    CHECK(history_count() == 27);
+    CHECK(xdrip_model()->bg_timestamp == phone()->delivered.timestamp);
+    wait_announce_interval();
+    CHECK(phone()->capabilities == STEADY_CAPABILITIES);
+    push_readings(1);
+    CHECK(history_count() == 28);
+}
+
+// Expected traffic: messages and bytes in, dropped, messages and bytes out, failed sends
+static const Scenario SCENARIOS[] = {
+    {"announce and readings", 1, announce_and_readings, {12, 819, 0, 1, 29, 0}},
+    {"restart", 2, restart, {8, 545, 0, 2, 58, 0}},
+    {"unknown and malformed", 1, unknown_and_malformed, {4, 220, 1, 1, 29, 0}},
+    {"face capabilities", 1, face_capabilities, {12, 777, 0, 6, 174, 0}},
+    {"phone capabilities", 1, phone_capabilities, {64, 3594, 0, 1, 29, 0}},
+    {"reconnect storm", 1, reconnect_storm, {3, 203, 0, 2, 58, 0}},
+    {"outage", 1, outage, {6, 450, 0, 3, 87, 0}},
+};
+
+static const Scenario *s_scenario;
+
+static void events(void) {
+    s_scenario->events(s_run);
+    s_shared->now = now();
+}
+
+static void add_traffic(HostTraffic *total, const HostTraffic *run) {
+    total->in_messages += run->in_messages;
+    total->in_bytes += run->in_bytes;
+    total->in_dropped += run->in_dropped;
+    total->out_messages += run->out_messages;
+    total->out_bytes += run->out_bytes;
+    total->out_failed += run->out_failed;
+}
+
+// Runs the face once, from start to exit, in a child process.
+static void run(void) {
+    fflush(stdout);
+    const pid_t pid = fork();
+    CHECK(pid >= 0);
+    if (pid == 0) {
+        host_persist_use(&s_shared->persist);
+        phone_use(&s_shared->phone);
+        host_clock_set_ms((uint64_t)s_shared->now * 1000);
+        host_app_run(face_main, events);
+        add_traffic(&s_shared->traffic, host_traffic());
+        fflush(stdout);
+        _exit(0);
+    }
+    int status;
+    CHECK(waitpid(pid, &status, 0) == pid);
+    CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+
+int main(void) {
+    s_shared =
+        mmap(NULL, sizeof(Shared), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    CHECK(s_shared != MAP_FAILED);
+    phone_use(&s_shared->phone);
+
+    for (s_scenario = SCENARIOS; s_scenario < SCENARIOS + sizeof(SCENARIOS) / sizeof(SCENARIOS[0]);
+         s_scenario++) {
+        *s_shared = (Shared){.now = START_TIME};
+        phone_reset();
+        for (s_run = 0; s_run < s_scenario->runs; s_run++) {
+            run();
+        }
+        const HostTraffic *total = &s_shared->traffic;
+        printf("protocol: %s: %u messages, %u B in (%u dropped); %u messages, %u B out\n",
+               s_scenario->name, (unsigned)total->in_messages, (unsigned)total->in_bytes,
+               (unsigned)total->in_dropped, (unsigned)total->out_messages,
+               (unsigned)total->out_bytes);
+        const HostTraffic *expected = &s_scenario->expected;
+        CHECK(total->in_messages == expected->in_messages);
+        CHECK(total->in_bytes == expected->in_bytes);
+        CHECK(total->in_dropped == expected->in_dropped);
+        CHECK(total->out_messages == expected->out_messages);
+        CHECK(total->out_bytes == expected->out_bytes);
+        CHECK(total->out_failed == expected->out_failed);
+    }
+    return 0;
+}
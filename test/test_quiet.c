@@ -0,0 +1,129 @@
+// The reduced update mode over a night: the real main.c, with the modules of the emery profile,
+// runs against the host SDK in host/ with Quiet Time on from 22:00 to 06:02, fed a reading every
+// 5 minutes by the reference phone, but for a two hour outage. Wrist taps wake it twice.
+//
+// Checks that the face wakes a few times an hour instead of every minute, also while no reading
+// comes, that it leaves the mode with the first reading after Quiet Time ends, or within half an
+// hour without readings, and that a night with taps is summarized in a single log record.
+
+#include "config.h"
+#include "host.h"
+#include "log.h"
+#include "phone.h"
+#include "quiet.h"
+
+#define START_TIME 1704142800 // 2024-01-01 21:00 UTC
+#define CADENCE_SECONDS (5 * 60)
+
+#define MAX_PERIODS 4
+
+// Quiet period summaries logged, see LOG_EVENT_QUIET_ENDED
+typedef struct {
+    uint8_t hours;
+    uint16_t saved_wakeups, saved_redraws;
+} Period;
+
+static Period s_periods[MAX_PERIODS];
+static uint8_t s_period_count;
+
+// The binary log, instead of log.c
+void log_event(LogEvent event, uint8_t arg0, uint16_t arg1, uint16_t arg2) {
+    if (event == LOG_EVENT_QUIET_ENDED) {
+        CHECK(s_period_count < MAX_PERIODS);
+        s_periods[s_period_count++] = (Period){arg0, arg1, arg2};
+    }
+}
+
+size_t log_dump(uint8_t *buf) { return 0; }
+
+static Phone s_phone;
+static uint16_t s_reading_count;
+
+static uint32_t now(void) { return host_clock_ms() / 1000; }
+
+// Time of the night starting at START_TIME, hours before 21 being the next day's
+static uint32_t night(uint8_t hour, uint8_t minute) {
+    const uint32_t day = hour < 21 ? 24 * 60 * 60 : 0;
+    return START_TIME - 21 * 60 * 60 + day + hour * 60 * 60 + minute * 60;
+}
+
+// Moves the clock to `end`, with a reading every 5 minutes on the way if the phone is in range.
+// Readings stay in the target range, so no alert wakes the face.
+static void until(uint32_t end, bool with_readings) {
+    while (now() < end) {
+        const uint32_t next = (now() / CADENCE_SECONDS + 1) * CADENCE_SECONDS;
+        host_advance(((next < end ? next : end) - now()) * 1000);
+        if (with_readings && now() % CADENCE_SECONDS == 0) {
+            const uint16_t mgdl = 110 + (s_reading_count++ * 7) % 30;
+            phone_push(&(PhoneReading){.timestamp = now(), .mgdl = mgdl, .arrow_index = 4});
+        }
+    }
+}
+
+static uint32_t wakeups(void) { return host_counters()->ticks + host_counters()->timers; }
+
+static void events(void) {
+    until(night(22, 0), true);
+    host_set_quiet_time(true);
+    until(night(22, 5), true);
+    CHECK(quiet_is_active());
+    const uint32_t night_wakeups = wakeups();
+
+    until(night(23, 30), true);
+    host_tap();
+    CHECK(!quiet_is_active());
+    until(night(23, 35), true);
+    CHECK(quiet_is_active());
+
+    // Without readings, only the hourly ticks and the Quiet Time checks wake the face
+    until(night(1, 0), true);
+    host_set_connected(false);
+    const uint32_t outage_wakeups = wakeups();
+    until(night(3, 0), false);
+    const uint32_t outage = wakeups() - outage_wakeups;
+    host_set_connected(true);
+
+    until(night(4, 0), true);
+    host_tap();
+    until(night(6, 2), true);
+    host_set_quiet_time(false);
+    const uint32_t night_total = wakeups() - night_wakeups;
+    CHECK(quiet_is_active());
+    CHECK(s_period_count == 0); // Taps don't end the period
+    until(night(6, 5) + 1, true);
+    CHECK(!quiet_is_active());
+    CHECK(s_period_count == 1);
+
+    printf("quiet: %u wakeups from 22:05 to 06:02 instead of %u, %u in a 2 hour outage\n",
+           (unsigned)night_total, (unsigned)((night(6, 2) - night(22, 5)) / 60),
+           (unsigned)outage);
+    printf("quiet: logged %u hours, %u wakeups and %u redraws saved\n",
+           (unsigned)s_periods[0].hours, (unsigned)s_periods[0].saved_wakeups,
+           (unsigned)s_periods[0].saved_redraws);
+    CHECK(outage <= 2 + 120 / 20); // Hourly ticks and checks
+    CHECK(night_total < 40);
+    CHECK(s_periods[0].hours == 7);
+    CHECK(s_periods[0].saved_wakeups > 400);
+
+    // Quiet Time ending while no reading comes
+    until(night(7, 0), true);
+    host_set_connected(false);
+    host_set_quiet_time(true);
+    until(night(7, 5), false);
+    CHECK(quiet_is_active());
+    host_set_quiet_time(false);
+    until(night(7, 35), false);
+    CHECK(!quiet_is_active());
+    CHECK(s_period_count == 2);
+    host_set_connected(true);
+    until(night(7, 40), true);
+}
+
+int main(void) {
+    phone_use(&s_phone);
+    phone_reset();
+    host_clock_set_ms((uint64_t)START_TIME * 1000);
+    host_app_run(face_main, events);
+    CHECK(host_heap_in_use() == 0);
+    return 0;
+}
@@ -0,0 +1,106 @@
+// Send queue, see src/pkjs/send_queue.js: the readings missed while the watch is out of range reach
+// it as history batches once it asks for them, also when the first announcement after the
+// reconnect doesn't, and are only dropped for watchfaces that never take batches.
+
+var assert = require('assert');
+var SendQueue = require('../src/pkjs/send_queue');
+
+var CAP_HISTORY = 1 << 5;
+var CADENCE_SECONDS = 5 * 60;
+var START_TIMESTAMP = 1700000100;
+var INBOX_SIZE = 256;
+
+// Timestamps of the readings in a history batch, see src/c/history_batch.h for the layout
+function batchTimestamps(bytes) {
+  var intervalSeconds = bytes[1] * 60;
+  var slotCount = bytes[2] | (bytes[3] << 8);
+  var base = (bytes[4] | (bytes[5] << 8) | (bytes[6] << 16) | (bytes[7] << 24)) >>> 0;
+  var timestamps = [];
+  for (var slot = 0; slot < slotCount; slot++) {
+    if (bytes[10 + (slot >> 3)] & (1 << (slot & 7))) {
+      timestamps.push(base + slot * intervalSeconds);
+    }
+  }
+  return timestamps;
+}
+
+// A watch that takes every message while in range, and records the readings it got
+function Watch() {
+  this.inRange = true;
+  this.timestamps = {};
+  this.batches = 0;
+  var self = this;
+  this.queue = new SendQueue(function(dict, onSuccess, onFailure) {
+    if (!self.inRange) {
+      onFailure();
+      return;
+    }
+    assert(dict.HistoryBatch === undefined || self.asksForHistory, 'batch not asked for');
+    if (dict.HistoryBatch) {
+      self.batches++;
+      batchTimestamps(dict.HistoryBatch).forEach(function(timestamp) {
+        self.timestamps[timestamp] = true;
+      });
+    }
+    if (dict.Timestamp) {
+      self.timestamps[dict.Timestamp] = true;
+    }
+    onSuccess();
+  });
+}
+
+Watch.prototype.announce = function(payload) {
+  this.asksForHistory = (payload.Capabilities & CAP_HISTORY) !== 0;
+  this.queue.onAnnouncement(payload);
+};
+
+Watch.prototype.has = function(index) {
+  return this.timestamps[START_TIMESTAMP + index * CADENCE_SECONDS] === true;
+};
+
+function push(watch, index) {
+  var timestamp = START_TIMESTAMP + index * CADENCE_SECONDS;
+  var mgdl = 100 + index * 7 % 150;
+  watch.queue.push({timestamp: timestamp, mgdl: mgdl, fields: {Timestamp: timestamp}});
+}
+
+// Sends readings [0, 12) in range, then [12, 36) out of range, then reconnects, announcing
+// `reconnected` once the connection has settled and `gap` with the next reading.
+function disconnect(reconnected, gap) {
+  var watch = new Watch();
+  watch.announce(reconnected);
+  for (var i = 0; i < 36; i++) {
+    watch.inRange = i < 12;
+    push(watch, i);
+  }
+  watch.inRange = true;
+  watch.announce(reconnected);
+  push(watch, 36);
+  if (gap) {
+    watch.announce(gap);
+  }
+  return watch;
+}
+
+// A watchface asking for history as soon as the connection has settled
+var watch = disconnect({Capabilities: CAP_HISTORY, InboxSize: INBOX_SIZE});
+for (var i = 0; i <= 36; i++) {
+  assert(watch.has(i), 'reading ' + i + ' missing');
+}
+assert(watch.batches > 0 && watch.queue.pending.length === 0);
+console.log('send queue: ' + watch.queue.messagesSent + ' messages for 37 readings, ' +
+            watch.batches + ' of them history batches');
+
+// One noticing the gap only with the first reading after it: the missed readings wait for it
+watch = disconnect({Capabilities: 0, InboxSize: INBOX_SIZE},
+                   {Capabilities: CAP_HISTORY, InboxSize: INBOX_SIZE});
+for (i = 0; i <= 36; i++) {
+  assert(watch.has(i), 'reading ' + i + ' missing after the late request');
+}
+assert(watch.queue.pending.length === 0);
+
+// One without history: only the newest reading, and nothing kept for it
+watch = disconnect({Capabilities: 0});
+assert(watch.has(36) && !watch.has(20) && watch.batches === 0);
+assert(watch.queue.pending.length === 0);
+console.log('send queue: missed readings backfilled after a reconnect');
@@ -0,0 +1,237 @@
+// Conformance of the watch side of the xDrip protocol, see xdrip.h: which messages xdrip_receive()
+// accepts and rejects, what a rejected message leaves untouched, and the order in which the
+// handlers see the parts of an accepted one.
+
+#include "host.h"
+#include "xdrip.h"
+
+#define MAX_CALLS 8
+
+typedef enum {
+    CALL_SETTINGS,
+    CALL_HISTORY_BATCH,
+    CALL_MODEL_CHANGED,
+    CALL_DEBUG_DUMP,
+} Call;
+
+static Call s_calls[MAX_CALLS];
+static int s_call_count;
+static uint32_t s_changes; // Of the last model_changed call
+static XdripField s_sent[4]; // Of the last send, with the data copied to s_sent_data
+static uint8_t s_sent_data[4][8];
+static size_t s_sent_count;
+
+static void record(Call call) {
+    CHECK(s_call_count < MAX_CALLS);
+    s_calls[s_call_count++] = call;
+}
+
+static void settings_handler(const uint8_t *data, uint16_t length) { record(CALL_SETTINGS); }
+
+static void history_batch_handler(const uint8_t *data, uint16_t length) {
+    record(CALL_HISTORY_BATCH);
+}
+
+static void model_changed_handler(const XdripModel *model, uint32_t changes) {
+    record(CALL_MODEL_CHANGED);
+    s_changes = changes;
+}
+
+static void debug_dump_handler(void) { record(CALL_DEBUG_DUMP); }
+
+static bool send_handler(const XdripField *fields, size_t count) {
+    CHECK(count <= sizeof(s_sent) / sizeof(s_sent[0]));
+    for (size_t i = 0; i < count; i++) {
+        CHECK(fields[i].length <= sizeof(s_sent_data[i]));
+        memcpy(s_sent_data[i], fields[i].data, fields[i].length);
+        s_sent[i] = fields[i];
+        s_sent[i].data = s_sent_data[i];
+    }
+    s_sent_count = count;
+    return true;
+}
+
+// Fields, as AppMessage tuples arrive
+#define UINT8(key, value) {key, XDRIP_TYPE_UINT, 1, (const uint8_t[]){value}}
+#define UINT32(key, value)                                                                         \
+    {key, XDRIP_TYPE_UINT, 4,                                                                      \
+     (const uint8_t[]){(value) & 0xFF, ((value) >> 8) & 0xFF, ((value) >> 16) & 0xFF,              \
+                       ((value) >> 24) & 0xFF}}
+#define INT32(key, value)                                                                          \
+    {key, XDRIP_TYPE_INT, 4,                                                                       \
+     (const uint8_t[]){(uint32_t)(value) & 0xFF, ((uint32_t)(value) >> 8) & 0xFF,                  \
+                       ((uint32_t)(value) >> 16) & 0xFF, ((uint32_t)(value) >> 24) & 0xFF}}
+#define STRING(key, value) {key, XDRIP_TYPE_STRING, sizeof(value), (const uint8_t *)(value)}
+#define BYTES(key, ...) {key, XDRIP_TYPE_BYTES, sizeof((const uint8_t[]){__VA_ARGS__}),           \
+                         (const uint8_t[]){__VA_ARGS__}}
+
+// A field with an explicit type and length, e.g. one that doesn't match its data
+#define RAW(key, type, length, ...) {key, type, length, (const uint8_t[]){__VA_ARGS__}}
+
+#define COUNT(fields) (sizeof(fields) / sizeof(fields[0]))
+
+#define NOW 1700000000
+
+static bool receive(const XdripField *fields, size_t count, const XdripField **rejected) {
+    s_call_count = 0;
+    return xdrip_receive(fields, count, NOW, rejected);
+}
+
+// A message with `field` next to valid ones must be rejected at `field`, and change nothing.
+static void check_rejected(XdripField field) {
+    const XdripField fields[] = {
+        UINT32(XDRIP_KEY_BG_TIMESTAMP, NOW - 60),
+        STRING(XDRIP_KEY_BG_STRING, "99"),
+        field,
+    };
+    const XdripModel before = *xdrip_model();
+    const XdripField *rejected = NULL;
+    CHECK(!receive(fields, COUNT(fields), &rejected));
+    CHECK(rejected == &fields[2]);
+    CHECK(s_call_count == 0);
+    CHECK(memcmp(&before, xdrip_model(), sizeof(before)) == 0);
+}
+
+static void check_accepted(const XdripField *fields, size_t count) {
+    const XdripField *rejected = NULL;
+    CHECK(receive(fields, count, &rejected));
+    CHECK(rejected == NULL);
+}
+
+int main(void) {
+    xdrip_init(&(XdripHandlers){
+        .model_changed = model_changed_handler,
+        .settings = settings_handler,
+        .history_batch = history_batch_handler,
+        .debug_dump = debug_dump_handler,
+        .send = send_handler,
+    });
+
+    // A reading, as xDrip sends it
+    const XdripField reading[] = {
+        UINT32(XDRIP_KEY_BG_TIMESTAMP, NOW - 120),
+        STRING(XDRIP_KEY_BG_STRING, "7.5"),
+        STRING(XDRIP_KEY_DELTA_STRING, "+0.3"),
+        UINT8(XDRIP_KEY_ARROW_INDEX, 4),
+    };
+    check_accepted(reading, COUNT(reading));
+    CHECK(s_call_count == 1 && s_calls[0] == CALL_MODEL_CHANGED);
+    CHECK(s_changes == (XDRIP_CHANGED_READING | XDRIP_NEW_READING));
+    CHECK(strcmp(xdrip_model()->bg_string, "7.5") == 0);
+    CHECK(xdrip_model()->bg_is_mmol && xdrip_model()->bg_mgdl == 135);
+    CHECK(xdrip_model()->arrow_index == 4);
+    CHECK(xdrip_model()->last_message_time == NOW);
+
+    // The re-sent reading after an announcement is not a new one
+    check_accepted(reading, COUNT(reading));
+    CHECK(s_changes == XDRIP_CHANGED_READING);
+
+    // An older reading doesn't replace the newer one
+    const XdripField older[] = {
+        UINT32(XDRIP_KEY_BG_TIMESTAMP, NOW - 420),
+        STRING(XDRIP_KEY_BG_STRING, "6.1"),
+        UINT8(XDRIP_KEY_ARROW_INDEX, 6),
+    };
+    check_accepted(older, COUNT(older));
+    CHECK(s_changes == 0);
+    CHECK(xdrip_model()->bg_timestamp == NOW - 120);
+    CHECK(strcmp(xdrip_model()->bg_string, "7.5") == 0 && xdrip_model()->arrow_index == 4);
+
+    // Wrong tuple types
+    check_rejected((XdripField)STRING(XDRIP_KEY_BG_TIMESTAMP, "123"));
+    check_rejected((XdripField)UINT32(XDRIP_KEY_BG_STRING, 135));
+    check_rejected((XdripField)STRING(XDRIP_KEY_ARROW_INDEX, "4"));
+    check_rejected((XdripField)UINT32(XDRIP_KEY_IOB_STRING, 1));
+    check_rejected((XdripField)STRING(XDRIP_KEY_HISTORY_BATCH, "1"));
+    check_rejected((XdripField)UINT8(XDRIP_KEY_SETTINGS, 1));
+
+    // Integers of the wrong length, or out of the key's range. PebbleKit JS sends every number as
+    // an int32, which is fine if the value fits.
+    check_rejected((XdripField)RAW(XDRIP_KEY_BG_TIMESTAMP, XDRIP_TYPE_UINT, 2, 1, 2));
+    check_rejected((XdripField)RAW(XDRIP_KEY_ARROW_INDEX, XDRIP_TYPE_UINT, 2, 1, 0));
+    check_rejected((XdripField)INT32(XDRIP_KEY_ARROW_INDEX, 256));
+    check_rejected((XdripField)INT32(XDRIP_KEY_ARROW_INDEX, -1));
+    check_rejected((XdripField)INT32(XDRIP_KEY_PHONE_BATTERY, 300));
+    check_rejected((XdripField)INT32(XDRIP_KEY_BG_TIMESTAMP, -5));
+    check_rejected((XdripField)RAW(XDRIP_KEY_PHONE_BATTERY, XDRIP_TYPE_INT, 1, 50));
+    const XdripField js_numbers[] = {
+        INT32(XDRIP_KEY_BG_TIMESTAMP, NOW - 60),
+        INT32(XDRIP_KEY_ARROW_INDEX, 7),
+        INT32(XDRIP_KEY_PHONE_BATTERY, 100),
+    };
+    check_accepted(js_numbers, COUNT(js_numbers));
+    CHECK(xdrip_model()->bg_timestamp == NOW - 60);
+    CHECK(xdrip_model()->arrow_index == 7 && xdrip_model()->phone_battery == 100);
+    CHECK(s_changes == (XDRIP_CHANGED_READING | XDRIP_NEW_READING | XDRIP_CHANGED_EXTENDED));
+
+    // Strings must be terminated within the field. Longer ones are truncated to the model's
+    // buffers.
+    check_rejected((XdripField)RAW(XDRIP_KEY_BG_STRING, XDRIP_TYPE_STRING, 3, '1', '3', '5'));
+    check_rejected((XdripField)RAW(XDRIP_KEY_DELTA_STRING, XDRIP_TYPE_STRING, 0, 0));
+    const XdripField long_strings[] = {
+        UINT32(XDRIP_KEY_BG_TIMESTAMP, NOW - 30),
+        STRING(XDRIP_KEY_BG_STRING, "1234567890"),
+        STRING(XDRIP_KEY_IOB_STRING, "123.456789U"),
+        STRING(XDRIP_KEY_SENSOR_AGE_STRING, "14 days 23 hours"),
+    };
+    check_accepted(long_strings, COUNT(long_strings));
+    CHECK(strcmp(xdrip_model()->bg_string, "1234") == 0);
+    CHECK(strcmp(xdrip_model()->iob_string, "123.45") == 0);
+    CHECK(strcmp(xdrip_model()->sensor_age_string, "14 days") == 0);
+    CHECK(s_changes == (XDRIP_CHANGED_READING | XDRIP_NEW_READING | XDRIP_CHANGED_LOOP |
+                        XDRIP_CHANGED_EXTENDED));
+
+    // Unknown keys of any type are skipped, so newer senders can add keys
+    const XdripField unknown[] = {
+        UINT32(200, 1),
+        STRING(XDRIP_KEY_BG_STRING, "140"),
+        BYTES(201, 1, 2, 3),
+        UINT32(XDRIP_KEY_BG_TIMESTAMP, NOW),
+        STRING(202, "x"),
+    };
+    check_accepted(unknown, COUNT(unknown));
+    CHECK(s_call_count == 1 && s_calls[0] == CALL_MODEL_CHANGED);
+    CHECK(xdrip_model()->bg_mgdl == 140 && !xdrip_model()->bg_is_mmol);
+
+    // Settings, a history batch and a reading in one message: settings first, so they apply to
+    // the rest, then the backfill, then the reading, whatever the order of the tuples
+    const XdripField combined[] = {
+        STRING(XDRIP_KEY_BG_STRING, "150"),
+        BYTES(XDRIP_KEY_HISTORY_BATCH, 1, 5, 1, 0, 0, 0, 0, 0, 100, 0, 1),
+        UINT32(XDRIP_KEY_BG_TIMESTAMP, NOW + 300),
+        BYTES(XDRIP_KEY_SETTINGS, 1, 0, 70, 0, 180, 0, 0xFF, 0x03),
+    };
+    check_accepted(combined, COUNT(combined));
+    CHECK(s_call_count == 3);
+    CHECK(s_calls[0] == CALL_SETTINGS);
+    CHECK(s_calls[1] == CALL_HISTORY_BATCH);
+    CHECK(s_calls[2] == CALL_MODEL_CHANGED);
+
+    // Messages without a reading update the message time, but not the model's reading
+    const XdripField batch_only[] = {BYTES(XDRIP_KEY_HISTORY_BATCH, 1)};
+    check_accepted(batch_only, COUNT(batch_only));
+    CHECK(s_call_count == 1 && s_calls[0] == CALL_HISTORY_BATCH);
+    CHECK(xdrip_model()->bg_timestamp == NOW + 300);
+
+    // A debug dump request is answered on its own
+    const XdripField dump[] = {
+        UINT8(XDRIP_KEY_DEBUG_DUMP, 1),
+        UINT32(XDRIP_KEY_BG_TIMESTAMP, NOW + 600),
+    };
+    check_accepted(dump, COUNT(dump));
+    CHECK(s_call_count == 1 && s_calls[0] == CALL_DEBUG_DUMP);
+    CHECK(xdrip_model()->bg_timestamp == NOW + 300);
+
+    // The announcement: protocol version, capabilities and inbox size, little endian
+    CHECK(xdrip_announce(XDRIP_CAP_BG | XDRIP_CAP_HISTORY, 256));
+    CHECK(s_sent_count == 3);
+    CHECK(s_sent[0].key == XDRIP_KEY_PROTOCOL_VERSION && s_sent[0].type == XDRIP_TYPE_UINT &&
+          s_sent[0].length == 1);
+    CHECK(s_sent[1].key == XDRIP_KEY_CAPABILITIES && s_sent[1].length == 4);
+    CHECK(s_sent[1].data[0] == (XDRIP_CAP_BG | XDRIP_CAP_HISTORY));
+    CHECK(s_sent[2].key == XDRIP_KEY_INBOX_SIZE && s_sent[2].length == 2);
+    CHECK(s_sent[2].data[0] == 0 && s_sent[2].data[1] == 1);
+
+    printf("xdrip: conformance checks passed\n");
+    return 0;
+}
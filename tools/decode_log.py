@@ -0,0 +1,79 @@
+#!/usr/bin/env python3
+"""Decodes a binary log dump from the watchface (see src/c/log.h).
+
+Usage: decode_log.py <hex>, or the hex on stdin. The dump is the KEY_DEBUG_LOG byte array the
+watchface sends in reply to KEY_DEBUG_DUMP, in a build with LOG_LEVEL above none.
+
+Times are anchored on the dump's full timestamp. Records before a gap of more than 18 hours, e.g.
+over a quiet night, are marked with '?', as their day is unknown.
+"""
+import datetime
+import struct
+import sys
+
+# Keep in sync with LogEvent in src/c/log.h. Values are (name, argument names).
+EVENTS = {
+    1: ('bg_received', ('arrow', 'mgdl', 'new')),
+    2: ('outbox_begin_failed', (None, 'result', None)),
+    3: ('outbox_send_failed', (None, 'result', None)),
+    4: ('capabilities_sent', ('version', 'caps_lo', 'caps_hi')),
+    5: ('heap_growth', (None, 'grown', 'startup')),
+    6: ('history_batch', ('valid', 'bytes', 'readings')),
+    7: ('message_rejected', ('type', 'key', 'length')),
+    8: ('alloc_failed', ('site', 'free', 'used')),
+    9: ('quiet_ended', ('hours', 'saved_wakeups', 'saved_redraws')),
+    10: ('settings', ('valid', 'bytes', 'changes')),
+}
+
+# Keep in sync with AllocSite in src/c/metrics.h
+ALLOC_SITES = {1: 'detail_window', 2: 'detail_view', 3: 'graph_cache'}
+
+HEADER = struct.Struct('<I')
+RECORD = struct.Struct('<HBBHH')
+
+# Set in a record's event when the gap to the next record, or to the dump, exceeds 0xFFFF seconds.
+# See LOG_EVENT_AMBIGUOUS_TIME in src/c/log.h.
+AMBIGUOUS_TIME = 0x80
+
+
+def decode(data):
+    """Returns (timestamp, is_exact, name, args) per record, oldest first.
+
+    Records only keep the low 16 bits of their time. Each is placed at the latest time before the
+    next record (or the dump's full timestamp, for the newest one) with those bits. Where the
+    watch flagged a gap of more than 0xFFFF seconds, the record and all older ones are only known
+    up to a multiple of 0xFFFF + 1 seconds: they are placed at the latest time the flag allows,
+    and is_exact is False.
+    """
+    (now,) = HEADER.unpack_from(data)
+    records = [RECORD.unpack_from(data, offset)
+               for offset in range(HEADER.size, len(data) - RECORD.size + 1, RECORD.size)]
+    decoded = []
+    later_time = now
+    is_exact = True
+    for time16, event, arg0, arg1, arg2 in reversed(records):
+        timestamp = later_time - ((later_time - time16) & 0xFFFF)
+        if event & AMBIGUOUS_TIME:
+            event &= ~AMBIGUOUS_TIME
+            is_exact = False
+            timestamp -= 0x10000
+        later_time = timestamp
+        name, arg_names = EVENTS.get(event, ('event_{}'.format(event), ('a0', 'a1', 'a2')))
+        if name == 'alloc_failed':
+            arg0 = ALLOC_SITES.get(arg0, arg0)
+        args = ', '.join('{}={}'.format(n, v)
+                         for n, v in zip(arg_names, (arg0, arg1, arg2)) if n)
+        decoded.append((datetime.datetime.utcfromtimestamp(timestamp), is_exact, name, args))
+    return reversed(decoded)
+
+
+def main():
+    text = sys.argv[1] if len(sys.argv) > 1 else sys.stdin.read()
+    for timestamp, is_exact, name, args in decode(bytes.fromhex(text.strip())):
+        # '?': at this time, or a multiple of 18.2 hours earlier
+        print('{:%Y-%m-%d %H:%M:%S}{} {:<20} {}'.format(timestamp, ' ' if is_exact else '?', name,
+                                                         args))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,153 @@
+#!/usr/bin/env python3
+"""Estimates the watchface's battery use in mAh/day from its event counters.
+
+Usage: energy_model.py [--platform P] [--hours N] [--log FILE [--report-minutes N]]
+
+Without --log, replays the real face in the standard scenarios on the host (see test/replay.c,
+built with `make -C test replay`) and estimates from the metrics it reports (see metrics_report()
+in src/c/metrics.c). Aplite replays with its own profile; the other platforms replay with emery's,
+the one with the most features, which writes the most flash. With --log, estimates from the
+metrics of a debug build on a watch or the emulator instead, e.g. a `pebble logs` capture or a log
+from tools/run_emulator.py. Reports are hourly, or every minute in test mode (--report-minutes 1).
+
+The event rates are measured; the costs are not. Battery capacities are the specified ones, and
+every current and cost per event below is a placeholder derived from the advertised battery life
+of each watch and typical current draw of its parts, marked UNMEASURED. The estimates are good for
+comparing changes against each other, not for absolute numbers, until the costs are calibrated.
+"""
+import argparse
+import os
+import re
+import subprocess
+
+# Per platform: battery capacity [mAh], specified, and baseline current with the face idle [uA],
+# UNMEASURED
+PLATFORMS = {
+    'aplite': {'battery_mah': 130, 'idle_ua': 500},
+    'basalt': {'battery_mah': 150, 'idle_ua': 550},
+    'chalk': {'battery_mah': 52, 'idle_ua': 900},
+    'diorite': {'battery_mah': 130, 'idle_ua': 450},
+    'emery': {'battery_mah': 150, 'idle_ua': 400},
+    'flint': {'battery_mah': 150, 'idle_ua': 180},
+}
+# Cost per event [uAh], all UNMEASURED
+EVENT_COSTS_UAH = {
+    'wakeups': 0.01,          # CPU out of sleep for a tick or timer
+    'frames': 0.06,           # One redraw and display update
+    'messages': 0.15,         # Radio on for one AppMessage, either direction
+    'message_bytes': 0.002,   # Per byte on top of that
+    'vibe_pulses': 1.7,       # Motor on for one pulse
+    'flash_bytes': 0.001,     # Persistent storage written
+}
+# Larger displays cost more per frame, UNMEASURED
+FRAME_COST_SCALE = {'chalk': 1.2, 'emery': 1.6}
+
+# Standard scenarios, see test/replay.c
+SCENARIOS = ['normal_day', 'flaky_bluetooth', 'one_minute_cgm', 'quiet_night']
+# Host profile each platform replays with
+REPLAY_PROFILES = {'aplite': 'aplite'}
+
+TEST_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', 'test')
+
+# Metric lines from metrics_report(). All counters are totals since startup, except wakeups,
+# which are since the previous report.
+REPORT_PATTERNS = {
+    'frames': re.compile(r'Frames: (\d+),'),
+    'messages': re.compile(r'Messages: in (\d+) \((\d+) B, \d+ rejected\), out (\d+) \((\d+) B\)'),
+    'wakeups': re.compile(r'Wakeups since last report: (\d+) ticks, (\d+) timers'),
+    'vibe_pulses': re.compile(r'Vibes: (\d+) pulses'),
+    'flash_bytes': re.compile(r'Flash: \d+ writes, (\d+) B'),
+}
+
+
+def mah_per_day(platform, per_hour):
+    coefficients = PLATFORMS[platform]
+    uah = coefficients['idle_ua']
+    for event, count in per_hour.items():
+        cost = EVENT_COSTS_UAH[event]
+        if event == 'frames':
+            cost *= FRAME_COST_SCALE.get(platform, 1)
+        uah += cost * count
+    return uah * 24 / 1000
+
+
+def counters_from_log(text):
+    """Returns the counter totals between the first and last report, and the number of report
+    intervals in between."""
+    reports = []
+    for line in text.splitlines():
+        for name, pattern in REPORT_PATTERNS.items():
+            match = pattern.search(line)
+            if not match:
+                continue
+            if name == 'frames':
+                reports.append({})  # First line of a report
+            if not reports:
+                continue
+            report = reports[-1]
+            values = [int(v) for v in match.groups()]
+            if name == 'messages':
+                report['messages'] = values[0] + values[2]
+                report['message_bytes'] = values[1] + values[3]
+            elif name == 'wakeups':
+                report['wakeups'] = sum(values)
+            else:
+                report[name] = values[0]
+    if len(reports) < 2:
+        raise SystemExit('Need at least two metrics reports in the log')
+
+    first, last = reports[0], reports[-1]
+    counters = {name: last.get(name, 0) - first.get(name, 0)
+                for name in EVENT_COSTS_UAH if name != 'wakeups'}
+    counters['wakeups'] = sum(r.get('wakeups', 0) for r in reports[1:])
+    return counters, len(reports) - 1
+
+
+def replay(profile, scenario, hours):
+    """Returns the events per hour of the face replayed in a scenario."""
+    program = os.path.join(TEST_DIR, 'build', 'replay_' + profile)
+    log = subprocess.run([program, scenario, str(hours)], check=True, capture_output=True,
+                         text=True).stdout
+    counters, intervals = counters_from_log(log)
+    return {name: count / intervals for name, count in counters.items()}
+
+
+def print_estimate(platform, name, per_hour):
+    mah = mah_per_day(platform, per_hour)
+    days = PLATFORMS[platform]['battery_mah'] / mah
+    print('{:<8} {:<16} {:6.2f} mAh/day  {:5.1f} days'.format(platform, name, mah, days))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('--platform', choices=sorted(PLATFORMS), action='append')
+    parser.add_argument('--log', help='Log with metrics reports from a debug build')
+    parser.add_argument('--report-minutes', type=int, default=60,
+                        help='Minutes between metrics reports (default: 60)')
+    parser.add_argument('--hours', type=int, default=24,
+                        help='Hours to replay each scenario for (default: 24)')
+    args = parser.parse_args()
+    platforms = args.platform or sorted(PLATFORMS)
+
+    if args.log:
+        with open(args.log) as f:
+            counters, intervals = counters_from_log(f.read())
+        hours = intervals * args.report_minutes / 60
+        per_hour = {name: count / hours for name, count in counters.items()}
+        for platform in platforms:
+            print_estimate(platform, 'log', per_hour)
+        return
+
+    subprocess.run(['make', '-s', '-C', TEST_DIR, 'replay'], check=True)
+    rates = {}
+    for platform in platforms:
+        profile = REPLAY_PROFILES.get(platform, 'emery')
+        for name in SCENARIOS:
+            if (profile, name) not in rates:
+                rates[profile, name] = replay(profile, name, args.hours)
+            print_estimate(platform, name, rates[profile, name])
+    print('Event rates replayed, costs per event UNMEASURED, see the top of this file')
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,216 @@
+#!/usr/bin/env python3
+"""Floods the watchface in the Pebble emulator with data messages at increasing rates, to find the
+highest message rate each platform sustains.
+
+Usage: flood_inbox.py [platform ...] [--out DIR] [--rates R,R,...] [--seconds N] [--window N]
+
+Needs the Pebble SDK's `pebble` tool and its libpebble2. The build is configured with --stress
+(test mode without generated readings, see src/c/test_mode.h), --enable metrics and --log-level
+debug. Messages are sent like xDrip replaying a backlog: one reading per message, a minute apart,
+starting a week ago.
+At most --window messages are outstanding at a time, as the phone waits for ACKs too.
+
+Each rate runs for --seconds, then until the face's next metrics report (every minute), so the
+watch side numbers can be attributed to it:
+
+  sent, acked, nacked   phone side, with the ACK latency
+  handled               messages the face applied
+  dropped               messages the system dropped before the face saw them (inbox busy)
+  coalesced             messages whose redraw merged into that of the previous one
+  handler               average time applying a message, without the redraw
+
+The knee is the highest rate with no NACKs or drops and at least 95% of the offered rate acked.
+Backfills should be paced below it.
+"""
+import argparse
+import json
+import os
+import subprocess
+import threading
+import time
+
+from run_emulator import METRICS, ROOT, app_uuid, connect, pebble, target_platforms
+
+DEFAULT_RATES = [1, 2, 4, 8, 16, 32, 64]  # Messages per second
+READING_INTERVAL = 60                     # Seconds between the readings sent
+SUSTAINED_ACKED = 0.95
+
+
+class Flooder:
+    """Sends readings through AppMessage and tracks their ACKs."""
+
+    def __init__(self, connection, window):
+        from libpebble2.services.appmessage import AppMessageService
+
+        self.service = AppMessageService(connection)
+        self.service.register_handler('ack', lambda tid: self._done(tid, acked=True))
+        self.service.register_handler('nack', lambda tid: self._done(tid, acked=False))
+        self.uuid = app_uuid()
+        self.window = window
+        self.timestamp = int(time.time()) - 7 * 24 * 60 * 60
+        self.lock = threading.Lock()
+        self.outstanding = {}  # Transaction ID -> send time
+
+    def _done(self, transaction_id, acked):
+        with self.lock:
+            sent_at = self.outstanding.pop(transaction_id, None)
+            if sent_at is None:
+                return
+            if acked:
+                self.acked += 1
+                self.latencies.append(time.time() - sent_at)
+            else:
+                self.nacked += 1
+
+    def run(self, rate, seconds):
+        from libpebble2.services.appmessage import CString, Uint8, Uint32
+
+        self.sent = self.acked = self.nacked = self.blocked = 0
+        self.latencies = []
+        start = time.time()
+        for i in range(int(rate * seconds)):
+            delay = start + i / rate - time.time()
+            if delay > 0:
+                time.sleep(delay)
+            with self.lock:
+                if len(self.outstanding) >= self.window:
+                    self.blocked += 1
+                    continue
+            self.timestamp += READING_INTERVAL
+            mgdl = 120 + (self.sent % 40) - 20
+            transaction_id = self.service.send_message(self.uuid, {
+                10: Uint32(self.timestamp),
+                11: CString(str(mgdl)),
+                12: CString('+1'),
+                13: Uint8(4),
+            })
+            with self.lock:
+                self.outstanding[transaction_id] = time.time()
+            self.sent += 1
+        # Give the last messages time to be acknowledged
+        time.sleep(1)
+        with self.lock:
+            self.outstanding.clear()
+        latencies = sorted(self.latencies) or [0]
+        return {
+            'rate': rate,
+            'sent': self.sent,
+            'blocked': self.blocked,
+            'acked': self.acked,
+            'nacked': self.nacked,
+            'acked_per_s': round(self.acked / seconds, 1),
+            'latency_p50_ms': round(latencies[len(latencies) // 2] * 1000),
+            'latency_p95_ms': round(latencies[len(latencies) * 95 // 100] * 1000),
+        }
+
+
+class WatchReports:
+    """Follows the cumulative message counters the face logs with every metrics report."""
+
+    def __init__(self, log_path):
+        self.log_path = log_path
+        self.count = 0
+        self.last = None
+
+    def _read(self):
+        messages = inbox = None
+        count = 0
+        with open(self.log_path) as f:
+            for line in f:
+                match = METRICS['inbox'].search(line)
+                if match:
+                    inbox = tuple(int(v) for v in match.groups())
+                    count += 1
+                match = METRICS['messages'].search(line)
+                if match:
+                    messages = tuple(int(v) for v in match.groups())
+        return count, messages, inbox
+
+    def wait_for_next(self, timeout=90):
+        """Waits for a new report, and returns what changed since the previous one."""
+        deadline = time.time() + timeout
+        while time.time() < deadline:
+            count, messages, inbox = self._read()
+            if count > self.count and messages:
+                break
+            time.sleep(1)
+        else:
+            raise RuntimeError('no metrics report from the face, see ' + self.log_path)
+        self.count = count
+        current = {
+            'handled': messages[0] - messages[2],
+            'rejected': messages[2],
+            'dropped': inbox[0],
+            'coalesced': inbox[1],
+            'handler_ms': inbox[2],
+        }
+        previous, self.last = self.last, current
+        if previous is None:
+            return None
+        delta = {k: current[k] - previous[k] for k in current}
+        delta['handler_avg_ms'] = round(delta.pop('handler_ms') / max(delta['handled'], 1), 2)
+        return delta
+
+
+def is_sustained(step):
+    return (step['nacked'] == 0 and step['dropped'] == 0 and
+            step['acked_per_s'] >= step['rate'] * SUSTAINED_ACKED)
+
+
+def run_platform(platform, out_dir, rates, seconds, window):
+    emulator = ('--emulator', platform)
+    pebble('install', '--vnc', *emulator)
+    log_path = os.path.join(out_dir, '{}-flood.log'.format(platform))
+    with open(log_path, 'w') as log_file:
+        logs = subprocess.Popen(['pebble', 'logs'] + list(emulator), cwd=ROOT, stdout=log_file,
+                                stderr=subprocess.STDOUT)
+    try:
+        connection = connect(platform)
+        flooder = Flooder(connection, window)
+        reports = WatchReports(log_path)
+        reports.wait_for_next()
+        steps = []
+        for rate in rates:
+            step = flooder.run(rate, seconds)
+            step.update(reports.wait_for_next())
+            steps.append(step)
+            print('{}: {}'.format(platform, json.dumps(step, sort_keys=True)))
+        connection.close()
+    finally:
+        logs.terminate()
+        logs.wait()
+        pebble('kill')
+
+    knee = None
+    for step in steps:
+        if not is_sustained(step):
+            break
+        knee = step['rate']
+    return {'steps': steps, 'knee': knee}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('platforms', nargs='*', help='Default: targetPlatforms in package.json')
+    parser.add_argument('--out', default=os.path.join(ROOT, 'build', 'emulator'))
+    parser.add_argument('--rates', default=','.join(str(r) for r in DEFAULT_RATES),
+                        help='Messages per second, in the order they are tried')
+    parser.add_argument('--seconds', type=int, default=40, help='Flood time per rate')
+    parser.add_argument('--window', type=int, default=4, help='Messages awaiting an ACK')
+    args = parser.parse_args()
+
+    os.makedirs(args.out, exist_ok=True)
+    pebble('build', '--', '--stress', '--enable', 'metrics', '--log-level', 'debug')
+
+    rates = [float(r) for r in args.rates.split(',')]
+    results = {}
+    for platform in args.platforms or target_platforms():
+        results[platform] = run_platform(platform, args.out, rates, args.seconds, args.window)
+    with open(os.path.join(args.out, 'flood.json'), 'w') as f:
+        json.dump(results, f, indent=2, sort_keys=True)
+    for platform, result in results.items():
+        print('{}: knee at {} messages/s'.format(platform, result['knee']))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,230 @@
+#!/usr/bin/env python3
+"""Runs the watchface headless in the Pebble emulator on each target platform, and collects
+screenshots, logs and the metrics it reports (see src/c/metrics.h).
+
+Usage: run_emulator.py [platform ...] [--out DIR] [--minutes N]
+
+Needs the Pebble SDK's `pebble` tool and its libpebble2, but no phone or network. The build is
+configured with --stress, so the face reports metrics every minute and has no generated readings,
+with --enable metrics, which release builds leave out, and --log-level debug, so the reports reach
+the log.
+
+The script plays xDrip: it sends AppMessages to the face through the emulator's phone side, as
+tools/flood_inbox.py does. It backfills the last --backfill readings, one per message, then sends a
+new reading every --cadence seconds, and resends the latest one whenever the face announces its
+capabilities. During the run it toggles the connection (which makes the face re-announce) and taps
+to open the detail view, taking a screenshot after each step. A platform fails if it never reports
+metrics, which usually means the face crashed, or if the face rejected or missed messages.
+"""
+import argparse
+import json
+import os
+import re
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+import uuid
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+READING_INTERVAL = 5 * 60  # Seconds between the backfilled readings
+ACK_TIMEOUT = 5            # Seconds
+
+# Metric lines logged by metrics_report(), and the numbers to pick from them
+METRICS = {
+    'frames': re.compile(r'Frames: (\d+), last (\d+) ms, avg (\d+) ms, max (\d+) ms'),
+    'graph': re.compile(r'Graph: avg (\d+) ms, max (\d+) ms'),
+    'messages': re.compile(
+        r'Messages: in (\d+) \((\d+) B, (\d+) rejected\), out (\d+) \((\d+) B\)'),
+    'inbox': re.compile(r'Inbox: (\d+) dropped, (\d+) coalesced, handlers (\d+) ms, max (\d+) ms'),
+    'heap': re.compile(r'Heap: used (\d+) B, peak (\d+) B, min free (\d+) B'),
+}
+
+
+def pebble(*args, **kwargs):
+    return subprocess.run(['pebble'] + list(args), cwd=ROOT, check=True, **kwargs)
+
+
+def target_platforms():
+    with open(os.path.join(ROOT, 'package.json')) as f:
+        return json.load(f)['pebble']['targetPlatforms']
+
+
+def app_uuid():
+    with open(os.path.join(ROOT, 'package.json')) as f:
+        return uuid.UUID(json.load(f)['pebble']['uuid'])
+
+
+def connect(platform):
+    """Connects to the emulator's phone side, as started by `pebble install --emulator`."""
+    from libpebble2.communication import PebbleConnection
+    from libpebble2.communication.transports.websocket import WebsocketTransport
+
+    with open(os.path.join(tempfile.gettempdir(), 'pb-emulator.json')) as f:
+        versions = json.load(f)[platform]
+    info = versions[sorted(versions)[-1]]
+    connection = PebbleConnection(
+        WebsocketTransport('ws://localhost:{}/'.format(info['pypkjs']['port'])))
+    connection.connect()
+    connection.run_async()
+    return connection
+
+
+class Phone:
+    """Sends readings like xDrip, one message at a time, each waiting for its ACK."""
+
+    def __init__(self, connection):
+        from libpebble2.services.appmessage import AppMessageService
+
+        self.service = AppMessageService(connection)
+        self.service.register_handler('ack', lambda tid: self._done(tid, acked=True))
+        self.service.register_handler('nack', lambda tid: self._done(tid, acked=False))
+        self.service.register_handler('appmessage', self._received)
+        self.uuid = app_uuid()
+        self.lock = threading.Lock()
+        self.sending = threading.Lock()  # One message in flight
+        self.answered = threading.Event()
+        self.transaction_id = None
+        self.latest = None
+        self.mgdl = 120
+        self.sent = self.acked = self.nacked = self.announcements = 0
+
+    def _done(self, transaction_id, acked):
+        with self.lock:
+            if transaction_id != self.transaction_id:
+                return
+            if acked:
+                self.acked += 1
+            else:
+                self.nacked += 1
+            self.answered.set()
+
+    def _received(self, transaction_id, app_uuid, data):
+        # Keys 0 and 1 are the protocol version and capabilities of an announcement
+        if app_uuid != self.uuid or 1 not in data:
+            return
+        self.announcements += 1
+        # xDrip answers an announcement with its latest data. Not from this thread, which
+        # delivers the ACKs.
+        if self.latest:
+            threading.Thread(target=self._send, args=(self.latest,)).start()
+
+    def _send(self, message):
+        with self.sending:
+            with self.lock:
+                self.answered.clear()
+                self.transaction_id = self.service.send_message(self.uuid, message)
+                self.sent += 1
+            self.answered.wait(ACK_TIMEOUT)
+
+    def send_reading(self, timestamp):
+        from libpebble2.services.appmessage import CString, Uint8, Uint32
+
+        # A slow sine-like walk through the range, so the graph and the arrow change
+        step = [3, 6, 9, 6, 3, 0, -3, -6, -9, -6, -3, 0][(timestamp // READING_INTERVAL) % 12]
+        self.mgdl = max(40, min(400, self.mgdl + step))
+        arrow = 4 - step // 3
+        self.latest = {
+            10: Uint32(timestamp),
+            11: CString(str(self.mgdl)),
+            12: CString('{:+d}'.format(step)),
+            13: Uint8(arrow),
+            14: CString('1.25U'),
+            15: CString('20g'),
+            16: CString('6d 4h'),
+            17: Uint8(80),
+        }
+        self._send(self.latest)
+
+    def totals(self):
+        return {'sent': self.sent, 'acked': self.acked, 'nacked': self.nacked,
+                'announcements': self.announcements}
+
+
+def parse_metrics(log):
+    """Returns the last reported value of each metric line, as tuples of ints."""
+    metrics = {}
+    for line in log.splitlines():
+        for name, pattern in METRICS.items():
+            match = pattern.search(line)
+            if match:
+                metrics[name] = tuple(int(v) for v in match.groups())
+    return metrics
+
+
+def run_platform(platform, out_dir, minutes, backfill, cadence):
+    emulator = ('--emulator', platform)
+    pebble('install', '--vnc', *emulator)
+    with open(os.path.join(out_dir, '{}.log'.format(platform)), 'w+') as log_file:
+        logs = subprocess.Popen(['pebble', 'logs'] + list(emulator), cwd=ROOT, stdout=log_file,
+                                stderr=subprocess.STDOUT)
+        try:
+            connection = connect(platform)
+            phone = Phone(connection)
+            start = int(time.time())
+            for i in range(backfill, 0, -1):
+                phone.send_reading(start - i * READING_INTERVAL)
+            time.sleep(2)
+            pebble('screenshot', '--no-open', *emulator,
+                   os.path.join(out_dir, '{}-start.png'.format(platform)))
+            pebble('emu-bt-connection', '--connected', 'no', *emulator)
+            time.sleep(2)
+            pebble('emu-bt-connection', '--connected', 'yes', *emulator)
+            # Past the face's connection settling, and its announcement
+            time.sleep(8)
+            pebble('emu-tap', *emulator)
+            time.sleep(1)
+            pebble('screenshot', '--no-open', *emulator,
+                   os.path.join(out_dir, '{}-detail.png'.format(platform)))
+            # Metrics are reported on the minute tick
+            end = time.time() + minutes * 60
+            while time.time() < end:
+                time.sleep(min(cadence, max(end - time.time(), 0)))
+                phone.send_reading(int(time.time()))
+            time.sleep(65)
+            connection.close()
+        finally:
+            logs.terminate()
+            logs.wait()
+            pebble('kill')
+        log_file.seek(0)
+        metrics = parse_metrics(log_file.read())
+        metrics['phone'] = phone.totals()
+        return metrics
+
+
+def is_healthy(metrics):
+    """Whether the face reported, and applied every message the phone got an ACK for."""
+    if 'heap' not in metrics or 'messages' not in metrics:
+        return False
+    received, _, rejected = metrics['messages'][:3]
+    phone = metrics['phone']
+    return phone['nacked'] == 0 and rejected == 0 and received >= phone['acked']
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('platforms', nargs='*', help='Default: targetPlatforms in package.json')
+    parser.add_argument('--out', default=os.path.join(ROOT, 'build', 'emulator'))
+    parser.add_argument('--minutes', type=int, default=2, help='Run time per platform')
+    parser.add_argument('--backfill', type=int, default=36,
+                        help='Readings sent at the start, {} s apart'.format(READING_INTERVAL))
+    parser.add_argument('--cadence', type=int, default=20,
+                        help='Seconds between new readings during the run')
+    args = parser.parse_args()
+
+    os.makedirs(args.out, exist_ok=True)
+    pebble('build', '--', '--stress', '--enable', 'metrics', '--log-level', 'debug')
+
+    failed = False
+    for platform in args.platforms or target_platforms():
+        metrics = run_platform(platform, args.out, args.minutes, args.backfill, args.cadence)
+        print('{}: {}'.format(platform, json.dumps(metrics, sort_keys=True)))
+        failed = failed or not is_healthy(metrics)
+    sys.exit(1 if failed else 0)
+
+
+if __name__ == '__main__':
+    main()